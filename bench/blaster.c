@@ -0,0 +1,173 @@
+/*
+ * send the synthetic traffic of ipmi_gen.c over real sockets at a fixed
+ * packet rate, for the capture benchmark(capture_bench.sh)
+ *
+ * every manager port and every BMC address has a socket of its own(the BMC
+ * one bound to port 623), so the packets on the wire have the addresses and
+ * ports of the generated conversation. on lo any address of
+ * 127.0.0.0/8 can be bound, with a veth pair the addresses must be routed
+ * through it. the corpus is sent again and again until the duration is over
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "ipmi_gen.h"
+
+#define BLAST_TICK_NS       1000000     /* packets are sent in a burst every tick */
+
+static void usage(void) {
+    fprintf(stderr, "Usage: blaster [-r pps] [-t secs] [-b bmcs] [-m manager] [-n bmc_net]\n");
+    fprintf(stderr, "  -r pps: packets per second, default 10000\n");
+    fprintf(stderr, "  -t secs: duration, default 5\n");
+    fprintf(stderr, "  -b bmcs: BMCs of the generated traffic, also sockets opened, default 256\n");
+    fprintf(stderr, "  -m manager: address of the manager, default 127.0.0.1\n");
+    fprintf(stderr, "  -n bmc_net: address of the first BMC, the next ones follow it, default 127.1.0.1\n");
+}
+
+static int open_socket(u_int32_t addr, u_short port) {
+    struct sockaddr_in sin;
+    int fd, one = 1;
+
+    fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if ( fd == -1 ){
+        return -1;
+    }
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    memset(&sin, 0, sizeof(sin));
+    sin.sin_family = AF_INET;
+    sin.sin_addr.s_addr = addr;
+    sin.sin_port = htons(port);
+    if ( bind(fd, (struct sockaddr *)&sin, sizeof(sin)) == -1 ){
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static void tick_add(struct timespec *t, long ns) {
+    t->tv_nsec += ns;
+    while ( t->tv_nsec >= 1000000000 ){
+        t->tv_sec++;
+        t->tv_nsec -= 1000000000;
+    }
+}
+
+int main(int argc, char *argv[]) {
+    struct gen_corpus c;
+    struct gen_packet *p;
+    struct sockaddr_in to;
+    struct timespec next, start, end;
+    u_int32_t manager = htonl(0x7f000001), bmc_net = htonl(0x7f010001);
+    unsigned long long sent = 0, failed = 0, due;
+    double rate = 10000, secs = 5, elapsed;
+    int bmcs = 256, ch, i, fd, k;
+    int *bmc_fds, *client_fds;
+
+    while ( (ch = getopt(argc, argv, "r:t:b:m:n:")) != -1 ){
+        switch ( ch ){
+            case 'r':
+                rate = atof(optarg);
+                break;
+            case 't':
+                secs = atof(optarg);
+                break;
+            case 'b':
+                bmcs = atoi(optarg);
+                break;
+            case 'm':
+                manager = inet_addr(optarg);
+                break;
+            case 'n':
+                bmc_net = inet_addr(optarg);
+                break;
+            default:
+                usage();
+                return (2);
+        }
+    }
+    if ( rate <= 0 || secs <= 0 || bmcs <= 0 || bmcs > 20000 ){
+        usage();
+        return (2);
+    }
+
+    if ( gen_corpus_build(&c, bmcs, 8) == -1 ){
+        fprintf(stderr, "out of memory for the corpus\n");
+        return (1);
+    }
+
+    /* the corpus numbers BMCs as 10.1.x.y from 0 and the manager ports from GEN_CLIENT_PORT */
+    bmc_fds = (int *)calloc(bmcs, sizeof(int));
+    client_fds = (int *)calloc(bmcs, sizeof(int));
+    if ( bmc_fds == NULL || client_fds == NULL ){
+        fprintf(stderr, "out of memory for the sockets\n");
+        return (1);
+    }
+    for ( i = 0; i < bmcs; i++ ){
+        bmc_fds[i] = open_socket(htonl(ntohl(bmc_net) + i), GEN_RMCP_PORT);
+        client_fds[i] = open_socket(manager, GEN_CLIENT_PORT + i);
+        if ( bmc_fds[i] == -1 || client_fds[i] == -1 ){
+            fprintf(stderr, "Couldn't bind the sockets of BMC %d: %s\n", i, strerror(errno));
+            return (1);
+        }
+    }
+
+    memset(&to, 0, sizeof(to));
+    to.sin_family = AF_INET;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    next = start;
+    k = 0;
+    for ( ;; ){
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+        if ( elapsed >= secs ){
+            break;
+        }
+
+        /* catch up with the packets due by now, a late tick sends a larger burst */
+        due = (unsigned long long)(elapsed * rate) + 1;
+        while ( sent + failed < due ){
+            p = &c.pkts[k];
+            k = (k + 1) % c.count;
+            i = (ntohl(p->src_port == GEN_RMCP_PORT ? p->src_addr : p->dst_addr) & 0xffff);
+            if ( p->src_port == GEN_RMCP_PORT ){
+                fd = bmc_fds[i];
+                to.sin_addr.s_addr = manager;
+                to.sin_port = htons(p->dst_port);
+            }
+            else {
+                fd = client_fds[i];
+                to.sin_addr.s_addr = htonl(ntohl(bmc_net) + i);
+                to.sin_port = htons(GEN_RMCP_PORT);
+            }
+            if ( sendto(fd, p->payload, p->len, 0, (struct sockaddr *)&to, sizeof(to)) == p->len ){
+                sent++;
+            }
+            else {
+                failed++;
+            }
+        }
+
+        tick_add(&next, BLAST_TICK_NS);
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+    }
+
+    /* one line the benchmark script parses */
+    printf("sent %llu failed %llu secs %.3f pps %.0f\n", sent, failed, elapsed, sent / elapsed);
+
+    for ( i = 0; i < bmcs; i++ ){
+        close(bmc_fds[i]);
+        close(client_fds[i]);
+    }
+    free(bmc_fds);
+    free(client_fds);
+    gen_corpus_free(&c);
+    return (0);
+}
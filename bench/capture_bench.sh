@@ -0,0 +1,150 @@
+#!/bin/sh
+#
+# end to end capture benchmark: bench/blaster sends the generated IPMI traffic
+# at increasing rates while ipmidump captures it, for every capture backend and
+# output mode. the sustained rate of a combination is the highest rate reached
+# before the kernel(Capture: line), the -Q queue(Queue: line) or the decoder
+# (Decoder: line, against the packets sent) lost a packet. when bench/blaster
+# cannot send as fast as asked, the run is marked sender_limited and the rate
+# it reached is the sustained one: the capture was not the limit.
+#
+# the results are written as JSON, one combination per line, and compared to a
+# former baseline with -c: a sustained rate more than 10% under the baseline
+# one is reported and the script fails.
+#
+# needs root(AF_PACKET), run from the top of the tree: make capture-bench
+#
+usage() {
+    echo "Usage: bench/capture_bench.sh [-i iface] [-t secs] [-r \"rates\"] [-o out.json] [-c baseline.json]" >&2
+    echo "  -i iface: interface to capture, default lo(a veth needs -m and -n of bench/blaster in BLASTER_OPTS)" >&2
+    echo "  -t secs: duration of every run, default 3" >&2
+    echo "  -r rates: packets per second tried in order, default \"$RATES\"" >&2
+    echo "  -o out.json: results, default bench/capture_baseline.json" >&2
+    echo "  -c baseline.json: compare with a former run" >&2
+}
+
+IFACE=lo
+SECS=3
+RATES="10000 20000 50000 100000 200000 400000 800000"
+OUT=bench/capture_baseline.json
+BASELINE=
+IPMIDUMP=./ipmidump
+BLASTER=./bench/blaster
+
+while getopts "i:t:r:o:c:" opt; do
+    case $opt in
+        i) IFACE=$OPTARG ;;
+        t) SECS=$OPTARG ;;
+        r) RATES=$OPTARG ;;
+        o) OUT=$OPTARG ;;
+        c) BASELINE=$OPTARG ;;
+        *) usage; exit 2 ;;
+    esac
+done
+
+# backend name and its options
+BACKENDS="libpcap: tpacket:-T tpacket-queue:-T#-Q#65536 libpcap-queue:-Q#65536"
+# output mode name and its options
+OUTPUTS="text: text-nohex:-X aggregate:-A#3600"
+
+TMP=$(mktemp -d) || exit 1
+trap 'rm -rf "$TMP"' EXIT
+
+# one run: prints "rate sent decoded kernel_drop queue_drop", or nothing when ipmidump did not start
+run() {
+    rate=$1
+    shift
+    "$IPMIDUMP" -i "$IFACE" "$@" > /dev/null 2> "$TMP/err" &
+    pid=$!
+    sleep 1
+    if ! kill -0 $pid 2> /dev/null; then
+        return
+    fi
+    $BLASTER -r "$rate" -t "$SECS" $BLASTER_OPTS > "$TMP/sent"
+    # let the decoder drain what is queued
+    sleep 1
+    kill -INT $pid
+    wait $pid
+    awk -v rate="$rate" '
+        FILENAME ~ /sent$/ { sent = $2 }
+        /^Capture:/ { kdrop += $5 + $10 }
+        /^Queue:/ { qdrop += $13 }
+        /^Decoder:/ { decoded += $2 }
+        END { printf "%d %d %d %d %d\n", rate, sent, decoded, kdrop, qdrop }
+    ' "$TMP/sent" "$TMP/err"
+}
+
+: > "$OUT.tmp"
+for backend in $BACKENDS; do
+    bname=${backend%%:*}
+    bopts=$(echo "${backend#*:}" | tr '#' ' ')
+    for output in $OUTPUTS; do
+        oname=${output%%:*}
+        oopts=$(echo "${output#*:}" | tr '#' ' ')
+        sustained=0
+        runs=
+        for rate in $RATES; do
+            line=$(run "$rate" $bopts $oopts)
+            if [ -z "$line" ]; then
+                echo "$bname/$oname: ipmidump did not start, skipped" >&2
+                break
+            fi
+            set -- $line
+            # bench/blaster may not keep up with the rate asked, the rate reached counts
+            reached=$(awk -v sent="$2" -v secs="$SECS" 'BEGIN { printf "%d", sent / secs }')
+            limited=$(awk -v reached="$reached" -v rate="$rate" 'BEGIN { print (reached < rate * 0.9) ? "true" : "false" }')
+            echo "$bname/$oname: $rate pps($reached reached), sent $2, decoded $3, kernel drops $4, queue drops $5" >&2
+            runs="$runs${runs:+, }{\"rate\": $1, \"reached\": $reached, \"sender_limited\": $limited, \"sent\": $2, \"decoded\": $3, \"kernel_drop\": $4, \"queue_drop\": $5}"
+            if [ "$4" -ne 0 ] || [ "$5" -ne 0 ] || [ "$3" -lt "$2" ]; then
+                break
+            fi
+            sustained=$reached
+            if [ "$limited" = true ]; then
+                echo "$bname/$oname: the sender is the limit, higher rates skipped" >&2
+                break
+            fi
+        done
+        if [ -n "$runs" ]; then
+            echo "  {\"backend\": \"$bname\", \"output\": \"$oname\", \"sustained_pps\": $sustained, \"runs\": [$runs]}" >> "$OUT.tmp"
+        fi
+    done
+done
+
+{
+    echo "{\"host\": \"$(uname -n)\", \"kernel\": \"$(uname -r)\", \"date\": \"$(date -u +%Y-%m-%dT%H:%M:%SZ)\", \"iface\": \"$IFACE\", \"secs\": $SECS, \"results\": ["
+    sed '$!s/$/,/' "$OUT.tmp"
+    echo "]}"
+} > "$OUT"
+rm -f "$OUT.tmp"
+echo "results written to $OUT" >&2
+
+if [ -n "$BASELINE" ]; then
+    # every result is on a line of its own, see above
+    awk '
+        function field(name,   v) {
+            v = $0
+            sub(".*\"" name "\": \"?", "", v)
+            sub("[\",].*", "", v)
+            return v
+        }
+        /"backend"/ {
+            key = field("backend") "/" field("output")
+            if ( FILENAME == ARGV[1] ) {
+                base[key] = field("sustained_pps")
+                next
+            }
+            if ( !(key in base) ) {
+                next
+            }
+            now = field("sustained_pps")
+            if ( now < base[key] * 0.9 ) {
+                printf "REGRESSION %s: %d pps, baseline %d pps\n", key, now, base[key]
+                bad = 1
+            }
+            else {
+                printf "ok %s: %d pps, baseline %d pps\n", key, now, base[key]
+            }
+        }
+        END { exit bad }
+    ' "$BASELINE" "$OUT"
+fi
@@ -0,0 +1,146 @@
+/*
+ * microbenchmark of the decoders
+ *
+ * generates the traffic of many BMCs(ipmi_gen.c) and feeds every udp payload
+ * to print_rmcp from memory, the way got_packet does after the udp header, at
+ * each dump level with the text written to /dev/null, then in the aggregate
+ * only mode(-A). malloc and friends are wrapped by the linker(--wrap), so the
+ * allocations of the first pass(records and tables being built) and of the
+ * passes after it(steady state, should be none) are counted per packet
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/types.h>
+
+#include "dump.h"
+#include "output.h"
+#include "stats.h"
+#include "ipmi_gen.h"
+
+#define BENCH_BMCS      1024
+#define BENCH_POLLS     8
+#define BENCH_MIN_SEC   0.5     /* measured passes last at least this */
+
+DUMP_TLS struct dump_packet dump_pkt;
+DUMP_TLS struct dump_counters dump_cnt;
+
+extern void print_rmcp(const u_char *payload, int payload_len, enum dump_level dl);
+
+static unsigned long allocs;
+
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t n, size_t size);
+void* __real_realloc(void *p, size_t size);
+int __real_posix_memalign(void **p, size_t align, size_t size);
+
+void* __wrap_malloc(size_t size) {
+    allocs++;
+    return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t n, size_t size) {
+    allocs++;
+    return __real_calloc(n, size);
+}
+
+void* __wrap_realloc(void *p, size_t size) {
+    allocs++;
+    return __real_realloc(p, size);
+}
+
+int __wrap_posix_memalign(void **p, size_t align, size_t size) {
+    allocs++;
+    return __real_posix_memalign(p, align, size);
+}
+
+static double now_sec(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* one pass over the corpus, as got_packet decodes it */
+static void decode_pass(const struct gen_corpus *c, enum dump_level dl) {
+    const struct gen_packet *p;
+    int i;
+
+    for ( i = 0; i < c->count; i++ ){
+        p = &c->pkts[i];
+        dump_pkt.ts = p->ts;
+        dump_pkt.src_addr = p->src_addr;
+        dump_pkt.dst_addr = p->dst_addr;
+        dump_pkt.src_port = p->src_port;
+        dump_pkt.dst_port = p->dst_port;
+        if ( dump_stats ){
+            if ( p->src_port == GEN_RMCP_PORT ){
+                stats_packet(DUMP_BMC_KEY(p->src_addr, p->src_port), DUMP_BMC_KEY(p->dst_addr, p->dst_port), p->len);
+            }
+            else {
+                stats_packet(DUMP_BMC_KEY(p->dst_addr, p->dst_port), DUMP_BMC_KEY(p->src_addr, p->src_port), p->len);
+            }
+        }
+        print_rmcp(p->payload, p->len, dl);
+        out_packet_end();
+    }
+}
+
+static void measure(const struct gen_corpus *c, const char *mode, const char *level, enum dump_level dl) {
+    unsigned long cold, warm;
+    double start, sec;
+    int passes = 0;
+
+    allocs = 0;
+    decode_pass(c, dl);
+    cold = allocs;
+
+    allocs = 0;
+    start = now_sec();
+    do {
+        decode_pass(c, dl);
+        passes++;
+        sec = now_sec() - start;
+    } while ( sec < BENCH_MIN_SEC );
+    warm = allocs;
+
+    printf("%-10s %-7s %10.0f %8.1f %12.4f %12.4f\n", mode, level,
+            (double)c->count * passes / sec, sec * 1e9 / ((double)c->count * passes),
+            (double)cold / c->count, (double)warm / ((double)c->count * passes));
+}
+
+int main(int argc, char *argv[]) {
+    static const char *names[] = { [DL_RMCP] = "rmcp", [DL_ASF] = "asf", [DL_IPMI_HEADER] = "header", [DL_IPMI] = "ipmi" };
+    struct gen_corpus c;
+    int devnull, dl;
+
+    if ( gen_corpus_build(&c, BENCH_BMCS, BENCH_POLLS) == -1 ){
+        fprintf(stderr, "out of memory for the corpus\n");
+        return (1);
+    }
+    devnull = open("/dev/null", O_WRONLY);
+    if ( devnull == -1 ){
+        perror("/dev/null");
+        return (1);
+    }
+    out_init(devnull);
+
+    printf("%d packets of %d BMCs\n", c.count, BENCH_BMCS);
+    printf("%-10s %-7s %10s %8s %12s %12s\n", "output", "level", "pkts/s", "ns/pkt", "allocs/pkt", "steady/pkt");
+    for ( dl = DL_RMCP; dl <= DL_IPMI; dl++ ){
+        measure(&c, "text", names[dl], dl);
+    }
+    out_flush();
+
+    /* the first aggregate pass allocates the counters of every BMC and client */
+    if ( stats_open(3600, "/dev/null") == -1 ){
+        perror("/dev/null");
+        return (1);
+    }
+    measure(&c, "aggregate", names[DL_IPMI], DL_IPMI);
+
+    gen_corpus_free(&c);
+    return (0);
+}
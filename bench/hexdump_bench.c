@@ -0,0 +1,176 @@
+/*
+ * microbenchmark of the payload hex dump
+ *
+ * compares the printf per byte dump ipmidump used before hexdump.c with every
+ * kernel this cpu supports. the output of each kernel is checked against the
+ * printf one first, so a faster but wrong kernel never shows up as a win
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#include <sys/types.h>
+
+#include "hexdump.h"
+
+#define CHECK_MAX_LEN   300
+#define ROUNDS_BYTES    (64UL << 20)    /* bytes dumped per measure */
+
+/* the former print_hex_ascii_line of main.c, printing to f */
+static void legacy_line(FILE *f, const u_char *payload, int len, int offset) {
+    int i;
+    int gap;
+    const u_char *ch;
+
+    fprintf(f, "%05d   ", offset);
+    ch = payload;
+    for(i = 0; i < len; i++) {
+        fprintf(f, "%02x ", *ch);
+        ch++;
+        if (i == 7)
+            fprintf(f, " ");
+    }
+    if (len < 8)
+        fprintf(f, " ");
+    if (len < 16) {
+        gap = 16 - len;
+        for (i = 0; i < gap; i++) {
+            fprintf(f, "   ");
+        }
+    }
+    fprintf(f, "   ");
+    ch = payload;
+    for(i = 0; i < len; i++) {
+        if (isprint(*ch))
+            fprintf(f, "%c", *ch);
+        else
+            fprintf(f, ".");
+        ch++;
+    }
+    fprintf(f, "\n");
+}
+
+/* the former print_payload of main.c */
+static void legacy_payload(FILE *f, const u_char *payload, int len) {
+    int len_rem = len;
+    int line_width = 16;
+    int line_len;
+    int offset = 0;
+    const u_char *ch = payload;
+
+    if (len <= 0)
+        return;
+    if (len <= line_width) {
+        legacy_line(f, ch, len, offset);
+        return;
+    }
+    for ( ;; ) {
+        line_len = line_width % len_rem;
+        legacy_line(f, ch, line_len, offset);
+        len_rem = len_rem - line_len;
+        ch = ch + line_len;
+        offset = offset + line_width;
+        if (len_rem <= line_width) {
+            legacy_line(f, ch, len_rem, offset);
+            break;
+        }
+    }
+}
+
+static double now_sec(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int check(const char *kernel, const u_char *data, char *expect, char *got) {
+    FILE *f;
+    size_t n, m;
+    int len;
+
+    for ( len = 1; len <= CHECK_MAX_LEN; len++ ){
+        f = fmemopen(expect, hexdump_size(CHECK_MAX_LEN, HEXDUMP_DEF_WIDTH), "w");
+        legacy_payload(f, data, len);
+        n = ftell(f);
+        fclose(f);
+
+        m = hexdump_render(got, data, len, 0, HEXDUMP_DEF_WIDTH);
+        if ( n != m || memcmp(expect, got, n) != 0 ){
+            fprintf(stderr, "%s: output differs from printf for %d bytes\n", kernel, len);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* MB/s of payload dumped, payloads of len bytes */
+static double measure_legacy(const u_char *data, int len) {
+    FILE *f = fopen("/dev/null", "w");
+    unsigned long done = 0;
+    double start;
+
+    setvbuf(f, NULL, _IOFBF, 1 << 20);
+    start = now_sec();
+    while ( done < ROUNDS_BYTES / 16 ){
+        legacy_payload(f, data + done % 4096, len);
+        done += len;
+    }
+    fflush(f);
+    fclose(f);
+    return done / (now_sec() - start) / 1e6;
+}
+
+static double measure(const u_char *data, int len, char *out) {
+    unsigned long done = 0;
+    volatile size_t sink = 0;
+    double start;
+
+    start = now_sec();
+    while ( done < ROUNDS_BYTES ){
+        sink += hexdump_render(out, data + done % 4096, len, 0, HEXDUMP_DEF_WIDTH);
+        done += len;
+    }
+    (void)sink;
+    return done / (now_sec() - start) / 1e6;
+}
+
+int main(int argc, char *argv[]) {
+    static const char *kernels[] = { "scalar", "sse2", "avx2" };
+    static const int lens[] = { 28, 64, 256, 1472 };
+    u_char *data;
+    char *expect, *got;
+    double base, mbs;
+    int i, k;
+
+    data = (u_char *)malloc(8192);
+    expect = (char *)malloc(hexdump_size(8192, HEXDUMP_MAX_WIDTH));
+    got = (char *)malloc(hexdump_size(8192, HEXDUMP_MAX_WIDTH));
+    srand(623);
+    for ( i = 0; i < 8192; i++ ){
+        data[i] = rand() & 0xff;
+    }
+
+    printf("%-8s %6s %10s %8s\n", "kernel", "bytes", "MB/s", "speedup");
+    for ( i = 0; i < (int)(sizeof(lens) / sizeof(lens[0])); i++ ){
+        base = measure_legacy(data, lens[i]);
+        printf("%-8s %6d %10.1f %8s\n", "printf", lens[i], base, "1.0x");
+
+        for ( k = 0; k < (int)(sizeof(kernels) / sizeof(kernels[0])); k++ ){
+            if ( hexdump_select(kernels[k]) == -1 ){
+                continue;
+            }
+            if ( check(kernels[k], data, expect, got) == -1 ){
+                return (1);
+            }
+            mbs = measure(data, lens[i], got);
+            printf("%-8s %6d %10.1f %7.1fx\n", kernels[k], lens[i], mbs, mbs / base);
+        }
+    }
+
+    free(data);
+    free(expect);
+    free(got);
+    return (0);
+}
@@ -0,0 +1,483 @@
+/*
+ * synthetic IPMI traffic, see ipmi_gen.h
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <arpa/inet.h>
+
+#include "ipmi_gen.h"
+
+#define GEN_RECORDS         9       /* per BMC: a controller locator, 6 full and 2 compact sensors */
+#define GEN_FULL_SENSORS    6
+#define GEN_SDR_READ        16      /* bytes of a partial Get SDR */
+#define GEN_GAP_US          10      /* capture time between two packets */
+#define GEN_FRAME_HEADER    (14 + 20 + 8)
+
+/* an SDR record as the BMC sends it, header included */
+struct gen_record {
+    u_char          raw[64];
+    int             len;
+};
+
+/* where a BMC is in its conversation */
+struct gen_bmc {
+    u_int32_t       addr;
+    u_int32_t       client_addr;
+    u_short         client_port;
+    u_int32_t       session;
+    u_char          seq;
+    int             step;
+    int             record;
+    int             offset;
+    int             poll;
+    struct gen_record records[GEN_RECORDS];
+};
+
+static struct timeval gen_ts;
+
+static u_char csum(const u_char *b, int n) {
+    u_char s = 0;
+
+    while ( n-- > 0 ){
+        s += *b++;
+    }
+    return -s;
+}
+
+static struct gen_packet* gen_add(struct gen_corpus *c, int response, const struct gen_bmc *bmc) {
+    struct gen_packet *p;
+
+    if ( c->count == c->cap ){
+        c->cap = c->cap == 0 ? 4096 : c->cap * 2;
+        p = (struct gen_packet *)realloc(c->pkts, (size_t)c->cap * sizeof(struct gen_packet));
+        if ( p == NULL ){
+            return NULL;
+        }
+        c->pkts = p;
+    }
+    p = &c->pkts[c->count++];
+
+    gen_ts.tv_usec += GEN_GAP_US;
+    if ( gen_ts.tv_usec >= 1000000 ){
+        gen_ts.tv_sec++;
+        gen_ts.tv_usec -= 1000000;
+    }
+    p->ts = gen_ts;
+    if ( response ){
+        p->src_addr = bmc->addr;
+        p->src_port = GEN_RMCP_PORT;
+        p->dst_addr = bmc->client_addr;
+        p->dst_port = bmc->client_port;
+    }
+    else {
+        p->src_addr = bmc->client_addr;
+        p->src_port = bmc->client_port;
+        p->dst_addr = bmc->addr;
+        p->dst_port = GEN_RMCP_PORT;
+    }
+    return p;
+}
+
+/* an ipmi 1.5 message without authentication, section 13.6 */
+static int gen_ipmi(struct gen_corpus *c, struct gen_bmc *bmc, int response, u_char netfn, u_char cmd,
+        const u_char *data, int data_len) {
+    struct gen_packet *p = gen_add(c, response, bmc);
+    u_char *m;
+
+    if ( p == NULL ){
+        return -1;
+    }
+    m = p->payload;
+    m[0] = 0x06;            /* rmcp: version, reserved, sequence, class ipmi */
+    m[1] = 0x00;
+    m[2] = 0xff;
+    m[3] = 0x07;
+    m[4] = 0x00;            /* auth type none */
+    memset(m + 5, 0, 4);    /* session sequence */
+    memcpy(m + 9, &bmc->session, 4);
+    m[13] = 7 + data_len;   /* rsAddr netFn csum rqAddr rqSeq cmd data csum */
+    m[14] = response ? 0x81 : 0x20;
+    m[15] = (response ? netfn | 1 : netfn) << 2;
+    m[16] = csum(m + 14, 2);
+    m[17] = response ? 0x20 : 0x81;
+    m[18] = bmc->seq << 2;
+    m[19] = cmd;
+    memcpy(m + 20, data, data_len);
+    m[20 + data_len] = csum(m + 17, 3 + data_len);
+    p->len = 21 + data_len;
+    return 0;
+}
+
+/* a request and its response, under a new rqSeq */
+static int gen_exchange(struct gen_corpus *c, struct gen_bmc *bmc, u_char netfn, u_char cmd,
+        const u_char *rq, int rq_len, const u_char *rs, int rs_len) {
+    bmc->seq = (bmc->seq + 1) & 0x3f;
+    if ( gen_ipmi(c, bmc, 0, netfn, cmd, rq, rq_len) == -1 ){
+        return -1;
+    }
+    return gen_ipmi(c, bmc, 1, netfn, cmd, rs, rs_len);
+}
+
+static int gen_asf(struct gen_corpus *c, struct gen_bmc *bmc, int pong) {
+    struct gen_packet *p = gen_add(c, pong, bmc);
+    u_char *m;
+
+    if ( p == NULL ){
+        return -1;
+    }
+    m = p->payload;
+    memset(m, 0, 28);
+    m[0] = 0x06;
+    m[2] = 0xff;
+    m[3] = 0x06;            /* class asf */
+    m[6] = 0x11;            /* IANA 4542 */
+    m[7] = 0xbe;
+    m[8] = pong ? 0x40 : 0x80;
+    m[11] = pong ? 16 : 0;
+    if ( pong ){
+        m[14] = 0x11;
+        m[15] = 0xbe;
+        m[20] = 0x81;       /* supported entities: ipmi */
+    }
+    p->len = pong ? 28 : 12;
+    return 0;
+}
+
+static void gen_full_sensor(struct gen_record *r, unsigned short rec_id, u_char num, const char *name, int m, int rexp, u_char base) {
+    u_char *b = r->raw;
+    int n = strlen(name);
+
+    memset(b, 0, sizeof(r->raw));
+    b[0] = rec_id & 0xff;
+    b[1] = rec_id >> 8;
+    b[2] = 0x51;
+    b[3] = 0x01;            /* full sensor */
+    b[5] = 0x20;            /* owner */
+    b[7] = num;
+    b[8] = 0x07;            /* entity */
+    b[9] = 0x01;
+    b[10] = 0x7f;
+    b[11] = 0x68;
+    b[12] = base == 1 ? 0x01 : base == 4 ? 0x02 : 0x04;    /* sensor type */
+    b[13] = 0x01;           /* threshold */
+    b[21] = base;           /* unit */
+    b[23] = 0x00;           /* linear */
+    b[24] = m & 0xff;
+    b[25] = (m >> 2) & 0xc0;
+    b[29] = (rexp & 0x0f) << 4;
+    b[31] = 25;
+    b[32] = 80;
+    b[33] = 10;
+    b[34] = 127;
+    b[36] = 100;
+    b[37] = 90;
+    b[38] = 80;
+    b[39] = 5;
+    b[40] = 8;
+    b[41] = 10;
+    b[42] = 2;
+    b[43] = 2;
+    b[47] = 0xc0 | n;
+    memcpy(b + 48, name, n);
+    r->len = 48 + n;
+    b[4] = r->len - 5;
+}
+
+static void gen_compact_sensor(struct gen_record *r, unsigned short rec_id, u_char num, const char *name) {
+    u_char *b = r->raw;
+    int n = strlen(name);
+
+    memset(b, 0, sizeof(r->raw));
+    b[0] = rec_id & 0xff;
+    b[1] = rec_id >> 8;
+    b[2] = 0x51;
+    b[3] = 0x02;            /* compact sensor */
+    b[5] = 0x20;
+    b[7] = num;
+    b[8] = 0x07;
+    b[9] = 0x01;
+    b[10] = 0x7f;
+    b[11] = 0x68;
+    b[12] = 0x08;           /* power supply */
+    b[13] = 0x6f;           /* sensor specific */
+    b[20] = 0xc0;
+    b[31] = 0xc0 | n;
+    memcpy(b + 32, name, n);
+    r->len = 32 + n;
+    b[4] = r->len - 5;
+}
+
+static void gen_mc_locator(struct gen_record *r, unsigned short rec_id, const char *name) {
+    u_char *b = r->raw;
+    int n = strlen(name);
+
+    memset(b, 0, sizeof(r->raw));
+    b[0] = rec_id & 0xff;
+    b[1] = rec_id >> 8;
+    b[2] = 0x51;
+    b[3] = 0x12;            /* management controller device locator */
+    b[5] = 0x20;
+    b[8] = 0xbf;
+    b[12] = 0x2e;
+    b[13] = 0x01;
+    b[15] = 0xc0 | n;
+    memcpy(b + 16, name, n);
+    r->len = 16 + n;
+    b[4] = r->len - 5;
+}
+
+static void gen_bmc_init(struct gen_bmc *bmc, int i) {
+    static const char *names[GEN_FULL_SENSORS] = { "CPU1 Temp", "CPU2 Temp", "Inlet Temp", "12V", "3.3V", "FAN1" };
+    static const u_char bases[GEN_FULL_SENSORS] = { 1, 1, 1, 4, 4, 18 };
+    static const int ms[GEN_FULL_SENSORS] = { 1, 1, 1, 63, 17, 60 };
+    static const int rexps[GEN_FULL_SENSORS] = { 0, 0, 0, -3, -3, 0 };
+    int k;
+
+    memset(bmc, 0, sizeof(*bmc));
+    bmc->addr = htonl(0x0a010000 | (i & 0xffff));           /* 10.1.x.y */
+    bmc->client_addr = htonl(0x0a000001);                   /* 10.0.0.1 */
+    bmc->client_port = GEN_CLIENT_PORT + (i % 20000);
+    bmc->seq = i & 0x3f;
+
+    gen_mc_locator(&bmc->records[0], 1, "BMC");
+    for ( k = 0; k < GEN_FULL_SENSORS; k++ ){
+        gen_full_sensor(&bmc->records[1 + k], 2 + k, 0x30 + k, names[k], ms[k], rexps[k], bases[k]);
+    }
+    gen_compact_sensor(&bmc->records[7], 8, 0x40, "PSU1 Status");
+    gen_compact_sensor(&bmc->records[8], 9, 0x41, "PSU2 Status");
+}
+
+/*
+ * the next exchange of a BMC
+ *
+ * @return: 1 when one was added, 0 when the BMC is done, -1 out of memory
+ */
+static int gen_step(struct gen_corpus *c, struct gen_bmc *bmc, int polls) {
+    u_char rq[24], rs[24];
+    struct gen_record *r;
+    unsigned short next;
+    int n;
+
+    memset(rq, 0, sizeof(rq));
+    memset(rs, 0, sizeof(rs));
+    switch ( bmc->step ){
+        case 0:
+            bmc->step++;
+            return gen_asf(c, bmc, 0) == -1 || gen_asf(c, bmc, 1) == -1 ? -1 : 1;
+        case 1:
+            bmc->step++;
+            rq[0] = 0x0e;
+            rq[1] = 0x04;
+            rs[1] = 0x01;
+            rs[2] = 0x15;
+            return gen_exchange(c, bmc, 0x06, 0x38, rq, 2, rs, 9) == -1 ? -1 : 1;
+        case 2:
+            bmc->step++;
+            rq[0] = 0x02;
+            memcpy(rq + 1, "admin", 5);
+            memcpy(rs + 1, &bmc->addr, 4);      /* temporary session id */
+            return gen_exchange(c, bmc, 0x06, 0x39, rq, 17, rs, 21) == -1 ? -1 : 1;
+        case 3:
+            bmc->step++;
+            rq[0] = 0x02;
+            rq[1] = 0x04;
+            rq[18] = 0x01;
+            rs[1] = 0x02;
+            memcpy(rs + 2, &bmc->addr, 4);
+            rs[6] = 0x07;
+            rs[10] = 0x04;
+            if ( gen_exchange(c, bmc, 0x06, 0x3a, rq, 22, rs, 11) == -1 ){
+                return -1;
+            }
+            bmc->session = bmc->addr;
+            return 1;
+        case 4:
+            bmc->step++;
+            rq[0] = 0x04;
+            rs[1] = 0x04;
+            return gen_exchange(c, bmc, 0x06, 0x3b, rq, 1, rs, 2) == -1 ? -1 : 1;
+        case 5:
+            bmc->step++;
+            rs[1] = 0x51;
+            rs[2] = GEN_RECORDS;
+            rs[4] = 0xe8;
+            rs[5] = 0x03;
+            rs[9] = 0x5f;
+            rs[13] = 0x5e;
+            rs[14] = 0x2f;
+            return gen_exchange(c, bmc, 0x0a, 0x20, rq, 0, rs, 15) == -1 ? -1 : 1;
+        case 6:
+            bmc->step++;
+            rs[1] = 0x01;
+            return gen_exchange(c, bmc, 0x0a, 0x22, rq, 0, rs, 3) == -1 ? -1 : 1;
+        case 7:
+            /* the walk: a read of the header, then the body by GEN_SDR_READ bytes */
+            r = &bmc->records[bmc->record];
+            next = bmc->record + 1 < GEN_RECORDS ? bmc->record + 2 : 0xffff;
+            n = bmc->offset == 0 ? 5 : r->len - bmc->offset < GEN_SDR_READ ? r->len - bmc->offset : GEN_SDR_READ;
+            rq[0] = 0x01;
+            rq[2] = bmc->offset == 0 && bmc->record == 0 ? 0 : bmc->record + 1;
+            rq[4] = bmc->offset;
+            rq[5] = n;
+            rs[1] = next & 0xff;
+            rs[2] = next >> 8;
+            memcpy(rs + 3, r->raw + bmc->offset, n);
+            if ( gen_exchange(c, bmc, 0x0a, 0x23, rq, 6, rs, 3 + n) == -1 ){
+                return -1;
+            }
+            bmc->offset += n;
+            if ( bmc->offset == r->len ){
+                bmc->offset = 0;
+                if ( ++bmc->record == GEN_RECORDS ){
+                    bmc->step++;
+                }
+            }
+            return 1;
+        case 8:
+            /* polls rounds of reading then threshold of every full sensor */
+            if ( bmc->poll == polls * GEN_FULL_SENSORS * 2 ){
+                bmc->step++;
+                return gen_step(c, bmc, polls);
+            }
+            rq[0] = 0x30 + (bmc->poll >> 1) % GEN_FULL_SENSORS;
+            if ( (bmc->poll & 1) == 0 ){
+                rs[1] = 0x20 + (bmc->poll & 0x1f);
+                rs[2] = 0xc0;
+                n = gen_exchange(c, bmc, 0x04, 0x2d, rq, 1, rs, 5);
+            }
+            else {
+                rs[1] = 0x3f;
+                rs[2] = 5;
+                rs[3] = 8;
+                rs[4] = 10;
+                rs[5] = 80;
+                rs[6] = 90;
+                rs[7] = 100;
+                n = gen_exchange(c, bmc, 0x04, 0x27, rq, 1, rs, 8);
+            }
+            bmc->poll++;
+            return n == -1 ? -1 : 1;
+        case 9:
+            bmc->step++;
+            memcpy(rq, &bmc->session, 4);
+            return gen_exchange(c, bmc, 0x06, 0x3c, rq, 4, rs, 1) == -1 ? -1 : 1;
+        default:
+            return 0;
+    }
+}
+
+/*
+ * generate the traffic of bmcs BMCs, one exchange of each in turn
+ *
+ * @polls: rounds of sensor polls after the SDR walk
+ * @return: 0, -1 out of memory
+ */
+int gen_corpus_build(struct gen_corpus *c, int bmcs, int polls) {
+    struct gen_bmc *all;
+    int i, live, ret = 0;
+
+    memset(c, 0, sizeof(*c));
+    all = (struct gen_bmc *)calloc(bmcs, sizeof(struct gen_bmc));
+    if ( all == NULL ){
+        return -1;
+    }
+    gen_ts.tv_sec = 1700000000;
+    gen_ts.tv_usec = 0;
+    for ( i = 0; i < bmcs; i++ ){
+        gen_bmc_init(&all[i], i);
+    }
+
+    do {
+        live = 0;
+        for ( i = 0; i < bmcs; i++ ){
+            ret = gen_step(c, &all[i], polls);
+            if ( ret == -1 ){
+                break;
+            }
+            live += ret;
+        }
+    } while ( live > 0 && ret != -1 );
+
+    free(all);
+    if ( ret == -1 ){
+        gen_corpus_free(c);
+    }
+    return ret == -1 ? -1 : 0;
+}
+
+void gen_corpus_free(struct gen_corpus *c) {
+    free(c->pkts);
+    memset(c, 0, sizeof(*c));
+}
+
+/*
+ * the ethernet frame of a packet
+ *
+ * @frame: room for GEN_FRAME_HEADER + GEN_MAX_PAYLOAD bytes
+ * @return: bytes of the frame
+ */
+int gen_frame(const struct gen_packet *p, u_char *frame) {
+    u_char *ip = frame + 14, *udp = ip + 20;
+    u_int32_t sum = 0;
+    int i;
+
+    memcpy(frame, "\x00\x11\x22\x33\x44\x55\x66\x77\x88\x99\xaa\xbb\x08\x00", 14);
+    memset(ip, 0, 20);
+    ip[0] = 0x45;
+    ip[2] = (20 + 8 + p->len) >> 8;
+    ip[3] = (20 + 8 + p->len) & 0xff;
+    ip[8] = 64;
+    ip[9] = 17;
+    memcpy(ip + 12, &p->src_addr, 4);
+    memcpy(ip + 16, &p->dst_addr, 4);
+    for ( i = 0; i < 20; i += 2 ){
+        sum += ip[i] << 8 | ip[i + 1];
+    }
+    while ( sum >> 16 ){
+        sum = (sum & 0xffff) + (sum >> 16);
+    }
+    ip[10] = ~sum >> 8;
+    ip[11] = ~sum & 0xff;
+
+    udp[0] = p->src_port >> 8;
+    udp[1] = p->src_port & 0xff;
+    udp[2] = p->dst_port >> 8;
+    udp[3] = p->dst_port & 0xff;
+    udp[4] = (8 + p->len) >> 8;
+    udp[5] = (8 + p->len) & 0xff;
+    udp[6] = 0;
+    udp[7] = 0;
+    memcpy(udp + 8, p->payload, p->len);
+    return GEN_FRAME_HEADER + p->len;
+}
+
+/*
+ * write the corpus as a pcap file of ethernet frames
+ *
+ * @return: 0, -1 with errno set
+ */
+int gen_write_pcap(const struct gen_corpus *c, const char *path) {
+    u_int32_t file_header[6] = { 0xa1b2c3d4, 0x00040002, 0, 0, 65535, 1 };
+    u_int32_t rec[4];
+    u_char frame[GEN_FRAME_HEADER + GEN_MAX_PAYLOAD];
+    FILE *f;
+    int i, len;
+
+    f = fopen(path, "wb");
+    if ( f == NULL ){
+        return -1;
+    }
+    fwrite(file_header, sizeof(file_header), 1, f);
+    for ( i = 0; i < c->count; i++ ){
+        len = gen_frame(&c->pkts[i], frame);
+        rec[0] = c->pkts[i].ts.tv_sec;
+        rec[1] = c->pkts[i].ts.tv_usec;
+        rec[2] = len;
+        rec[3] = len;
+        fwrite(rec, sizeof(rec), 1, f);
+        fwrite(frame, len, 1, f);
+    }
+    return fclose(f) == 0 ? 0 : -1;
+}
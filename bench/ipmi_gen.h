@@ -0,0 +1,43 @@
+#ifndef _IPMI_DUMP_BENCH_IPMI_GEN_H
+#define _IPMI_DUMP_BENCH_IPMI_GEN_H
+
+#include <sys/types.h>
+#include <sys/time.h>
+
+/*
+ * synthetic RMCP/ASF/IPMI 1.5 traffic of many BMCs polled by one manager
+ *
+ * every BMC goes through what a monitoring manager does: ASF ping/pong,
+ * session setup, Get SDR Repository Info and Reserve, a walk of its SDR
+ * repository with partial reads of 16 bytes, rounds of Get Sensor Reading and
+ * Get Sensor Threshold for each of its full sensors, and Close Session. the
+ * exchanges of all BMCs are interleaved, a request is always followed by its
+ * response, the way a manager polling them in parallel looks on the wire
+ */
+
+#define GEN_MAX_PAYLOAD     96
+#define GEN_RMCP_PORT       623
+#define GEN_CLIENT_PORT     40000
+
+struct gen_packet {
+    struct timeval  ts;
+    u_int32_t       src_addr;       /* network order */
+    u_int32_t       dst_addr;
+    u_short         src_port;       /* host order */
+    u_short         dst_port;
+    u_short         len;
+    u_char          payload[GEN_MAX_PAYLOAD];
+};
+
+struct gen_corpus {
+    struct gen_packet   *pkts;
+    int                 count;
+    int                 cap;
+};
+
+int gen_corpus_build(struct gen_corpus *c, int bmcs, int polls);
+void gen_corpus_free(struct gen_corpus *c);
+int gen_frame(const struct gen_packet *p, u_char *frame);
+int gen_write_pcap(const struct gen_corpus *c, const char *path);
+
+#endif
@@ -0,0 +1,53 @@
+/*
+ * write the synthetic traffic of ipmi_gen.c to a pcap file, to replay it or
+ * decode it with ipmidump -r
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "ipmi_gen.h"
+
+static void usage(void) {
+    fprintf(stderr, "Usage: ipmigen [-b bmcs] [-p polls] file.pcap\n");
+    fprintf(stderr, "  -b bmcs: BMCs polled by the manager, default 1024\n");
+    fprintf(stderr, "  -p polls: rounds of sensor polls after the SDR walk, default 8\n");
+}
+
+int main(int argc, char *argv[]) {
+    struct gen_corpus c;
+    int bmcs = 1024, polls = 8;
+    int ch;
+
+    while ( (ch = getopt(argc, argv, "b:p:")) != -1 ){
+        switch ( ch ){
+            case 'b':
+                bmcs = atoi(optarg);
+                break;
+            case 'p':
+                polls = atoi(optarg);
+                break;
+            default:
+                usage();
+                return (2);
+        }
+    }
+    if ( optind != argc - 1 || bmcs <= 0 || bmcs > 65536 || polls < 0 ){
+        usage();
+        return (2);
+    }
+
+    if ( gen_corpus_build(&c, bmcs, polls) == -1 ){
+        fprintf(stderr, "out of memory for the corpus\n");
+        return (1);
+    }
+    if ( gen_write_pcap(&c, argv[optind]) == -1 ){
+        fprintf(stderr, "Couldn't write %s: %s\n", argv[optind], strerror(errno));
+        return (1);
+    }
+    printf("%d packets of %d BMCs written to %s\n", c.count, bmcs, argv[optind]);
+    gen_corpus_free(&c);
+    return (0);
+}
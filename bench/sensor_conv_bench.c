@@ -0,0 +1,168 @@
+/*
+ * microbenchmark of the sensor reading conversion
+ *
+ * compares the pow() per reading conversion ipmidump used before sensor_conv.c
+ * with a load from the per sensor table. every table is checked against the
+ * conversion in double first, a table only has float precision
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <sys/types.h>
+
+#include "sensor_conv.h"
+
+#define SENSORS         64
+#define READINGS        (16UL << 20)    /* readings converted per measure */
+
+/* the former convert_sensor_reading of ipmi_sdr.c, B fixed, without linearization */
+static double legacy_convert(const struct ipmi_sdr_type_full_sensor *fs, u_char val) {
+    int m,b,k1,k2,si;
+    double result;
+    m = __TO_M(fs->mtol);
+    b = __TO_B(fs->bacc);
+    k1 = __TO_B_EXP(fs->bacc);
+    k2 = __TO_R_EXP(fs->bacc);
+    si = ((fs->common.unit & 0xc0) >> 6);
+
+    switch(si) {
+        case 0: /* unsigned */
+            result = (double) (((m*val)+b*pow(10,k1)) * pow(10,k2));
+            break;
+        case 1: /* signed 1's complement */
+            if ( val & 0x80 ){
+                val++;
+            }
+        case 2: /* signed 2's complement */
+            result = (double) (((m*(signed char)val)+b*pow(10,k1)) * pow(10,k2));
+            break;
+        default:
+            return 0.0;
+    }
+    return result;
+}
+
+static double now_sec(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* raw factors, stored the way a BMC sends them */
+static void random_sensor(struct ipmi_sdr_type_full_sensor *fs, u_char linearization) {
+    u_char *mtol = (u_char *)&fs->mtol;
+    u_char *bacc = (u_char *)&fs->bacc;
+
+    memset(fs, 0, sizeof(*fs));
+    fs->common.unit = (rand() % 3) << 6;
+    fs->linearization = linearization;
+    mtol[0] = rand() & 0xff;                /* M ls */
+    mtol[1] = rand() & 0xc0;                /* M ms, tolerance */
+    bacc[0] = rand() & 0xff;                /* B ls */
+    bacc[1] = rand() & 0xc0;                /* B ms, accuracy */
+    bacc[2] = 0;
+    bacc[3] = ((rand() % 5 - 4) & 0x0f) << 4 | ((rand() % 3) & 0x0f);   /* Rexp -4..0, Bexp 0..2 */
+}
+
+static int same(double expect, float got) {
+    if ( isnan(expect) ){
+        return isnan(got);
+    }
+    if ( isinf(expect) || fabs(expect) > 3.4e38 ){
+        return isinf(got) && (expect > 0) == (got > 0);
+    }
+    return fabs(expect - got) <= fabs(expect) * 1e-6 + 1e-30;
+}
+
+static int check(struct ipmi_sdr_type_full_sensor *fs, float *table) {
+    int s, v;
+
+    for ( s = 0; s < SENSORS; s++ ){
+        sensor_conv_build(table, &fs[s]);
+        for ( v = 0; v < SENSOR_CONV_VALUES; v++ ){
+            if ( !same(sensor_conv_value(&fs[s], v), table[v]) ){
+                fprintf(stderr, "sensor %d(linearization 0x%02x) raw 0x%02x: %g in the table, %g expected\n",
+                        s, fs[s].linearization, v, table[v], sensor_conv_value(&fs[s], v));
+                return -1;
+            }
+            if ( fs[s].linearization == SDR_SENSOR_L_LINEAR && !same(legacy_convert(&fs[s], v), table[v]) ){
+                fprintf(stderr, "sensor %d raw 0x%02x: %g in the table, %g by the former conversion\n",
+                        s, v, table[v], legacy_convert(&fs[s], v));
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+/* millions of readings converted per second */
+static double measure_legacy(struct ipmi_sdr_type_full_sensor *fs, const u_char *raw) {
+    volatile double sink = 0;
+    unsigned long i;
+    double start;
+
+    start = now_sec();
+    for ( i = 0; i < READINGS; i++ ){
+        sink += legacy_convert(&fs[i % SENSORS], raw[i & 4095]);
+    }
+    (void)sink;
+    return READINGS / (now_sec() - start) / 1e6;
+}
+
+static double measure_table(float (*tables)[SENSOR_CONV_VALUES], const u_char *raw) {
+    volatile double sink = 0;
+    unsigned long i;
+    double start;
+
+    start = now_sec();
+    for ( i = 0; i < READINGS; i++ ){
+        sink += tables[i % SENSORS][raw[i & 4095]];
+    }
+    (void)sink;
+    return READINGS / (now_sec() - start) / 1e6;
+}
+
+int main(int argc, char *argv[]) {
+    static struct ipmi_sdr_type_full_sensor fs[SENSORS];
+    static float tables[SENSORS][SENSOR_CONV_VALUES];
+    u_char raw[4096];
+    double base, mps, start;
+    int i, l, rounds;
+
+    srand(623);
+    for ( i = 0; i < 4096; i++ ){
+        raw[i] = rand() & 0xff;
+    }
+
+    /* every linearization first, to check the tables */
+    for ( l = SDR_SENSOR_L_LINEAR; l <= SDR_SENSOR_L_CUBERT; l++ ){
+        for ( i = 0; i < SENSORS; i++ ){
+            random_sensor(&fs[i], l);
+        }
+        if ( check(fs, tables[0]) == -1 ){
+            return (1);
+        }
+    }
+
+    /* then linear sensors, the only ones the former conversion handles */
+    for ( i = 0; i < SENSORS; i++ ){
+        random_sensor(&fs[i], SDR_SENSOR_L_LINEAR);
+        sensor_conv_build(tables[i], &fs[i]);
+    }
+
+    start = now_sec();
+    for ( rounds = 0; rounds < 10000; rounds++ ){
+        sensor_conv_build(tables[rounds % SENSORS], &fs[rounds % SENSORS]);
+    }
+    printf("table build: %.2f us per sensor\n", (now_sec() - start) / rounds * 1e6);
+
+    base = measure_legacy(fs, raw);
+    mps = measure_table(tables, raw);
+    printf("%-8s %12s %8s\n", "path", "Mreadings/s", "speedup");
+    printf("%-8s %12.1f %8s\n", "pow", base, "1.0x");
+    printf("%-8s %12.1f %7.1fx\n", "table", mps, mps / base);
+    return (0);
+}
@@ -1,7 +1,9 @@
 #ifndef _IPMI_DUMP_DUMP_H
 #define _IPMI_DUMP_DUMP_H
 
-
+#include <sys/types.h>
+#include <sys/time.h>
+/* the deepest layer decoded(-l), every layer is also printed */
 enum dump_level {
     DL_ETHERNET,
     DL_IP,
@@ -13,4 +15,56 @@ enum dump_level {
 };
 
 
+/*
+ * decoder state is kept per worker thread(-j), so workers never contend.
+ * tcc has no thread local storage, it is limited to a single worker
+ */
+#ifdef __TINYC__
+#define DUMP_TLS
+#else
+#define DUMP_TLS __thread
+#endif
+
+
+struct ipmi_corr_entry;
+
+/*
+ * the packet being decoded, every layer fills its part for the layers above
+ */
+struct dump_packet {
+    struct timeval  ts;
+    u_int32_t       src_addr;       /* network order */
+    u_int32_t       dst_addr;
+    u_short         src_port;       /* host order */
+    u_short         dst_port;
+
+    /* ipmi message header */
+    int             response;
+    u_char          rs_addr;        /* slave address and lun of the responder(the BMC) */
+    u_char          rs_lun;
+    u_int64_t       bmc;            /* address and port of the BMC side, see DUMP_BMC_KEY */
+    struct ipmi_corr_entry *corr;   /* the request of the message, NULL when not tracked or not matched */
+};
+
+#define DUMP_BMC_KEY(addr, port)    (((u_int64_t)(addr) << 16) | (port))
+
+extern DUMP_TLS struct dump_packet dump_pkt;
+
+/*
+ * what the decoders of a thread could not use, so that a capture loss shows
+ * next to the kernel drops instead of silently breaking the decoding
+ */
+struct dump_counters {
+    unsigned long long  packets;        /* udp datagrams decoded */
+    unsigned long long  truncated;      /* udp payload cut by the snaplen */
+    unsigned long long  rejects;        /* too short for rmcp or not rmcp version 0x06 */
+    unsigned long long  malformed;      /* rmcp, asf or ipmi the decoders failed to parse */
+    unsigned long long  unmatched;      /* responses without a tracked request */
+    unsigned long long  sdr_gaps;       /* SDR records completed with a partial read missing */
+    unsigned long long  sdr_stale;      /* SDR records dropped before all their bytes were read */
+};
+
+extern DUMP_TLS struct dump_counters dump_cnt;
+
+
 #endif
@@ -0,0 +1,329 @@
+/*
+ * render payload as rows of offset, hex pairs and printable ascii
+ *
+ * the text of a row is laid out first(offset, spaces), then every full 16 bytes
+ * of a row are handed as a job to the kernel, which writes its 16 hex triplets
+ * and 16 ascii characters in one pass. bytes left over at the end of a row are
+ * rendered by the scalar code
+ */
+#include <string.h>
+#include <sys/types.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__) && !defined(__TINYC__)
+#define HEXDUMP_SIMD
+#include <immintrin.h>
+#endif
+
+#include "hexdump.h"
+
+/* "xx " per byte and one more space between groups of 8 bytes */
+#define HEX_COLS(width)     ((width) * 3 + (width) / 8 - 1)
+/* distance between the hex text of two 16 byte chunks of a row: 48 + 2 group gaps */
+#define CHUNK_COLS          50
+#define JOB_BATCH           64
+
+struct hexdump_job {
+    const u_char    *src;   /* 16 bytes */
+    char            *hex;   /* 48 bytes: "xx xx xx xx xx xx xx xx  xx xx xx xx xx xx xx xx " less the last space */
+    char            *asc;   /* 16 bytes */
+};
+
+typedef void (*hexdump_kernel_fn)(const struct hexdump_job *jobs, int n);
+
+static const char hex_digits[] = "0123456789abcdef";
+
+static void hexdump_byte(const u_char *src, int i, char *hex, char *asc) {
+    char *h = hex + i * 3 + i / 8;
+
+    h[0] = hex_digits[src[i] >> 4];
+    h[1] = hex_digits[src[i] & 0x0f];
+    /* isprint of the C locale */
+    asc[i] = (src[i] >= 0x20 && src[i] < 0x7f) ? src[i] : '.';
+}
+
+static void hexdump_scalar(const struct hexdump_job *jobs, int n) {
+    int i, j;
+
+    for ( j = 0; j < n; j++ ){
+        for ( i = 0; i < 16; i++ ){
+            hexdump_byte(jobs[j].src, i, jobs[j].hex, jobs[j].asc);
+        }
+    }
+}
+
+#ifdef HEXDUMP_SIMD
+
+/*
+ * pshufb masks placing the 32 hex characters of a chunk(a: bytes 0-7, b: bytes 8-15)
+ * at their columns, 0x80 gives zero which is then or'ed with a space
+ */
+static u_char shuf_a[3][16] __attribute__((aligned(16)));
+static u_char shuf_b[3][16] __attribute__((aligned(16)));
+static u_char shuf_sp[3][16] __attribute__((aligned(16)));
+
+__attribute__((constructor)) static void hexdump_masks_init(void) {
+    int q, i, c;
+
+    for ( q = 0; q < 48; q++ ){
+        shuf_a[q / 16][q % 16] = 0x80;
+        shuf_b[q / 16][q % 16] = 0x80;
+        shuf_sp[q / 16][q % 16] = ' ';
+    }
+    for ( i = 0; i < 16; i++ ){
+        for ( c = 0; c < 2; c++ ){
+            q = i * 3 + i / 8 + c;
+            if ( i < 8 ){
+                shuf_a[q / 16][q % 16] = i * 2 + c;
+            }
+            else {
+                shuf_b[q / 16][q % 16] = (i - 8) * 2 + c;
+            }
+            shuf_sp[q / 16][q % 16] = 0;
+        }
+    }
+}
+
+/* '0'-'9' then 'a'-'f' for nibbles of every byte */
+#define NIBBLE_TO_HEX(n, nine, zero, alpha) \
+    _mm_add_epi8(_mm_add_epi8((n), (zero)), _mm_and_si128(_mm_cmpgt_epi8((n), (nine)), (alpha)))
+
+__attribute__((target("sse2"))) static void hexdump_sse2(const struct hexdump_job *jobs, int n) {
+    const __m128i low = _mm_set1_epi8(0x0f);
+    const __m128i nine = _mm_set1_epi8(9);
+    const __m128i zero = _mm_set1_epi8('0');
+    const __m128i alpha = _mm_set1_epi8('a' - '0' - 10);
+    const __m128i space = _mm_set1_epi8(0x1f);
+    const __m128i del = _mm_set1_epi8(0x7f);
+    const __m128i dot = _mm_set1_epi8('.');
+    __m128i v, hi, lo, printable;
+    char pairs[32];
+    char *h;
+    int i, j;
+
+    for ( j = 0; j < n; j++ ){
+        v = _mm_loadu_si128((const __m128i *)jobs[j].src);
+        hi = NIBBLE_TO_HEX(_mm_and_si128(_mm_srli_epi16(v, 4), low), nine, zero, alpha);
+        lo = NIBBLE_TO_HEX(_mm_and_si128(v, low), nine, zero, alpha);
+        _mm_storeu_si128((__m128i *)pairs, _mm_unpacklo_epi8(hi, lo));
+        _mm_storeu_si128((__m128i *)(pairs + 16), _mm_unpackhi_epi8(hi, lo));
+
+        /* no byte shuffle in SSE2, spread the pairs with 2 byte moves */
+        h = jobs[j].hex;
+        for ( i = 0; i < 8; i++ ){
+            memcpy(h + i * 3, pairs + i * 2, 2);
+            memcpy(h + i * 3 + 25, pairs + i * 2 + 16, 2);
+        }
+
+        /* signed compare, 0x80-0xff are negative and never printable */
+        printable = _mm_and_si128(_mm_cmpgt_epi8(v, space), _mm_cmplt_epi8(v, del));
+        _mm_storeu_si128((__m128i *)jobs[j].asc,
+                         _mm_or_si128(_mm_and_si128(printable, v), _mm_andnot_si128(printable, dot)));
+    }
+}
+
+/* two chunks per iteration, one per 128 bit lane, so every lane uses the same masks */
+__attribute__((target("avx2"))) static void hexdump_avx2(const struct hexdump_job *jobs, int n) {
+    const __m256i low = _mm256_set1_epi8(0x0f);
+    const __m256i nine = _mm256_set1_epi8(9);
+    const __m256i zero = _mm256_set1_epi8('0');
+    const __m256i alpha = _mm256_set1_epi8('a' - '0' - 10);
+    const __m256i space = _mm256_set1_epi8(0x1f);
+    const __m256i del = _mm256_set1_epi8(0x7f);
+    const __m256i dot = _mm256_set1_epi8('.');
+    __m256i v, hi, lo, a, b, printable, asc, out;
+    __m256i sa[3], sb[3], sp[3];
+    int j, k;
+
+    /* most payloads are a single chunk, do not pay for the broadcasts then */
+    for ( k = 0; k < 3 && n > 1; k++ ){
+        sa[k] = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i *)shuf_a[k]));
+        sb[k] = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i *)shuf_b[k]));
+        sp[k] = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i *)shuf_sp[k]));
+    }
+
+    for ( j = 0; j + 1 < n; j += 2 ){
+        v = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)jobs[j].src)),
+                                    _mm_loadu_si128((const __m128i *)jobs[j + 1].src), 1);
+        hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), low);
+        lo = _mm256_and_si256(v, low);
+        hi = _mm256_add_epi8(_mm256_add_epi8(hi, zero), _mm256_and_si256(_mm256_cmpgt_epi8(hi, nine), alpha));
+        lo = _mm256_add_epi8(_mm256_add_epi8(lo, zero), _mm256_and_si256(_mm256_cmpgt_epi8(lo, nine), alpha));
+        a = _mm256_unpacklo_epi8(hi, lo);
+        b = _mm256_unpackhi_epi8(hi, lo);
+
+        for ( k = 0; k < 3; k++ ){
+            out = _mm256_or_si256(_mm256_or_si256(_mm256_shuffle_epi8(a, sa[k]), _mm256_shuffle_epi8(b, sb[k])), sp[k]);
+            _mm_storeu_si128((__m128i *)(jobs[j].hex + k * 16), _mm256_castsi256_si128(out));
+            _mm_storeu_si128((__m128i *)(jobs[j + 1].hex + k * 16), _mm256_extracti128_si256(out, 1));
+        }
+
+        printable = _mm256_and_si256(_mm256_cmpgt_epi8(v, space), _mm256_cmpgt_epi8(del, v));
+        asc = _mm256_blendv_epi8(dot, v, printable);
+        _mm_storeu_si128((__m128i *)jobs[j].asc, _mm256_castsi256_si128(asc));
+        _mm_storeu_si128((__m128i *)jobs[j + 1].asc, _mm256_extracti128_si256(asc, 1));
+    }
+
+    if ( j < n ){
+        /* odd chunk: the same with 128 bit registers, calling the SSE2 kernel would mix in legacy SSE code */
+        __m128i v1, hi1, lo1, a1, b1, out1, printable1;
+
+        v1 = _mm_loadu_si128((const __m128i *)jobs[j].src);
+        hi1 = _mm_and_si128(_mm_srli_epi16(v1, 4), _mm256_castsi256_si128(low));
+        lo1 = _mm_and_si128(v1, _mm256_castsi256_si128(low));
+        hi1 = NIBBLE_TO_HEX(hi1, _mm256_castsi256_si128(nine), _mm256_castsi256_si128(zero), _mm256_castsi256_si128(alpha));
+        lo1 = NIBBLE_TO_HEX(lo1, _mm256_castsi256_si128(nine), _mm256_castsi256_si128(zero), _mm256_castsi256_si128(alpha));
+        a1 = _mm_unpacklo_epi8(hi1, lo1);
+        b1 = _mm_unpackhi_epi8(hi1, lo1);
+        for ( k = 0; k < 3; k++ ){
+            out1 = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(a1, _mm_load_si128((const __m128i *)shuf_a[k])),
+                                             _mm_shuffle_epi8(b1, _mm_load_si128((const __m128i *)shuf_b[k]))),
+                                _mm_load_si128((const __m128i *)shuf_sp[k]));
+            _mm_storeu_si128((__m128i *)(jobs[j].hex + k * 16), out1);
+        }
+        printable1 = _mm_and_si128(_mm_cmpgt_epi8(v1, _mm256_castsi256_si128(space)), _mm_cmplt_epi8(v1, _mm256_castsi256_si128(del)));
+        _mm_storeu_si128((__m128i *)jobs[j].asc, _mm_blendv_epi8(_mm256_castsi256_si128(dot), v1, printable1));
+    }
+}
+
+#endif
+
+static const struct {
+    const char          *name;
+    hexdump_kernel_fn   fn;
+} kernels[] = {
+#ifdef HEXDUMP_SIMD
+    { "avx2", hexdump_avx2 },
+    { "sse2", hexdump_sse2 },
+#endif
+    { "scalar", hexdump_scalar },
+};
+
+static int kernel_cur = sizeof(kernels) / sizeof(kernels[0]) - 1;
+
+static int hexdump_supported(const char *name) {
+#ifdef HEXDUMP_SIMD
+    __builtin_cpu_init();
+    if ( strcmp(name, "avx2") == 0 ){
+        return __builtin_cpu_supports("avx2");
+    }
+    if ( strcmp(name, "sse2") == 0 ){
+        return __builtin_cpu_supports("sse2");
+    }
+#endif
+    return strcmp(name, "scalar") == 0;
+}
+
+/* the best kernel of this cpu */
+__attribute__((constructor)) static void hexdump_kernel_init(void) {
+    int i;
+
+    for ( i = 0; i < (int)(sizeof(kernels) / sizeof(kernels[0])); i++ ){
+        if ( hexdump_supported(kernels[i].name) ){
+            kernel_cur = i;
+            return;
+        }
+    }
+}
+
+/*
+ * force a kernel, used by the benchmark
+ *
+ * @kernel: "avx2", "sse2" or "scalar"
+ * @return: 0 on success, -1 if not built in or not supported by this cpu
+ *
+ */
+int hexdump_select(const char *kernel) {
+    int i;
+
+    for ( i = 0; i < (int)(sizeof(kernels) / sizeof(kernels[0])); i++ ){
+        if ( strcmp(kernels[i].name, kernel) == 0 && hexdump_supported(kernel) ){
+            kernel_cur = i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+const char* hexdump_kernel(void) {
+    return kernels[kernel_cur].name;
+}
+
+/*
+ * the most bytes hexdump_render writes
+ *
+ * @len: payload bytes
+ * @width: bytes per row
+ *
+ */
+size_t hexdump_size(size_t len, int width) {
+    size_t rows = (len + width - 1) / width;
+
+    /* offset is at most 20 digits */
+    return rows * (20 + 3 + HEX_COLS(width) + 3 + width + 1);
+}
+
+/* same as sprintf("%05lu") */
+static char* hexdump_offset(char *p, unsigned long offset) {
+    char tmp[20];
+    int i = sizeof(tmp);
+
+    do {
+        tmp[--i] = '0' + offset % 10;
+        offset /= 10;
+    } while ( offset || (int)sizeof(tmp) - i < 5 );
+
+    memcpy(p, tmp + i, sizeof(tmp) - i);
+    return p + sizeof(tmp) - i;
+}
+
+/*
+ * render data, the layout of the 16 bytes width is the one of tcpdump's sniffex
+ *
+ * @dst: at least hexdump_size(len, width) bytes
+ * @data: payload
+ * @len: payload bytes
+ * @offset: offset printed for the first byte
+ * @width: bytes per row, a multiple of 8 up to HEXDUMP_MAX_WIDTH
+ * @return: bytes written
+ *
+ */
+size_t hexdump_render(char *dst, const u_char *data, size_t len, unsigned long offset, int width) {
+    struct hexdump_job jobs[JOB_BATCH];
+    hexdump_kernel_fn kernel = kernels[kernel_cur].fn;
+    int njobs = 0;
+    size_t pos;
+    char *p = dst;
+    char *hex, *asc;
+    int i, n;
+
+    for ( pos = 0; pos < len; pos += width ){
+        n = len - pos < (size_t)width ? (int)(len - pos) : width;
+
+        p = hexdump_offset(p, offset + pos);
+        memset(p, ' ', 3 + HEX_COLS(width) + 3);
+        hex = p + 3;
+        asc = hex + HEX_COLS(width) + 3;
+
+        for ( i = 0; i + 16 <= n; i += 16 ){
+            jobs[njobs].src = data + pos + i;
+            jobs[njobs].hex = hex + i / 16 * CHUNK_COLS;
+            jobs[njobs].asc = asc + i;
+            if ( ++njobs == JOB_BATCH ){
+                kernel(jobs, njobs);
+                njobs = 0;
+            }
+        }
+        for ( ; i < n; i++ ){
+            hexdump_byte(data + pos, i, hex, asc);
+        }
+
+        asc[n] = '\n';
+        p = asc + n + 1;
+    }
+
+    if ( njobs > 0 ){
+        kernel(jobs, njobs);
+    }
+
+    return p - dst;
+}
@@ -0,0 +1,24 @@
+#ifndef _IPMI_DUMP_HEXDUMP_H
+#define _IPMI_DUMP_HEXDUMP_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+/*
+ * hex and ascii dump of packet payload, one row per width bytes:
+ *
+ * 00000   47 45 54 20 2f 20 48 54  54 50 2f 31 2e 31 0d 0a   GET / HTTP/1.1..
+ *
+ * every 16 bytes of a row are rendered by a SIMD kernel(AVX2 or SSE2, picked at
+ * startup), the remaining bytes by the scalar one
+ */
+
+#define HEXDUMP_DEF_WIDTH   16
+#define HEXDUMP_MAX_WIDTH   64      /* width must be a multiple of 8, up to this */
+
+size_t hexdump_size(size_t len, int width);
+size_t hexdump_render(char *dst, const u_char *data, size_t len, unsigned long offset, int width);
+int hexdump_select(const char *kernel);
+const char* hexdump_kernel(void);
+
+#endif
@@ -7,7 +7,12 @@
 
 #include "align.h"
 #include "dump.h"
+#include "output.h"
 #include "ipmi_cmd.h"
+#include "ipmi_corr.h"
+#include "latency.h"
+#include "stats.h"
+#include "probe.h"
 
 #define IPMI_AUTH_CODE_LEN      16
 
@@ -31,16 +36,7 @@ struct ipmi_session_header {
 struct ipmi_payload_header {
     u_char          ipd_len TCC_PACKED;        /* ipmi payload length */
     u_char          ipd_to_addr TCC_PACKED;    /* message send to which addr, for request message, this should be 0x20(indicate BMC); for response message, this should be 0x81(indicate the requestor) */
-    u_char          ipd_net_fn TCC_PACKED;     /* network function section 5.1 */
-#define NETFN_CHAS   0x00  // chassis
-#define NETFN_BRIDGE 0x02  // bridge
-#define NETFN_SEVT   0x04  // sensor/event
-#define NETFN_APP    0x06  // application
-#define NETFN_FW     0x08  // firmware
-#define NETFN_STOR   0x0a  // storage
-#define NETFN_TRANS  0x0c  // transport
-#define NETFN_SOL    0x34  // serial-over-lan (in IPMI 2.0, use TRANS)
-#define NETFN_PICMG  0x2c  // for ATCA PICMG systems
+    u_char          ipd_net_fn TCC_PACKED;     /* network function section 5.1, NETFN_* of ipmi_cmd.h */
     u_char          ipd_chksum1 TCC_PACKED;    /* checksum */
     u_char          ipd_from_addr TCC_PACKED;  /* from address */
     u_char          ipd_req_seq TCC_PACKED;    /* request sequence , the requestor and responsor should match same */
@@ -48,8 +44,17 @@ struct ipmi_payload_header {
 } GNU_PACKED;
 
 
-extern void print_ipmi_session(enum ipmi_direction direction,u_char cmd, const u_char *payload, int payload_len, enum dump_level dl);
-extern void print_ipmi_sdr(enum ipmi_direction direction,u_char cmd, const u_char *payload, int payload_len, enum dump_level dl);
+static struct out_label auth_type_labels[256];
+static struct out_label network_function_labels[64];
+
+const char* ipmi_get_auth_type_str(u_char auth_type);
+const char* ipmi_get_network_function_str(u_char nf);
+
+__attribute__((constructor)) static void ipmi_labels_init(void) {
+    out_labels_init(auth_type_labels, 256, ipmi_get_auth_type_str);
+    out_labels_init(network_function_labels, 64, ipmi_get_network_function_str);
+}
+
 
 const char* ipmi_get_auth_type_str(u_char auth_type) {
     switch ( auth_type ) {
@@ -94,54 +99,20 @@ const char* ipmi_get_network_function_str(u_char nf) {
     }
 }
 
-const char* ipmi_get_cmd_str(u_char nf, u_char cmd){
-    if ( nf == NETFN_APP && cmd == GET_CHAN_AUTH ) {
-        return "Get Auth Capability";
-    }
-    else if ( nf == NETFN_APP && cmd == GET_SESS_CHAL ) {
-        return "Get Session Challenge";
-    } 
-    else if ( nf == NETFN_APP && cmd == ACT_SESSION ) {
-        return "Activate Session";
-    } 
-    else if ( nf == NETFN_APP && cmd == SET_SESS_PRIV ) {
-        return "Set Session Privilege";
-    } 
-    else if ( nf == NETFN_APP && cmd == CLOSE_SESSION ) {
-        return "Close Session";
-    } 
-    else if ( nf == NETFN_STOR && cmd == GET_SDR_REPINFO ) {
-        return "Get SDR Repo Info";
-    } 
-    else if ( nf == NETFN_STOR && cmd == RESERVE_SDR_REP ) {
-        return "Reserve SDR Repo";
-    } 
-    else if ( nf == NETFN_STOR && cmd == GET_SDR ) {
-        return "Get SDR";
-    } 
-    else if ( nf == NETFN_SEVT && cmd == GET_SENSOR_READING ) {
-        return "Get Sensor Reading";
-    } 
-    else if ( nf == NETFN_SEVT && cmd == GET_SENSOR_THRESHOLD ) {
-        return "Get Sensor Threshold";
-    } 
-    else {
-        return "TODO";
-    }
-}
-
 /*
  * parse and print ipmi payload
  *
  * @payload: the raw payload(without rmcp header)
  * @payload_len: the payload valid length
- * @dump_level: to determine what level should be print, rmcp? asf? ipmi?
+ * @dump_level: the deepest layer to decode, nothing past it is parsed or printed
  *
  */ 
 void print_ipmi(const u_char *payload, int payload_len, enum dump_level dl){
     struct ipmi_session_header *ish;
     struct ipmi_payload_header *iph;
-    const u_char *ipmi_payload_body, *ipb;
+    const struct ipmi_cmd_desc *cmd;
+    const u_char *ipmi_payload_body;
+    struct ipmi_corr_key key;
     int actual_header_len = sizeof(struct ipmi_session_header);
     int msg_len = 0;
     int i;
@@ -162,16 +133,24 @@ void print_ipmi(const u_char *payload, int payload_len, enum dump_level dl){
         goto small_length;
     }
 
-    if ( dl <= DL_IPMI_HEADER ) {
-        printf("  [IPMI] Auth Type(%lu): %s(0x%02x)\n",sizeof(ish->ish_auth_type), ipmi_get_auth_type_str(ish->ish_auth_type), ish->ish_auth_type );
-        printf("  [IPMI] Sequence(%lu): %u\n", sizeof(ish->ish_sn), ish->ish_sn);
-        printf("  [IPMI] Session(%lu): %u\n", sizeof(ish->ish_id), ish->ish_id);
+    if ( dump_stats ){
+        stats_auth_type(ish->ish_auth_type);
+    }
+    else if ( dl >= DL_IPMI_HEADER ) {
+        OUT_LIT("  [IPMI] Auth Type(1): ");
+        out_label(&auth_type_labels[ish->ish_auth_type]);
+        OUT_LIT("\n  [IPMI] Sequence(4): ");
+        out_udec(ish->ish_sn);
+        OUT_LIT("\n  [IPMI] Session(4): ");
+        out_udec(ish->ish_id);
+        out_char('\n');
         if ( ish->ish_auth_type != IPMI_AUTH_TYPE_NONE ) {
-            printf("  [IPMI] Auth Code(16 bytes):");
+            OUT_LIT("  [IPMI] Auth Code(16 bytes):");
             for (  i = 0 ; i < IPMI_AUTH_CODE_LEN; i++ ) {
-                printf(" 0x%02x", ish->ish_auth_code[i]);
+                out_char(' ');
+                out_hex8(ish->ish_auth_code[i]);
             }
-            printf("\n");
+            out_char('\n');
         }
     }
 
@@ -195,49 +174,86 @@ void print_ipmi(const u_char *payload, int payload_len, enum dump_level dl){
         network_fn = network_fn - 1;
         direction = IPMI_RESPONSE;
     }
-    if ( dl <= DL_IPMI_HEADER ){
-        if ( direction == IPMI_REQUEST ){
-            printf("  [IPMI] Request\n");
+    PROBE_SET_CMD(network_fn, iph->ipd_cmd);
+    /* a request goes to the BMC, a response comes from it */
+    dump_pkt.response = direction == IPMI_RESPONSE;
+    key.session = ish->ish_id;
+    /* rqSeq only, the low bits are rqLUN in the request and rsLUN in its response */
+    key.seq = iph->ipd_req_seq >> 2;
+    key.netfn = network_fn;
+    key.cmd = iph->ipd_cmd;
+    if ( direction == IPMI_REQUEST ){
+        dump_pkt.rs_addr = iph->ipd_to_addr;
+        dump_pkt.rs_lun = iph->ipd_net_fn & 0x03;
+        dump_pkt.bmc = DUMP_BMC_KEY(dump_pkt.dst_addr, dump_pkt.dst_port);
+        key.client_addr = dump_pkt.src_addr;
+        key.client_port = dump_pkt.src_port;
+        key.bmc_addr = dump_pkt.dst_addr;
+        key.bmc_port = dump_pkt.dst_port;
+        dump_pkt.corr = ipmi_corr_request(&key, &dump_pkt.ts);
+    }
+    else {
+        dump_pkt.rs_addr = iph->ipd_from_addr;
+        dump_pkt.rs_lun = iph->ipd_req_seq & 0x03;
+        dump_pkt.bmc = DUMP_BMC_KEY(dump_pkt.src_addr, dump_pkt.src_port);
+        key.client_addr = dump_pkt.dst_addr;
+        key.client_port = dump_pkt.dst_port;
+        key.bmc_addr = dump_pkt.src_addr;
+        key.bmc_port = dump_pkt.src_port;
+        dump_pkt.corr = ipmi_corr_response(&key);
+        if ( dump_pkt.corr != NULL ){
+            latency_record(dump_pkt.bmc, network_fn, iph->ipd_cmd, &dump_pkt.corr->ts, &dump_pkt.ts);
         }
         else {
-            printf("  [IPMI] Response\n");
+            dump_cnt.unmatched++;
         }
-        printf("  [IPMI] Message length: %d\n", msg_len);
-        printf("  [IPMI] Network Function: %s(0x%02x)\n", ipmi_get_network_function_str(network_fn) ,network_fn);
-        printf("  [IPMI] toAddr: 0x%02x, fromAddr: 0x%02x, reqSeq: 0x%02x\n", iph->ipd_to_addr, iph->ipd_from_addr, iph->ipd_req_seq);
-    }
-
-    printf("  [IPMI] Cmd: %s(0x%02x)\n", ipmi_get_cmd_str(network_fn, iph->ipd_cmd) ,iph->ipd_cmd);
-    ipb = payload + actual_header_len + sizeof(struct ipmi_payload_header);
-
-    if ( network_fn == NETFN_APP && (
-                iph->ipd_cmd == GET_CHAN_AUTH ||
-                iph->ipd_cmd == GET_SESS_CHAL ||
-                iph->ipd_cmd == ACT_SESSION ||
-                iph->ipd_cmd == SET_SESS_PRIV ||
-                iph->ipd_cmd == CLOSE_SESSION
-                )  ) {
-        print_ipmi_session(direction ,iph->ipd_cmd , ipb ,msg_len-sizeof(struct ipmi_payload_header)+1  , dl);
     }
-    else if ( network_fn == NETFN_STOR && (
-                iph->ipd_cmd == GET_SDR_REPINFO ||
-                iph->ipd_cmd == RESERVE_SDR_REP ||
-                iph->ipd_cmd == GET_SDR 
-                ) ){
-        print_ipmi_sdr(direction, iph->ipd_cmd, ipb, msg_len-sizeof(struct ipmi_payload_header)+1, dl);
+    if ( dump_stats ){
+        /* the completion code is the first data byte of a response */
+        stats_ipmi(network_fn, iph->ipd_cmd, dump_pkt.response,
+                dump_pkt.response && msg_len > (int)sizeof(struct ipmi_payload_header)
+                ? payload[actual_header_len + sizeof(struct ipmi_payload_header)] : -1);
+        return;
     }
-    else if ( network_fn == NETFN_SEVT && (
-                iph->ipd_cmd == GET_SENSOR_READING ||
-                iph->ipd_cmd == GET_SENSOR_THRESHOLD 
-                ) ){
-        print_ipmi_sdr(direction, iph->ipd_cmd, ipb, msg_len-sizeof(struct ipmi_payload_header)+1, dl);
+    if ( dl >= DL_IPMI_HEADER ){
+        if ( direction == IPMI_REQUEST ){
+            OUT_LIT("  [IPMI] Request\n");
+        }
+        else {
+            OUT_LIT("  [IPMI] Response\n");
+        }
+        OUT_LIT("  [IPMI] Message length: ");
+        out_dec(msg_len);
+        OUT_LIT("\n  [IPMI] Network Function: ");
+        out_label(&network_function_labels[network_fn]);
+        OUT_LIT("\n  [IPMI] toAddr: ");
+        out_hex8(iph->ipd_to_addr);
+        OUT_LIT(", fromAddr: ");
+        out_hex8(iph->ipd_from_addr);
+        OUT_LIT(", reqSeq: ");
+        out_hex8(iph->ipd_req_seq);
+        out_char('\n');
     }
-    else {
+
+    cmd = &ipmi_cmds[network_fn >> 1][iph->ipd_cmd];
+    OUT_LIT("  [IPMI] Cmd: ");
+    out_str(cmd->name != NULL ? cmd->name : "TODO");
+    out_char('(');
+    out_hex8(iph->ipd_cmd);
+    OUT_LIT(")\n");
+    if ( dl < DL_IPMI ){
+        return;
     }
 
+    /* msg_len counts the header bytes after ipd_len and the trailing checksum */
+    ipmi_payload_body = payload + actual_header_len + sizeof(struct ipmi_payload_header);
+    PROBE_ENTER();
+    ipmi_cmd_decode(cmd, direction, ipmi_payload_body, msg_len - sizeof(struct ipmi_payload_header));
+    PROBE_LEAVE(PROBE_BODY_STAGE(network_fn, iph->ipd_cmd));
+
     return;
 
 small_length:
-    fprintf(stderr, "Invalid ipmi: length is too small\n");
+    DUMP_INVALID("Invalid ipmi: length is too small\n");
     return;
 }
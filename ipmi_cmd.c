@@ -0,0 +1,209 @@
+/*
+ * every known (network function, command) with its name and decoders
+ *
+ * the table is dense, so looking up a command is a single index, and
+ * supporting a new command is adding its row
+ */
+#include <stdio.h>
+#include <sys/types.h>
+
+#include "output.h"
+#include "ipmi_cmd.h"
+#include "stats.h"
+
+#define CMD(nf, cmd)    [(nf) >> 1][(cmd)]
+
+const struct ipmi_cmd_desc ipmi_cmds[IPMI_NETFN_ROWS][256] = {
+    /* chassis, section 28 */
+    CMD(NETFN_CHAS, 0x00) = { "Get Chassis Capabilities" },
+    CMD(NETFN_CHAS, 0x01) = { "Get Chassis Status" },
+    CMD(NETFN_CHAS, 0x02) = { "Chassis Control" },
+    CMD(NETFN_CHAS, 0x03) = { "Chassis Reset" },
+    CMD(NETFN_CHAS, 0x04) = { "Chassis Identify" },
+    CMD(NETFN_CHAS, 0x05) = { "Set Chassis Capabilities" },
+    CMD(NETFN_CHAS, 0x06) = { "Set Power Restore Policy" },
+    CMD(NETFN_CHAS, 0x07) = { "Get System Restart Cause" },
+    CMD(NETFN_CHAS, 0x08) = { "Set System Boot Options" },
+    CMD(NETFN_CHAS, 0x09) = { "Get System Boot Options" },
+    CMD(NETFN_CHAS, 0x0a) = { "Set Front Panel Enables" },
+    CMD(NETFN_CHAS, 0x0b) = { "Set Power Cycle Interval" },
+    CMD(NETFN_CHAS, 0x0f) = { "Get POH Counter" },
+
+    /* sensor/event, sections 29, 30 and 35 */
+    CMD(NETFN_SEVT, 0x00) = { "Set Event Receiver" },
+    CMD(NETFN_SEVT, 0x01) = { "Get Event Receiver" },
+    CMD(NETFN_SEVT, 0x02) = { "Platform Event" },
+    CMD(NETFN_SEVT, 0x10) = { "Get PEF Capabilities" },
+    CMD(NETFN_SEVT, 0x11) = { "Arm PEF Postpone Timer" },
+    CMD(NETFN_SEVT, 0x12) = { "Set PEF Config Parameters" },
+    CMD(NETFN_SEVT, 0x13) = { "Get PEF Config Parameters" },
+    CMD(NETFN_SEVT, 0x14) = { "Set Last Processed Event Id" },
+    CMD(NETFN_SEVT, 0x15) = { "Get Last Processed Event Id" },
+    CMD(NETFN_SEVT, 0x16) = { "Alert Immediate" },
+    CMD(NETFN_SEVT, 0x17) = { "PET Acknowledge" },
+    CMD(NETFN_SEVT, 0x20) = { "Get Device SDR Info" },
+    CMD(NETFN_SEVT, 0x21) = { "Get Device SDR" },
+    CMD(NETFN_SEVT, 0x22) = { "Reserve Device SDR Repo" },
+    CMD(NETFN_SEVT, 0x23) = { "Get Sensor Reading Factors" },
+    CMD(NETFN_SEVT, 0x24) = { "Set Sensor Hysteresis" },
+    CMD(NETFN_SEVT, 0x25) = { "Get Sensor Hysteresis" },
+    CMD(NETFN_SEVT, 0x26) = { "Set Sensor Threshold" },
+    CMD(NETFN_SEVT, GET_SENSOR_THRESHOLD) = { "Get Sensor Threshold",
+            ipmi_get_sensor_threshold_request, ipmi_get_sensor_threshold_response, 1, 2 },
+    CMD(NETFN_SEVT, 0x28) = { "Set Sensor Event Enable" },
+    CMD(NETFN_SEVT, 0x29) = { "Get Sensor Event Enable" },
+    CMD(NETFN_SEVT, 0x2a) = { "Re-arm Sensor Events" },
+    CMD(NETFN_SEVT, 0x2b) = { "Get Sensor Event Status" },
+    CMD(NETFN_SEVT, GET_SENSOR_READING) = { "Get Sensor Reading",
+            ipmi_get_sensor_reading_request, ipmi_get_sensor_reading_response, 1, 3 },
+    CMD(NETFN_SEVT, 0x2e) = { "Set Sensor Type" },
+    CMD(NETFN_SEVT, 0x2f) = { "Get Sensor Type" },
+
+    /* application, sections 20, 21 and 22 */
+    CMD(NETFN_APP, 0x01) = { "Get Device Id" },
+    CMD(NETFN_APP, 0x02) = { "Cold Reset" },
+    CMD(NETFN_APP, 0x03) = { "Warm Reset" },
+    CMD(NETFN_APP, 0x04) = { "Get Self Test Results" },
+    CMD(NETFN_APP, 0x05) = { "Manufacturing Test On" },
+    CMD(NETFN_APP, 0x06) = { "Set ACPI Power State" },
+    CMD(NETFN_APP, 0x07) = { "Get ACPI Power State" },
+    CMD(NETFN_APP, 0x08) = { "Get Device GUID" },
+    CMD(NETFN_APP, 0x22) = { "Reset Watchdog Timer" },
+    CMD(NETFN_APP, 0x24) = { "Set Watchdog Timer" },
+    CMD(NETFN_APP, 0x25) = { "Get Watchdog Timer" },
+    CMD(NETFN_APP, 0x2e) = { "Set BMC Global Enables" },
+    CMD(NETFN_APP, 0x2f) = { "Get BMC Global Enables" },
+    CMD(NETFN_APP, 0x30) = { "Clear Message Flags" },
+    CMD(NETFN_APP, 0x31) = { "Get Message Flags" },
+    CMD(NETFN_APP, 0x32) = { "Enable Message Channel Receive" },
+    CMD(NETFN_APP, 0x33) = { "Get Message" },
+    CMD(NETFN_APP, 0x34) = { "Send Message" },
+    CMD(NETFN_APP, 0x35) = { "Read Event Message Buffer" },
+    CMD(NETFN_APP, 0x36) = { "Get BT Interface Capabilities" },
+    CMD(NETFN_APP, 0x37) = { "Get System GUID" },
+    CMD(NETFN_APP, GET_CHAN_AUTH) = { "Get Auth Capability",
+            ipmi_get_auth_cap_request, ipmi_get_auth_cap_response, 2, 4 },
+    CMD(NETFN_APP, GET_SESS_CHAL) = { "Get Session Challenge",
+            ipmi_get_sess_chal_request, ipmi_get_sess_chal_response, 17, 21 },
+    CMD(NETFN_APP, ACT_SESSION) = { "Activate Session",
+            ipmi_act_sess_request, ipmi_act_sess_response, 22, 11 },
+    CMD(NETFN_APP, SET_SESS_PRIV) = { "Set Session Privilege",
+            ipmi_set_sess_priv_request, ipmi_set_sess_priv_response, 1, 2 },
+    CMD(NETFN_APP, CLOSE_SESSION) = { "Close Session",
+            ipmi_close_sess_request, ipmi_close_sess_response, 4, 1 },
+    CMD(NETFN_APP, 0x3d) = { "Get Session Info" },
+    CMD(NETFN_APP, 0x3f) = { "Get AuthCode" },
+    CMD(NETFN_APP, 0x40) = { "Set Channel Access" },
+    CMD(NETFN_APP, 0x41) = { "Get Channel Access" },
+    CMD(NETFN_APP, 0x42) = { "Get Channel Info" },
+    CMD(NETFN_APP, 0x43) = { "Set User Access" },
+    CMD(NETFN_APP, 0x44) = { "Get User Access" },
+    CMD(NETFN_APP, 0x45) = { "Set User Name" },
+    CMD(NETFN_APP, 0x46) = { "Get User Name" },
+    CMD(NETFN_APP, 0x47) = { "Set User Password" },
+    CMD(NETFN_APP, 0x48) = { "Activate Payload" },
+    CMD(NETFN_APP, 0x49) = { "Deactivate Payload" },
+    CMD(NETFN_APP, 0x4a) = { "Get Payload Activation Status" },
+    CMD(NETFN_APP, 0x4b) = { "Get Payload Instance Info" },
+    CMD(NETFN_APP, 0x4c) = { "Set User Payload Access" },
+    CMD(NETFN_APP, 0x4d) = { "Get User Payload Access" },
+    CMD(NETFN_APP, 0x4e) = { "Get Channel Payload Support" },
+    CMD(NETFN_APP, 0x4f) = { "Get Channel Payload Version" },
+    CMD(NETFN_APP, 0x50) = { "Get Channel OEM Payload Info" },
+    CMD(NETFN_APP, 0x52) = { "Master Write-Read" },
+    CMD(NETFN_APP, 0x54) = { "Get Channel Cipher Suites" },
+    CMD(NETFN_APP, 0x55) = { "Suspend/Resume Payload Encryption" },
+    CMD(NETFN_APP, 0x56) = { "Set Channel Security Keys" },
+    CMD(NETFN_APP, 0x57) = { "Get System Interface Capabilities" },
+
+    /* storage, sections 34(FRU), 33(SDR) and 31(SEL) */
+    CMD(NETFN_STOR, 0x10) = { "Get FRU Inventory Area Info" },
+    CMD(NETFN_STOR, 0x11) = { "Read FRU Data" },
+    CMD(NETFN_STOR, 0x12) = { "Write FRU Data" },
+    CMD(NETFN_STOR, GET_SDR_REPINFO) = { "Get SDR Repo Info",
+            NULL, ipmi_get_sdr_repo_response, 0, 15 },
+    CMD(NETFN_STOR, 0x21) = { "Get SDR Repo Allocation Info" },
+    CMD(NETFN_STOR, RESERVE_SDR_REP) = { "Reserve SDR Repo",
+            NULL, ipmi_reserve_sdr_repo_response, 0, 3 },
+    CMD(NETFN_STOR, GET_SDR) = { "Get SDR",
+            ipmi_get_sdr_request, ipmi_get_sdr_response, 6, 3 },
+    CMD(NETFN_STOR, 0x24) = { "Add SDR" },
+    CMD(NETFN_STOR, 0x25) = { "Partial Add SDR" },
+    CMD(NETFN_STOR, 0x26) = { "Delete SDR" },
+    CMD(NETFN_STOR, 0x27) = { "Clear SDR Repo" },
+    CMD(NETFN_STOR, 0x28) = { "Get SDR Repo Time" },
+    CMD(NETFN_STOR, 0x29) = { "Set SDR Repo Time" },
+    CMD(NETFN_STOR, 0x2a) = { "Enter SDR Repo Update Mode" },
+    CMD(NETFN_STOR, 0x2b) = { "Exit SDR Repo Update Mode" },
+    CMD(NETFN_STOR, 0x2c) = { "Run Initialization Agent" },
+    CMD(NETFN_STOR, 0x40) = { "Get SEL Info" },
+    CMD(NETFN_STOR, 0x41) = { "Get SEL Allocation Info" },
+    CMD(NETFN_STOR, 0x42) = { "Reserve SEL" },
+    CMD(NETFN_STOR, 0x43) = { "Get SEL Entry" },
+    CMD(NETFN_STOR, 0x44) = { "Add SEL Entry" },
+    CMD(NETFN_STOR, 0x45) = { "Partial Add SEL Entry" },
+    CMD(NETFN_STOR, 0x46) = { "Delete SEL Entry" },
+    CMD(NETFN_STOR, 0x47) = { "Clear SEL" },
+    CMD(NETFN_STOR, 0x48) = { "Get SEL Time" },
+    CMD(NETFN_STOR, 0x49) = { "Set SEL Time" },
+    CMD(NETFN_STOR, 0x5a) = { "Get Auxiliary Log Status" },
+    CMD(NETFN_STOR, 0x5b) = { "Set Auxiliary Log Status" },
+    CMD(NETFN_STOR, 0x5c) = { "Get SEL Time UTC Offset" },
+    CMD(NETFN_STOR, 0x5d) = { "Set SEL Time UTC Offset" },
+
+    /* transport, sections 23, 25 and 26 */
+    CMD(NETFN_TRANS, 0x01) = { "Set LAN Config Parameters" },
+    CMD(NETFN_TRANS, 0x02) = { "Get LAN Config Parameters" },
+    CMD(NETFN_TRANS, 0x03) = { "Suspend BMC ARPs" },
+    CMD(NETFN_TRANS, 0x04) = { "Get IP/UDP/RMCP Statistics" },
+    CMD(NETFN_TRANS, 0x10) = { "Set Serial/Modem Config" },
+    CMD(NETFN_TRANS, 0x11) = { "Get Serial/Modem Config" },
+    CMD(NETFN_TRANS, 0x12) = { "Set Serial/Modem Mux" },
+    CMD(NETFN_TRANS, 0x20) = { "SOL Activating" },
+    CMD(NETFN_TRANS, 0x21) = { "Set SOL Config Parameters" },
+    CMD(NETFN_TRANS, 0x22) = { "Get SOL Config Parameters" },
+};
+
+const char* ipmi_get_cmd_str(u_char nf, u_char cmd){
+    const char *name = ipmi_cmds[(nf >> 1) & (IPMI_NETFN_ROWS - 1)][cmd].name;
+
+    return name != NULL ? name : "TODO";
+}
+
+/*
+ * check the data is long enough for the decoder of the command, then decode it
+ *
+ * @desc: the command
+ * @direction: request or response
+ * @data: the data after the cmd byte
+ * @data_len: bytes of data, without the trailing checksum
+ *
+ */
+void ipmi_cmd_decode(const struct ipmi_cmd_desc *desc, enum ipmi_direction direction, const u_char *data, int data_len) {
+    ipmi_decoder decoder;
+    int min;
+
+    if ( direction == IPMI_REQUEST ){
+        decoder = desc->request;
+        min = desc->request_min;
+    }
+    else {
+        decoder = desc->response;
+        min = desc->response_min;
+    }
+    if ( decoder == NULL ){
+        return;
+    }
+
+    if ( data_len < min ){
+        /* a failed command only returns its completion code */
+        if ( direction == IPMI_RESPONSE && data_len >= 1 && data[0] != 0x00 ){
+            OUT_HEX8_LINE("  [IPMI] Completion Code: ", data[0]);
+            return;
+        }
+        DUMP_INVALID("Invalid ipmi: length is too small\n");
+        return;
+    }
+
+    decoder(data, data_len);
+}
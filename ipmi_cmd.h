@@ -1,11 +1,24 @@
 #ifndef _IPMI_DUMP_IPMI_CMD_H
 #define _IPMI_DUMP_IPMI_CMD_H
 
+#include <sys/types.h>
+
 enum ipmi_direction {
     IPMI_REQUEST,
     IPMI_RESPONSE
 };
 
+/* network function section 5.1, the request one(even), the response is +1 */
+#define NETFN_CHAS   0x00  // chassis
+#define NETFN_BRIDGE 0x02  // bridge
+#define NETFN_SEVT   0x04  // sensor/event
+#define NETFN_APP    0x06  // application
+#define NETFN_FW     0x08  // firmware
+#define NETFN_STOR   0x0a  // storage
+#define NETFN_TRANS  0x0c  // transport
+#define NETFN_SOL    0x34  // serial-over-lan (in IPMI 2.0, use TRANS)
+#define NETFN_PICMG  0x2c  // for ATCA PICMG systems
+
 /* session (nf: NETFN_APP) */
 #define    GET_CHAN_AUTH  0x38
 #define    GET_SESS_CHAL  0x39
@@ -23,6 +36,53 @@ enum ipmi_direction {
 #define     GET_SENSOR_THRESHOLD   0x27
 
 
+/*
+ * print the data of a request or response
+ *
+ * @data: the data after the cmd byte, for a response it starts with the completion code
+ * @data_len: bytes of data, the trailing checksum excluded. never less than the
+ *            minimum length of the command
+ */
+typedef void (*ipmi_decoder)(const u_char *data, int data_len);
 
-#endif
+struct ipmi_cmd_desc {
+    const char      *name;          /* NULL for a command not known */
+    ipmi_decoder    request;        /* NULL when there is nothing to print */
+    ipmi_decoder    response;
+    u_char          request_min;    /* bytes read by the decoder */
+    u_char          response_min;
+};
+
+/*
+ * indexed by [netfn >> 1][cmd], a request and its response share the row of the even netfn.
+ * netfn is 6 bits, so 32 rows cover all of them
+ */
+#define IPMI_NETFN_ROWS     32
+extern const struct ipmi_cmd_desc ipmi_cmds[IPMI_NETFN_ROWS][256];
 
+const char* ipmi_get_cmd_str(u_char nf, u_char cmd);
+void ipmi_cmd_decode(const struct ipmi_cmd_desc *desc, enum ipmi_direction direction, const u_char *data, int data_len);
+
+/* ipmi_session.c */
+void ipmi_get_auth_cap_request(const u_char *data, int data_len);
+void ipmi_get_auth_cap_response(const u_char *data, int data_len);
+void ipmi_get_sess_chal_request(const u_char *data, int data_len);
+void ipmi_get_sess_chal_response(const u_char *data, int data_len);
+void ipmi_act_sess_request(const u_char *data, int data_len);
+void ipmi_act_sess_response(const u_char *data, int data_len);
+void ipmi_set_sess_priv_request(const u_char *data, int data_len);
+void ipmi_set_sess_priv_response(const u_char *data, int data_len);
+void ipmi_close_sess_request(const u_char *data, int data_len);
+void ipmi_close_sess_response(const u_char *data, int data_len);
+
+/* ipmi_sdr.c */
+void ipmi_get_sdr_repo_response(const u_char *data, int data_len);
+void ipmi_reserve_sdr_repo_response(const u_char *data, int data_len);
+void ipmi_get_sdr_request(const u_char *data, int data_len);
+void ipmi_get_sdr_response(const u_char *data, int data_len);
+void ipmi_get_sensor_reading_request(const u_char *data, int data_len);
+void ipmi_get_sensor_reading_response(const u_char *data, int data_len);
+void ipmi_get_sensor_threshold_request(const u_char *data, int data_len);
+void ipmi_get_sensor_threshold_response(const u_char *data, int data_len);
+
+#endif
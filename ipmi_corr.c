@@ -0,0 +1,206 @@
+/*
+ * pending ipmi requests, see ipmi_corr.h
+ *
+ * linear probing, an entry is removed by shifting the following entries of its
+ * cluster back, so there are no tombstones and a lookup stops at the first
+ * free slot
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/time.h>
+#include <arpa/inet.h>
+
+#include "dump.h"
+#include "ipmi_cmd.h"
+#include "ipmi_corr.h"
+#include "stats.h"
+
+#define CORR_MASK       (IPMI_CORR_SLOTS - 1)
+#define CORR_MAX_USED   (IPMI_CORR_SLOTS / 4 * 3)
+
+/* both directions of a udp flow are decoded by the same thread, see bmc_shard of main.c and tpacket_open */
+static DUMP_TLS struct ipmi_corr_entry *pending;
+static DUMP_TLS u_int32_t pending_count;
+static DUMP_TLS u_int32_t pending_dropped;     /* requests not tracked, the table was full */
+static DUMP_TLS time_t next_sweep;
+static DUMP_TLS struct ipmi_corr_entry answered;
+
+static u_int32_t corr_slot(const struct ipmi_corr_key *key) {
+    u_int64_t h;
+
+    h = ((u_int64_t)key->client_addr << 32 | key->bmc_addr) * 0x9e3779b97f4a7c15ull;
+    h ^= ((u_int64_t)key->client_port << 48 | (u_int64_t)key->bmc_port << 32 | key->session) * 0xc2b2ae3d27d4eb4full;
+    h ^= ((u_int64_t)key->seq << 16 | key->netfn << 8 | key->cmd) * 0x165667b19e3779f9ull;
+    return (u_int32_t)(h >> 40) & CORR_MASK;
+}
+
+static int corr_key_eq(const struct ipmi_corr_key *a, const struct ipmi_corr_key *b) {
+    return a->client_addr == b->client_addr && a->bmc_addr == b->bmc_addr
+        && a->client_port == b->client_port && a->bmc_port == b->bmc_port
+        && a->session == b->session && a->seq == b->seq
+        && a->netfn == b->netfn && a->cmd == b->cmd;
+}
+
+/* slot of key, or the free slot ending its cluster */
+static u_int32_t corr_find(const struct ipmi_corr_key *key) {
+    u_int32_t i;
+
+    for ( i = corr_slot(key); pending[i].used; i = (i + 1) & CORR_MASK ){
+        if ( corr_key_eq(&pending[i].key, key) ){
+            break;
+        }
+    }
+    return i;
+}
+
+/* free slot i, the entries after it move back when their home slot allows */
+static void corr_remove(u_int32_t i) {
+    u_int32_t j, home;
+
+    for ( j = (i + 1) & CORR_MASK; pending[j].used; j = (j + 1) & CORR_MASK ){
+        home = corr_slot(&pending[j].key);
+        /* the entry can fill i unless its home lies cyclically in (i, j] */
+        if ( ((j - home) & CORR_MASK) >= ((j - i) & CORR_MASK) ){
+            pending[i] = pending[j];
+            i = j;
+        }
+    }
+    pending[i].used = 0;
+    pending_count--;
+}
+
+/* a line per unanswered request, or a count in the -A reports */
+static void corr_report(FILE *f, const struct ipmi_corr_entry *e) {
+    char client[INET_ADDRSTRLEN], bmc[INET_ADDRSTRLEN];
+
+    if ( dump_stats ){
+        stats_expired(DUMP_BMC_KEY(e->key.bmc_addr, e->key.bmc_port),
+                DUMP_BMC_KEY(e->key.client_addr, e->key.client_port), e->key.netfn, e->key.cmd);
+        return;
+    }
+
+    inet_ntop(AF_INET, &e->key.client_addr, client, sizeof(client));
+    inet_ntop(AF_INET, &e->key.bmc_addr, bmc, sizeof(bmc));
+    fprintf(f, "No response to %s(0x%02x) from %s:%u to %s:%u, session %u, rqSeq 0x%02x, requested at %ld.%06ld\n",
+            ipmi_get_cmd_str(e->key.netfn, e->key.cmd), e->key.cmd, client, e->key.client_port, bmc, e->key.bmc_port,
+            e->key.session, e->key.seq, (long)e->ts.tv_sec, (long)e->ts.tv_usec);
+}
+
+/* report(or count) and drop the requests older than IPMI_CORR_TIMEOUT */
+static void corr_expire(time_t now) {
+    u_int32_t i = 0;
+
+    while ( i < IPMI_CORR_SLOTS ){
+        if ( pending[i].used && pending[i].ts.tv_sec + IPMI_CORR_TIMEOUT < now ){
+            corr_report(stderr, &pending[i]);
+            /* an entry from further may move into i, look at i again */
+            corr_remove(i);
+            continue;
+        }
+        i++;
+    }
+    next_sweep = now + 1;
+}
+
+/*
+ * track a request, a retransmission replaces the former one
+ *
+ * @key: the conversation of the request
+ * @ts: capture time of the request
+ *
+ * return the entry for the request decoder to fill its ctx, or NULL when the
+ * table is full of requests younger than IPMI_CORR_TIMEOUT
+ */
+struct ipmi_corr_entry* ipmi_corr_request(const struct ipmi_corr_key *key, const struct timeval *ts) {
+    u_int32_t i;
+
+    if ( pending == NULL ){
+        pending = (struct ipmi_corr_entry *)calloc(IPMI_CORR_SLOTS, sizeof(struct ipmi_corr_entry));
+        if ( pending == NULL ){
+            fprintf(stderr, "out of memory for pending requests\n");
+            exit(1);
+        }
+        next_sweep = ts->tv_sec + 1;
+    }
+    /* at most once a second, a table full of young requests is not scanned on every request */
+    if ( ts->tv_sec >= next_sweep ){
+        corr_expire(ts->tv_sec);
+    }
+
+    i = corr_find(key);
+    if ( !pending[i].used ){
+        if ( pending_count >= CORR_MAX_USED ){
+            pending_dropped++;
+            return NULL;
+        }
+        pending[i].used = 1;
+        pending[i].key = *key;
+        pending_count++;
+    }
+    pending[i].ts = *ts;
+    memset(&pending[i].ctx, 0, sizeof(pending[i].ctx));
+    return &pending[i];
+}
+
+/*
+ * report the expired requests when no request comes to sweep them, a capture
+ * ending in silence or a BMC no longer polled
+ *
+ * @now: capture time of the packet being decoded, or the clock on an idle live capture
+ *
+ */
+void ipmi_corr_tick(time_t now) {
+    if ( pending != NULL && now >= next_sweep ){
+        corr_expire(now);
+    }
+}
+
+/*
+ * pair a response with its request, the request is no longer pending
+ *
+ * @key: the conversation of the response, the same as of its request
+ *
+ * return a copy of the request entry valid until the next call, or NULL when
+ * no request is pending for it
+ */
+struct ipmi_corr_entry* ipmi_corr_response(const struct ipmi_corr_key *key) {
+    u_int32_t i;
+
+    if ( pending == NULL ){
+        return NULL;
+    }
+    i = corr_find(key);
+    if ( !pending[i].used ){
+        return NULL;
+    }
+    answered = pending[i];
+    corr_remove(i);
+    return &answered;
+}
+
+/*
+ * report every request still pending at the end of the capture as unanswered
+ */
+void ipmi_corr_flush(FILE *f) {
+    u_int32_t i;
+
+    if ( pending == NULL ){
+        return;
+    }
+
+    flockfile(f);
+    for ( i = 0; i < IPMI_CORR_SLOTS; i++ ){
+        if ( pending[i].used ){
+            corr_report(f, &pending[i]);
+            pending[i].used = 0;
+        }
+    }
+    if ( pending_dropped > 0 ){
+        fprintf(f, "%u requests were not tracked, more than %d were pending\n", pending_dropped, CORR_MAX_USED);
+    }
+    funlockfile(f);
+    pending_count = 0;
+    pending_dropped = 0;
+}
@@ -0,0 +1,54 @@
+#ifndef _IPMI_DUMP_IPMI_CORR_H
+#define _IPMI_DUMP_IPMI_CORR_H
+
+#include <stdio.h>
+#include <sys/types.h>
+#include <sys/time.h>
+
+/*
+ * pairing of ipmi responses with their request
+ *
+ * a request is pending until the response with the same conversation, session,
+ * rqSeq, netfn and cmd comes back. pending requests live in a bounded open
+ * addressing table of the decoding thread, so a response is paired in O(1)
+ * however many managers poll however many BMCs. a request without a response
+ * for IPMI_CORR_TIMEOUT seconds(of capture time) is reported, or counted with
+ * -A, and dropped
+ */
+
+#define IPMI_CORR_SLOTS     4096    /* pending requests per decoding thread, at most 3/4 used */
+#define IPMI_CORR_TIMEOUT   5
+
+struct ipmi_corr_key {
+    u_int32_t       client_addr;    /* network order */
+    u_int32_t       bmc_addr;
+    u_short         client_port;    /* host order */
+    u_short         bmc_port;
+    u_int32_t       session;
+    u_char          seq;            /* rqSeq(6 bits), without the lun bits */
+    u_char          netfn;          /* of the request */
+    u_char          cmd;
+};
+
+struct ipmi_corr_entry {
+    struct ipmi_corr_key    key;
+    struct timeval          ts;     /* of the request */
+    int                     used;
+
+    /* what the request decoder leaves for the response one */
+    union {
+        struct {
+            unsigned short  rec_id;     /* 0 for the first record */
+            u_char          offset;
+            u_char          reading;
+        } sdr;                          /* Get SDR */
+        u_int32_t           sensor;     /* SDR_SENSOR_KEY, Get Sensor Reading */
+    } ctx;
+};
+
+struct ipmi_corr_entry* ipmi_corr_request(const struct ipmi_corr_key *key, const struct timeval *ts);
+struct ipmi_corr_entry* ipmi_corr_response(const struct ipmi_corr_key *key);
+void ipmi_corr_tick(time_t now);
+void ipmi_corr_flush(FILE *f);
+
+#endif
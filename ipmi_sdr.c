@@ -6,39 +6,24 @@
  * - get sdr
  * - get sensor reading
  */
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <math.h>
 #include <sys/types.h>
 
 #include "align.h"
 #include "bswap.h"
 #include "dump.h"
+#include "output.h"
 #include "ipmi_cmd.h"
 #include "ipmi_sdr_type.h"
-
-
-#define tos32(val, bits)    ((val & ((1<<((bits)-1)))) ? (-((val) & (1<<((bits)-1))) | (val)) : (val))
-
-#if WORDS_BIGENDIAN
-# define __TO_TOL(mtol)     (uint16_t)(mtol & 0x3f)
-# define __TO_M(mtol)       (int16_t)(tos32((((mtol & 0xff00) >> 8) | ((mtol & 0xc0) << 2)), 10))
-# define __TO_B(bacc)       (int32_t)(tos32((((bacc & 0xff000000) >> 24) | ((bacc & 0xc00000) >> 14)), 10))
-# define __TO_ACC(bacc)     (uint32_t)(((bacc & 0x3f0000) >> 16) | ((bacc & 0xf000) >> 6))
-# define __TO_ACC_EXP(bacc) (uint32_t)((bacc & 0xc00) >> 10)
-# define __TO_R_EXP(bacc)   (int32_t)(tos32(((bacc & 0xf0) >> 4), 4))
-# define __TO_B_EXP(bacc)   (int32_t)(tos32((bacc & 0xf), 4))
-#else
-# define __TO_TOL(mtol)     (uint16_t)(BSWAP_16(mtol) & 0x3f)
-# define __TO_M(mtol)       (int16_t)(tos32((((BSWAP_16(mtol) & 0xff00) >> 8) | ((BSWAP_16(mtol) & 0xc0) << 2)), 10))
-# define __TO_B(bacc)       (int32_t)(tos32((((BSWAP_32(bacc) & 0xff000000) >> 24) | \
-                                            ((BSWAP_32(bacc) & 0xc00000) >> 14)), 10))
-# define __TO_ACC(bacc)     (uint32_t)(((BSWAP_32(bacc) & 0x3f0000) >> 16) | ((BSWAP_32(bacc) & 0xf000) >> 6))
-# define __TO_ACC_EXP(bacc) (uint32_t)((BSWAP_32(bacc) & 0xc00) >> 10)
-# define __TO_R_EXP(bacc)   (int32_t)(tos32(((BSWAP_32(bacc) & 0xf0) >> 4), 4))
-# define __TO_B_EXP(bacc)   (int32_t)(tos32((BSWAP_32(bacc) & 0xf), 4))
-#endif
+#include "sdr_store.h"
+#include "sdr_cache.h"
+#include "sdr_export.h"
+#include "sdr_partial.h"
+#include "sensor_conv.h"
+#include "ipmi_corr.h"
 
 
 /* unit description codes (IPMI v1.5 section 43.17) */
@@ -172,99 +157,24 @@ struct __ipmi_get_sensor_threshold_response {
     u_char              u_nr TCC_PACKED;
 } GNU_PACKED;
 
-/* chain to store all records */
-struct __ipmi_record_complete {
-    unsigned short      sdr_rec_id TCC_PACKED;
-    u_char              sdr_sensor_num TCC_PACKED;
-    u_char              sdr_rec_type TCC_PACKED;
-    u_char              sdr_rec_len TCC_PACKED; 
-    u_char              offseting TCC_PACKED; /* current pending offset */
-    u_char              reading TCC_PACKED; /* current reading len */
-    u_char              raw[255] TCC_PACKED;
-    struct __ipmi_record_complete  *next TCC_PACKED;
-} GNU_PACKED;
-static struct __ipmi_record_complete  *head;
-static struct __ipmi_record_complete   *last;
-static struct __ipmi_record_complete* seek_record(unsigned short sdr_rec_id) {
-    struct __ipmi_record_complete *p;
-    p = head;
-    while ( p ){
-        if ( p->sdr_rec_id == sdr_rec_id ) break;
-        p = p->next;
-    }
-    return p;
-}
-static struct __ipmi_record_complete* seek_sensor(u_char num) {
-    struct __ipmi_record_complete *p;
-    p = head;
-    while ( p ){
-        if ( p->sdr_sensor_num == num ) break;
-        p = p->next;
-    }
-    return p;
-}
-
-static struct __ipmi_record_complete* add_record(){
-    struct __ipmi_record_complete *p;
-    p = (struct __ipmi_record_complete *)calloc(1, sizeof(struct __ipmi_record_complete));
-    if ( head == NULL ){
-        head = p;
-    }
-    else {
-        p->next = head;
-        head = p;
-    }
-
-    return p;
-}
-
-static void remove_record(unsigned short sdr_rec_id){
-    struct __ipmi_record_complete *p, *pp;
-    p = head; pp = NULL;
-    while ( p ){
-        if ( p->sdr_rec_id == sdr_rec_id ) {
-            if ( pp == NULL ){
-                head = p->next;
-            }
-            else {
-                pp->next = p->next;
-            }
-            break;
-        }
-    }
-    if ( p ) free(p);
-
-    return;
-}
-
-static void clear_all_record(){
-    struct __ipmi_record_complete *p;
-    p = head;
-    while( p ){
-        free(p);
-    }
-
-    head = NULL;
-}
-
-void print_ipmi_sdr_op_support(u_char op_support){ if ( op_support & SDR_OP_SUP_ALLOC_INFO ) { printf("AllocInfo "); }
+void print_ipmi_sdr_op_support(u_char op_support){ if ( op_support & SDR_OP_SUP_ALLOC_INFO ) { OUT_LIT("AllocInfo "); }
     if ( op_support & SDR_OP_SUP_RESERVE_REPO ) {
-        printf("ReserveRepo ");
+        OUT_LIT("ReserveRepo ");
     }
     if ( op_support & SDR_OP_SUP_PARTIAL_ADD ) {
-        printf("PartialAdd ");
+        OUT_LIT("PartialAdd ");
     }
     if ( op_support & SDR_OP_SUP_DELETE ) {
-        printf("Delete ");
+        OUT_LIT("Delete ");
     }
     if ( op_support & SDR_OP_SUP_NON_MODAL_UP ) {
-        printf("NonModalUpdate ");
+        OUT_LIT("NonModalUpdate ");
     }
     if ( op_support & SDR_OP_SUP_MODAL_UP ) {
-        printf("ModalUpdate ");
+        OUT_LIT("ModalUpdate ");
     }
     if ( op_support & SDR_OP_SUP_OVERFLOW ) {
-        printf("Overflow ");
+        OUT_LIT("Overflow ");
     }
 
 }
@@ -314,131 +224,177 @@ const char* get_ipmi_sdr_sensor_reading_type(u_char rtype) {
   	return "out of range";
 }
 
+static const char* sensor_type_str(u_char type) {
+    if ( type > SENSOR_TYPE_MAX ){
+        return "reserved or oem defined(>=0xc0)";
+    }
+    return sensor_type_desc[type];
+}
+
+static const char* unit_str(u_char unit_base) {
+    if ( unit_base >= sizeof(unit_desc) / sizeof(unit_desc[0]) ){
+        return "unknown";
+    }
+    return unit_desc[unit_base];
+}
+
+static struct out_label rec_type_labels[256];
+static struct out_label sensor_type_labels[256];
+static struct out_label reading_type_labels[256];
+static struct out_label unit_labels[256];
+
+__attribute__((constructor)) static void ipmi_sdr_labels_init(void) {
+    out_labels_init(rec_type_labels, 256, get_ipmi_sdr_rec_type_str);
+    out_labels_init(sensor_type_labels, 256, sensor_type_str);
+    out_labels_init(reading_type_labels, 256, get_ipmi_sdr_sensor_reading_type);
+    out_labels_init(unit_labels, 256, unit_str);
+}
+
 static void print_id_string(u_char len, char *id_string){
     int id_length = (int)(len & 0x1f);
-    printf("  [IPMI] Id Code: 0x%02x, Id Length: 0x%02x\n", (len >> 6), len & 0x1f);
+    OUT_LIT("  [IPMI] Id Code: ");
+    out_hex8(len >> 6);
+    OUT_LIT(", Id Length: ");
+    out_hex8(id_length);
+    out_char('\n');
     if ( (id_length == 0) || (id_length == 0x1f) ){
         return;
     }
-    char tmp[17]; /* most 16 bytes */
-    memcpy(tmp, id_string, id_length);
-    tmp[id_length]='\0';
-    printf("  [IPMI] Id String: %s\n", tmp);
+    /* the string is not terminated, stop at the first NUL like %s did */
+    OUT_LIT("  [IPMI] Id String: ");
+    out_strn(id_string, strnlen(id_string, id_length));
+    out_char('\n');
 }
 
-static double convert_sensor_reading(struct __ipmi_record_complete *record, u_char val){
-    if ( record == NULL ){
-	    return 0;
-    }
+/*
+ * the body covers the struct of the record type and the id string it tells,
+ * else the struct would be read past the bytes of the record
+ *
+ * @record: a complete record
+ *
+ */
+static int record_fits(const struct sdr_record *record) {
+    size_t need;
+    u_char id_len;
 
-    if ( record->sdr_rec_type != SDR_RECORD_TYPE_FULL_SENSOR ){
-	    return 0;
+    if ( record->sdr_rec_type == SDR_RECORD_TYPE_FULL_SENSOR ){
+        need = offsetof(struct ipmi_sdr_type_full_sensor, id_string);
     }
-
-
-    struct ipmi_sdr_type_full_sensor *fs = (struct ipmi_sdr_type_full_sensor *)&(record->raw[5]);
-    int m,b,k1,k2,si;
-    double result;
-    m = __TO_M(fs->mtol);
-    b = __TO_M(fs->bacc);
-    k1 = __TO_B_EXP(fs->bacc);
-    k2 = __TO_R_EXP(fs->bacc);
-    si = ((fs->common.unit & 0xc0) >> 6);
-    //fprintf(stderr, "m:%d,b:%d,k1:%d,k2:%d,si:%d\n",m,b,k1,k2,si);
-
-    switch(si) {
-        case 0: /* unsigned */
-            result = (double) (((m*val)+b*pow(10,k1)) * pow(10,k2));
-            break;
-        case 1: /* signed 1's complement */
-            if ( val & 0x80 ){
-                val++;
-            }
-        case 2: /* signed 2's complement */
-            result = (double) (((m*(char)val)+b*pow(10,k1)) * pow(10,k2));
-            break;
-        default:
-            return 0.0;
+    else if ( record->sdr_rec_type == SDR_RECORD_TYPE_COMPACT_SENSOR ){
+        need = offsetof(struct ipmi_sdr_type_compact_sensor, id_string);
     }
+    else if ( record->sdr_rec_type == SDR_RECORD_TYPE_MC_DEVICE_LOCATOR ){
+        need = offsetof(struct ipmi_sdr_type_mc_device_locator, id_string);
+    }
+    else if ( record->sdr_rec_type == SDR_RECORD_TYPE_FRU_DEVICE_LOCATOR ){
+        need = offsetof(struct ipmi_sdr_type_fru_device_locator, id_string);
+    }
+    else {
+        return 1;
+    }
+    if ( record->sdr_rec_len < need ){
+        return 0;
+    }
+    /* the type/length byte of the id string is the last one before it */
+    id_len = record->raw[5 + need - 1] & 0x1f;
+    return id_len == 0x1f || record->sdr_rec_len >= need + id_len;
+}
 
-    /* TODO applying linearization, see ipmitool/lib/ipmi_sdr.c ln:218 */
-    return result;
-
-} 
+static double convert_sensor_reading(struct sdr_record *record, u_char val){
+    /* only the analog full sensors have a table */
+    if ( record == NULL || record->conv == NULL ){
+        return 0;
+    }
+    return record->conv[val];
+}
 
 
-static void print_ipmi_record_complete(struct __ipmi_record_complete *record){
+static void print_ipmi_record_complete(struct sdr_record *record){
     if ( record == NULL )
         return;
     u_char    *rbody = &(record->raw[5]);
-    printf("  [IPMI] Record Id: %d\n", record->sdr_rec_id);
-    printf("  [IPMI] Record Type: %s(0x%02x)\n", get_ipmi_sdr_rec_type_str(record->sdr_rec_type), record->sdr_rec_type);
-    printf("  [IPMI] Record Body Length: %d\n", record->sdr_rec_len);
+    OUT_DEC_LINE("  [IPMI] Record Id: ", record->sdr_rec_id);
+    OUT_LABEL_LINE("  [IPMI] Record Type: ", &rec_type_labels[record->sdr_rec_type]);
+    OUT_DEC_LINE("  [IPMI] Record Body Length: ", record->sdr_rec_len);
+    if ( record->sdr_gap ){
+        OUT_LIT("  [IPMI] Incomplete: a partial read of the record was missed, its bytes are not trusted\n");
+    }
+    if ( !record_fits(record) ){
+        OUT_LIT("  [IPMI] Record body too short for its type, not parsed.\n");
+        return;
+    }
 
 
     /* section 43.9 */
     if ( record->sdr_rec_type == SDR_RECORD_TYPE_MC_DEVICE_LOCATOR ){
         struct ipmi_sdr_type_mc_device_locator *l = (struct ipmi_sdr_type_mc_device_locator *)rbody;
-        printf("  [IPMI] I2C Slave Address: 0x%02x\n", l->slave_addr);
-        printf("  [IPMI] Channel Number: 0x%02x\n", l->chan_num);
-        printf("  [IPMI] Power State...: 0x%02x\n", l->psn_gi);
-        printf("  [IPMI] Device Cap: 0x%02x\n", l->dev_cap);
-        printf("  [IPMI] Entity Id: 0x%02x\n", l->e_id);
-        printf("  [IPMI] Entity Instance: 0x%02x\n", l->e_ins);
-        printf("  [IPMI] OEM: 0x%02x\n", l->oem);
+        OUT_HEX8_LINE("  [IPMI] I2C Slave Address: ", l->slave_addr);
+        OUT_HEX8_LINE("  [IPMI] Channel Number: ", l->chan_num);
+        OUT_HEX8_LINE("  [IPMI] Power State...: ", l->psn_gi);
+        OUT_HEX8_LINE("  [IPMI] Device Cap: ", l->dev_cap);
+        OUT_HEX8_LINE("  [IPMI] Entity Id: ", l->e_id);
+        OUT_HEX8_LINE("  [IPMI] Entity Instance: ", l->e_ins);
+        OUT_HEX8_LINE("  [IPMI] OEM: ", l->oem);
         print_id_string(l->id_code_type, l->id_string);
     }
     else if ( record->sdr_rec_type == SDR_RECORD_TYPE_OEM ){
-        printf("  [IPMI] Oem Data Not Parsed.\n");
+        OUT_LIT("  [IPMI] Oem Data Not Parsed.\n");
     }
     /* section 43.8 */
     else if ( record->sdr_rec_type == SDR_RECORD_TYPE_FRU_DEVICE_LOCATOR ){
         struct ipmi_sdr_type_fru_device_locator *l = (struct ipmi_sdr_type_fru_device_locator *)rbody;
-        printf("  [IPMI] Device Access Address: 0x%02x\n", l->dev_addr);
-        printf("  [IPMI] Device Id/Slave Address: 0x%02x\n", l->dev_id);
-        printf("  [IPMI] Access Info: 0x%02x\n", l->dev_id);
+        OUT_HEX8_LINE("  [IPMI] Device Access Address: ", l->dev_addr);
+        OUT_HEX8_LINE("  [IPMI] Device Id/Slave Address: ", l->dev_id);
+        OUT_HEX8_LINE("  [IPMI] Access Info: ", l->dev_id);
         if ( (l->dev_id & 0x80) > 0){
-            printf("    [IPMI] Logical FRU Device\n");
+            OUT_LIT("    [IPMI] Logical FRU Device\n");
         }
         else {
-            printf("    [IPMI] Non-Logical FRU Device\n");
+            OUT_LIT("    [IPMI] Non-Logical FRU Device\n");
         }
-        printf("    [IPMI] LUN: 0x%02x\n", ((l->dev_id >> 3) & 0x03));
-        printf("    [IPMI] Private Bus Id: 0x%02x\n", (l->dev_id & 0x07));
-        printf("  [IPMI] Channel Number: 0x%02x\n", l->chan_num);
+        OUT_HEX8_LINE("    [IPMI] LUN: ", ((l->dev_id >> 3) & 0x03));
+        OUT_HEX8_LINE("    [IPMI] Private Bus Id: ", (l->dev_id & 0x07));
+        OUT_HEX8_LINE("  [IPMI] Channel Number: ", l->chan_num);
         /* TODO print type in string */
-        printf("  [IPMI] Device Type: 0x%02x\n", l->type);
-        printf("  [IPMI] Device Type Modifier: 0x%02x\n", l->type_mod);
-        printf("  [IPMI] Entity Id: 0x%02x\n", l->eid);
-        printf("  [IPMI] Entity Instance: 0x%02x\n", l->eins);
-        printf("  [IPMI] OEM: 0x%02x\n", l->oem);
+        OUT_HEX8_LINE("  [IPMI] Device Type: ", l->type);
+        OUT_HEX8_LINE("  [IPMI] Device Type Modifier: ", l->type_mod);
+        OUT_HEX8_LINE("  [IPMI] Entity Id: ", l->eid);
+        OUT_HEX8_LINE("  [IPMI] Entity Instance: ", l->eins);
+        OUT_HEX8_LINE("  [IPMI] OEM: ", l->oem);
         print_id_string(l->id_string_len, l->id_string);
     }
     /* section 43.1  */
     else if ( record->sdr_rec_type == SDR_RECORD_TYPE_FULL_SENSOR || record->sdr_rec_type == SDR_RECORD_TYPE_COMPACT_SENSOR ){
         struct ipmi_sdr_sensor_common *s = (struct ipmi_sdr_sensor_common *)rbody;
-        printf("  [IPMI] Sensor Number: 0x%02x\n", s->number);
+        OUT_HEX8_LINE("  [IPMI] Sensor Number: ", s->number);
         record->sdr_sensor_num = s->number;	
-        printf("  [IPMI] Sensor Entity Id: 0x%02x\n", s->e_id);
-        printf("  [IPMI] Sensor Entity Instance: 0x%02x\n", s->e_ins);
-        if ( s->type > 0x2c ) {
-            printf("  [IPMI] Sensor Type: reserved or oem defined(>=0xc0)(0x%02x)\n",s->type);
-        }
-        else {
-            printf("  [IPMI] Sensor Type: %s(0x%02x)\n",sensor_type_desc[s->type]  ,s->type);
-        }
-        printf("  [IPMI] Sensor Reading Type: %s(0x%02x)\n", get_ipmi_sdr_sensor_reading_type(s->evn_type) ,s->evn_type);
-        printf("  [IPMI] Sensor Unit: 0x%02x\n",s->unit);
-        printf("  [IPMI] Sensor Unit Base: %s(0x%02x)\n", unit_desc[s->unit_base] ,s->unit_base);
-        printf("  [IPMI] Sensor Unit Modifier: 0x%02x\n", s->unit_mod);
+        OUT_HEX8_LINE("  [IPMI] Sensor Entity Id: ", s->e_id);
+        OUT_HEX8_LINE("  [IPMI] Sensor Entity Instance: ", s->e_ins);
+        OUT_LABEL_LINE("  [IPMI] Sensor Type: ", &sensor_type_labels[s->type]);
+        OUT_LABEL_LINE("  [IPMI] Sensor Reading Type: ", &reading_type_labels[s->evn_type]);
+        OUT_HEX8_LINE("  [IPMI] Sensor Unit: ", s->unit);
+        OUT_LABEL_LINE("  [IPMI] Sensor Unit Base: ", &unit_labels[s->unit_base]);
+        OUT_HEX8_LINE("  [IPMI] Sensor Unit Modifier: ", s->unit_mod);
         if ( record->sdr_rec_type == SDR_RECORD_TYPE_FULL_SENSOR ){
             struct ipmi_sdr_type_full_sensor *fs = (struct ipmi_sdr_type_full_sensor *)rbody;
-            printf("  [IPMI] Linearization: 0x%02x\n", fs->linearization);
-            printf("  [IPMI] M: %d,0x%02x\n",__TO_M(fs->mtol) ,fs->mtol);
-            printf("  [IPMI] B: %d\n",__TO_B(fs->bacc));
-            printf("  [IPMI] Bexp: %d\n",__TO_B_EXP(fs->bacc));
-            printf("  [IPMI] Rexp: %d\n",__TO_R_EXP(fs->bacc));
-            printf("  [IPMI] Value convert format: (%dxV+%dxpow(10,%d))xpow(10,%d) (y=(M x V + B x pow(10,Bexp)) x pow(10,Rexp))\n", __TO_M(fs->mtol), __TO_B(fs->bacc), __TO_B_EXP(fs->bacc), __TO_R_EXP(fs->bacc));
+            OUT_HEX8_LINE("  [IPMI] Linearization: ", fs->linearization);
+            OUT_LIT("  [IPMI] M: ");
+            out_dec(__TO_M(fs->mtol));
+            out_char(',');
+            out_hex8(fs->mtol);
+            out_char('\n');
+            OUT_DEC_LINE("  [IPMI] B: ", __TO_B(fs->bacc));
+            OUT_DEC_LINE("  [IPMI] Bexp: ", __TO_B_EXP(fs->bacc));
+            OUT_DEC_LINE("  [IPMI] Rexp: ", __TO_R_EXP(fs->bacc));
+            OUT_LIT("  [IPMI] Value convert format: (");
+            out_dec(__TO_M(fs->mtol));
+            OUT_LIT("xV+");
+            out_dec(__TO_B(fs->bacc));
+            OUT_LIT("xpow(10,");
+            out_dec(__TO_B_EXP(fs->bacc));
+            OUT_LIT("))xpow(10,");
+            out_dec(__TO_R_EXP(fs->bacc));
+            OUT_LIT(") (y=(M x V + B x pow(10,Bexp)) x pow(10,Rexp))\n");
             //u_char df = ((s->common.unit & 0xc0) >> 6);
             print_id_string(fs->id_code, fs->id_string);
         }
@@ -448,154 +404,251 @@ static void print_ipmi_record_complete(struct __ipmi_record_complete *record){
         }
     }
     else {
-        printf("  [IPMI] UnSupport SDR Type(0x%02x).\n", record->sdr_rec_type);
+        OUT_LIT("  [IPMI] UnSupport SDR Type(");
+        out_hex8(record->sdr_rec_type);
+        OUT_LIT(").\n");
     }
 
 
 }
 
-void print_ipmi_sdr(enum ipmi_direction direction,u_char cmd, const u_char *payload, int payload_len, enum dump_level dl) {
-    if ( cmd == GET_SDR_REPINFO ){
-        if ( direction == IPMI_REQUEST ){
-            /* no data need to unpack */
+/* section 33.9 */
+void ipmi_get_sdr_repo_response(const u_char *data, int data_len) {
+    struct ipmi_get_sdr_repo_response *response = (struct ipmi_get_sdr_repo_response *) data;
+    OUT_HEX8_LINE("  [IPMI] Completion Code: ", response->cc);
+    OUT_HEX8_LINE("  [IPMI] SDR Version: ", response->sdr_version);
+    OUT_DEC_LINE("  [IPMI] Read Count: ", response->sdr_rec_count);
+    OUT_DEC_LINE("  [IPMI] Free Bytes: ", response->sdr_rec_free);
+    OUT_DEC_LINE("  [IPMI] Last addition time: ", response->t1);
+    OUT_DEC_LINE("  [IPMI] Last deletion time: ", response->t2);
+    OUT_LIT("  [IPMI] Operation Support: ");
+    print_ipmi_sdr_op_support(response->sdr_op);
+    OUT_LIT("\n");
+
+    if ( response->cc == 0 ){
+        struct sdr_bmc *bmc = sdr_bmc_get(dump_pkt.bmc);
+        struct sdr_repo *repo = &bmc->repo;
+
+        /* unchanged, the usual case of a poller, costs nothing */
+        if ( repo->has_ts && repo->add_ts == response->t1 && repo->del_ts == response->t2
+                && repo->rec_count == response->sdr_rec_count ){
             return;
         }
-        else {
-            struct ipmi_get_sdr_repo_response *response = (struct ipmi_get_sdr_repo_response *) payload;
-            printf("  [IPMI] Completion Code: 0x%02x\n", response->cc);
-            printf("  [IPMI] SDR Version: 0x%02x\n", response->sdr_version);
-            printf("  [IPMI] Read Count: %d\n", response->sdr_rec_count);
-            printf("  [IPMI] Free Bytes: %d\n", response->sdr_rec_free);
-            printf("  [IPMI] Last addition time: %d\n", response->t1);
-            printf("  [IPMI] Last deletion time: %d\n", response->t2);
-            printf("  [IPMI] Operation Support: ");
-            print_ipmi_sdr_op_support(response->sdr_op);
-            printf("\n");
+        /*
+         * a deletion(a record replaced is deleted then added) leaves no record
+         * trusted. records only added since keep the ones read, the new ones
+         * are read on the next walk
+         */
+        if ( repo->has_ts && (repo->del_ts != response->t2 || response->sdr_rec_count < repo->rec_count) ){
+            sdr_bmc_reset(bmc);
+            sdr_export_mark(bmc);
         }
+        repo->add_ts = response->t1;
+        repo->del_ts = response->t2;
+        repo->rec_count = response->sdr_rec_count;
+        repo->has_ts = 1;
+        sdr_cache_tag(bmc);
     }
-    else if ( cmd == RESERVE_SDR_REP ){
-        if ( direction == IPMI_REQUEST ){
-            /* no data need to unpack */
-            return;
-        }
-        else {
-            struct ipmi_reserve_sdr_repo_response *response = (struct ipmi_reserve_sdr_repo_response *) payload;
-            printf("  [IPMI] Completion Code: 0x%02x\n", response->cc);
-            printf("  [IPMI] Reservation Id: %d\n", response->sdr_res_id);
-        }
+}
+
+/* section 33.11 */
+void ipmi_reserve_sdr_repo_response(const u_char *data, int data_len) {
+    struct ipmi_reserve_sdr_repo_response *response = (struct ipmi_reserve_sdr_repo_response *) data;
+    OUT_HEX8_LINE("  [IPMI] Completion Code: ", response->cc);
+    OUT_DEC_LINE("  [IPMI] Reservation Id: ", response->sdr_res_id);
+    /* a reservation only guards partial reads, the records read are kept until the timestamps move */
+}
+
+/*
+ * index a complete sensor record by its sensor, and convert the readings of
+ * an analog full sensor once for all
+ *
+ * @repo: the repo of the record
+ * @record: read to the end, on the wire or from the cache
+ *
+ */
+void ipmi_sdr_record_ready(struct sdr_repo *repo, struct sdr_record *record) {
+    struct ipmi_sdr_sensor_common *s;
+
+    if ( record->sdr_rec_type != SDR_RECORD_TYPE_FULL_SENSOR && record->sdr_rec_type != SDR_RECORD_TYPE_COMPACT_SENSOR ){
+        return;
     }
-    /* get sdr can request serval times and return partially, we have to track the request and response */
-    else if ( cmd == GET_SDR ){
-        if ( direction == IPMI_REQUEST ){
-            struct ipmi_get_sdr_request *request = (struct ipmi_get_sdr_request *) payload;
-            struct __ipmi_record_complete *s = NULL;
-            printf("  [IPMI] Reservation Id: %d\n", request->sdr_res_id);
-            printf("  [IPMI] Record Id: %d\n", request->sdr_rec_id);
-            printf("  [IPMI] Offset: %d\n", request->sdr_rec_offset);
-            printf("  [IPMI] Reading bytes: %d\n", request->sdr_byte_read);
-            if ( request->sdr_rec_id != 0 ) { /* 0 means try to fetch the first nearest record  */
-                last = seek_record(request->sdr_rec_id);
-                if ( last == NULL ){
-                    last = add_record();
-                }
-                last->sdr_rec_id = request->sdr_rec_id;
-                last->offseting = request->sdr_rec_offset;
-                last->reading = request->sdr_byte_read;
-            }
-	    else if ( last != NULL ) {
-                last->offseting = request->sdr_rec_offset;
-                last->reading = request->sdr_byte_read;
-	    }
+    /* a short record is not parsed, its sensor is not converted */
+    if ( !record_fits(record) ){
+        return;
+    }
+    s = (struct ipmi_sdr_sensor_common *)&(record->raw[5]);
+    sdr_sensor_set(repo, SDR_SENSOR_KEY(s->owner, s->owner_lun, s->number), record);
+    if ( record->sdr_rec_type == SDR_RECORD_TYPE_FULL_SENSOR ){
+        /* a record read again is converted again, in place */
+        if ( SENSOR_FMT(s->unit) == SENSOR_FMT_NO_ANALOG ){
+            record->conv = NULL;
         }
         else {
-            struct ipmi_get_sdr_response *response = (struct ipmi_get_sdr_response *) payload;
-            printf("  [IPMI] Completion Code: 0x%02x\n", response->cc);
-            printf("  [IPMI] Next Record Id: %d\n", response->sdr_next_rec_id);
-            if ( last == NULL ) { 
-            /* this is because the request record id is 0 which means a first attampt read, in this case the payload len must be exactly 9(cc+nextrid+5+checksum) which means fetch the head */
-                if ( payload_len == 5+4){
-                    last = add_record();
-                    last->sdr_rec_id = response->sdr_rec_header.sdr_rec_id;
-                    last->offseting = 0;
-                    last->reading = 5;
-                }
+            if ( record->conv == NULL ){
+                sdr_record_alloc_conv(repo, record);
             }
+            sensor_conv_build(record->conv, (struct ipmi_sdr_type_full_sensor *)s);
+        }
+    }
+}
 
-            if ( last != NULL ) {
-                if ( last->offseting == 0 && last->reading >= 5 ){
-                    last->sdr_rec_type = response->sdr_rec_header.sdr_rec_type;
-                    last->sdr_rec_len = response->sdr_rec_header.sdr_rec_len;
-                }
-                memcpy(&(last->raw[last->offseting]), payload + 3 /* skip cc and next_rec_id */, last->reading );
-                if ( last->offseting + last->reading == last->sdr_rec_len+5 ){
-                    /* reading complete parse and display */
-                    print_ipmi_record_complete(last);
-                }
-                else {
-                    printf("  [IPMI] (delay to display the following bytes until partial reading finish)\n");
-                }
-                
-            }
-            else {
-                fprintf(stderr, "the response failed to match any request");
-            }
+/* section 33.12, get sdr can request serval times and return partially, we have to track the request and response */
+static struct sdr_record* find_or_add_record(struct sdr_repo *repo, unsigned short rec_id) {
+    struct sdr_record *record = sdr_record_find(repo, rec_id);
+
+    if ( record == NULL ){
+        record = sdr_record_add(repo, rec_id);
+    }
+    return record;
+}
+
+/* the bytes of a reassembled record become the record of the repo */
+static struct sdr_record* publish_record(struct sdr_repo *repo, const struct sdr_partial *p) {
+    struct sdr_record *record = find_or_add_record(repo, p->rec_id);
+
+    if ( record->raw == NULL || record->sdr_rec_len != p->len ){
+        sdr_record_alloc_raw(repo, record, p->len);
+    }
+    else {
+        sdr_record_restart(repo, record);
+    }
+    memcpy(record->raw, p->raw, p->len + 5);
+    record->sdr_rec_type = p->raw[3];
+    return record;
+}
+
+void ipmi_get_sdr_request(const u_char *data, int data_len) {
+    struct ipmi_get_sdr_request *request = (struct ipmi_get_sdr_request *) data;
+    OUT_DEC_LINE("  [IPMI] Reservation Id: ", request->sdr_res_id);
+    OUT_DEC_LINE("  [IPMI] Record Id: ", request->sdr_rec_id);
+    OUT_DEC_LINE("  [IPMI] Offset: ", request->sdr_rec_offset);
+    OUT_DEC_LINE("  [IPMI] Reading bytes: ", request->sdr_byte_read);
+    if ( dump_pkt.corr != NULL ){
+        /* 0 means try to fetch the first nearest record, the response tells which one */
+        dump_pkt.corr->ctx.sdr.rec_id = request->sdr_rec_id;
+        dump_pkt.corr->ctx.sdr.offset = request->sdr_rec_offset;
+        dump_pkt.corr->ctx.sdr.reading = request->sdr_byte_read;
+    }
+}
+
+void ipmi_get_sdr_response(const u_char *data, int data_len) {
+    struct ipmi_get_sdr_response *response = (struct ipmi_get_sdr_response *) data;
+    struct sdr_bmc *bmc = sdr_bmc_get(dump_pkt.bmc);
+    struct sdr_record *record = NULL;
+    struct sdr_partial *p = NULL;
+    unsigned short rec_id;
+    int offset = 0, reading = 0, copy;
+    OUT_HEX8_LINE("  [IPMI] Completion Code: ", response->cc);
+    OUT_DEC_LINE("  [IPMI] Next Record Id: ", response->sdr_next_rec_id);
+    if ( dump_pkt.corr != NULL && response->cc == 0 ) {
+        rec_id = dump_pkt.corr->ctx.sdr.rec_id;
+        offset = dump_pkt.corr->ctx.sdr.offset;
+        reading = dump_pkt.corr->ctx.sdr.reading;
+        if ( rec_id == 0 && offset == 0 && data_len >= 3+2 ){
+            /* a first attempt read, the header of the response tells the record */
+            rec_id = response->sdr_rec_header.sdr_rec_id;
+        }
+        if ( rec_id != 0 ){
+            p = sdr_partial_get(dump_pkt.bmc, rec_id, dump_pkt.ts.tv_sec);
         }
     }
-    else if( cmd == GET_SENSOR_READING ){
-	    static u_char pending_sensor_num = 0;
-        if ( direction == IPMI_REQUEST ){
-            struct __ipmi_get_sensor_reading_request *request = (struct __ipmi_get_sensor_reading_request *) payload;
-	    pending_sensor_num = request->s_num;
-            printf("  [IPMI] Sensor Number: 0x%02x\n", request->s_num);
+
+    if ( p != NULL ) {
+        /* never past the data of the packet nor the record */
+        if ( reading > data_len - 3 ){
+            reading = data_len - 3;
+        }
+        copy = sdr_partial_add(p, offset, data + 3 /* skip cc and next_rec_id */, reading);
+        if ( SDR_PARTIAL_COMPLETE(p) ){
+            /* every byte came, in whatever order, parse and display */
+            record = publish_record(&bmc->repo, p);
+            sdr_partial_release(p);
+            record->sdr_gap = 0;
+            sdr_record_done(&bmc->repo, record);
+            sdr_cache_save(bmc, record);
+        }
+        else if ( p->header && copy > 0 && offset + copy == p->len + 5 ){
+            /* the end of the record came with a hole before it, shown untrusted until a late read fills it */
+            record = publish_record(&bmc->repo, p);
+            record->sdr_gap = 1;
+            dump_cnt.sdr_gaps++;
+        }
+        if ( record != NULL ){
+            ipmi_sdr_record_ready(&bmc->repo, record);
+            sdr_export_mark(bmc);
+            print_ipmi_record_complete(record);
+            /* the last record of the walk, the records may move to a set */
+            sdr_bmc_share(bmc);
         }
         else {
-            struct __ipmi_get_sensor_reading_response *response = (struct __ipmi_get_sensor_reading_response *) payload;
-            printf("  [IPMI] Completion Code: 0x%02x\n", response->cc);
-            struct __ipmi_record_complete  *record = seek_sensor(pending_sensor_num);
-	    if ( record != NULL ) {
-		if ( IS_READING_UNAVAILABLE(response->avail) ) {
-			printf("  [IPMI] Readed Value is unavaliable\n");
-		}
-		else {
-			struct ipmi_sdr_sensor_common *cmn = (struct ipmi_sdr_sensor_common *)&(record->raw[5]);
-		  if ( cmn->evn_type == 0x01 ) {
-			/* threshold type */ 
-			if ( (cmn->unit & 0xc0) != 0xc0 ) {
-				/* has analog value */
-				double c = convert_sensor_reading(record, response->value);
-				printf("  [IPMI] Readed Value: %.2f(0x%02x)\n",c ,response->value);
-			}	
-			else {
-				printf("  [IPMI] Readed Value(No analog): (0x%02x)\n",response->value);
-			}
-		  }
-		  else {
-				printf("  [IPMI] Readed Value(discrete or No analog): (0x%02x)\n",response->value);
- 			
-		  }
-		}
-	    }
-	    else {
-		    printf("  [IPMI] Readed Value(unconverted): 0x%02x\n", response->value);
-	    }
-
+            OUT_LIT("  [IPMI] (delay to display the following bytes until partial reading finish)\n");
         }
     }
-    else if( cmd == GET_SENSOR_THRESHOLD ){
-        if ( direction == IPMI_REQUEST ){
-            struct __ipmi_get_sensor_threshold_request *request = (struct __ipmi_get_sensor_threshold_request *) payload;
-            printf("  [IPMI] Sensor Number: 0x%02x\n", request->s_num);
+    else if ( dump_pkt.corr == NULL ) {
+        fprintf(stderr, "the response failed to match any request\n");
+    }
+}
+
+/* section 35.14 */
+void ipmi_get_sensor_reading_request(const u_char *data, int data_len) {
+    struct __ipmi_get_sensor_reading_request *request = (struct __ipmi_get_sensor_reading_request *) data;
+    /* the sensor is addressed by the responder of the request */
+    if ( dump_pkt.corr != NULL ){
+        dump_pkt.corr->ctx.sensor = SDR_SENSOR_KEY(dump_pkt.rs_addr, dump_pkt.rs_lun, request->s_num);
+    }
+    OUT_HEX8_LINE("  [IPMI] Sensor Number: ", request->s_num);
+}
+
+void ipmi_get_sensor_reading_response(const u_char *data, int data_len) {
+    struct __ipmi_get_sensor_reading_response *response = (struct __ipmi_get_sensor_reading_response *) data;
+    OUT_HEX8_LINE("  [IPMI] Completion Code: ", response->cc);
+    struct sdr_bmc *bmc = sdr_bmc_get(dump_pkt.bmc);
+    struct sdr_record  *record = NULL;
+    if ( dump_pkt.corr != NULL ) {
+        record = sdr_bmc_sensor_find(bmc, dump_pkt.corr->ctx.sensor);
+    }
+    if ( record != NULL ) {
+        if ( IS_READING_UNAVAILABLE(response->avail) ) {
+            OUT_LIT("  [IPMI] Readed Value is unavaliable\n");
         }
         else {
-            struct __ipmi_get_sensor_threshold_response *response = (struct __ipmi_get_sensor_threshold_response *) payload;
-            printf("  [IPMI] Completion Code: 0x%02x\n", response->cc);
-            /* TODO: unpack the mask */
-            printf("  [IPMI] Threshold Mask: 0x%02x\n", response->mask);
-            /* TODO: show the threshold */
+            struct ipmi_sdr_sensor_common *cmn = (struct ipmi_sdr_sensor_common *)&(record->raw[5]);
+            if ( cmn->evn_type == 0x01 ) {
+                /* threshold type */
+                if ( (cmn->unit & 0xc0) != 0xc0 ) {
+                    /* has analog value */
+                    double c = convert_sensor_reading(record, response->value);
+                    out_printf("  [IPMI] Readed Value: %.2f(0x%02x)\n",c ,response->value);
+                }
+                else {
+                    OUT_LIT("  [IPMI] Readed Value(No analog): (");
+                    out_hex8(response->value);
+                    OUT_LIT(")\n");
+                }
+            }
+            else {
+                OUT_LIT("  [IPMI] Readed Value(discrete or No analog): (");
+                out_hex8(response->value);
+                OUT_LIT(")\n");
+            }
         }
     }
     else {
-        fprintf(stderr, "unrecognized cmd 0x%02x\n", cmd);
+        OUT_HEX8_LINE("  [IPMI] Readed Value(unconverted): ", response->value);
     }
-    
+}
+
+/* section 35.9 */
+void ipmi_get_sensor_threshold_request(const u_char *data, int data_len) {
+    struct __ipmi_get_sensor_threshold_request *request = (struct __ipmi_get_sensor_threshold_request *) data;
+    OUT_HEX8_LINE("  [IPMI] Sensor Number: ", request->s_num);
+}
+
+void ipmi_get_sensor_threshold_response(const u_char *data, int data_len) {
+    struct __ipmi_get_sensor_threshold_response *response = (struct __ipmi_get_sensor_threshold_response *) data;
+    OUT_HEX8_LINE("  [IPMI] Completion Code: ", response->cc);
+    /* TODO: unpack the mask */
+    OUT_HEX8_LINE("  [IPMI] Threshold Mask: ", response->mask);
+    /* TODO: show the threshold */
 }
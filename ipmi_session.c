@@ -9,10 +9,12 @@
  * - close session
  */
 #include <stdio.h>
+#include <string.h>
 #include <sys/types.h>
 
 #include "align.h"
 #include "dump.h"
+#include "output.h"
 #include "ipmi_cmd.h"
 
 
@@ -126,6 +128,23 @@ const char* get_ipmi_auth_type_str(u_char auth_type){
     }
 }
 
+/* only the low nibble carries the value, the label keeps the whole byte */
+static const char* priviege_nibble_str(u_char priviege){
+    return get_ipmi_priviege(priviege & 0x0f);
+}
+
+static const char* auth_type_nibble_str(u_char auth_type){
+    return get_ipmi_auth_type_str(auth_type & 0x0f);
+}
+
+static struct out_label priviege_labels[256];
+static struct out_label auth_type_labels[256];
+
+__attribute__((constructor)) static void ipmi_session_labels_init(void) {
+    out_labels_init(priviege_labels, 256, priviege_nibble_str);
+    out_labels_init(auth_type_labels, 256, auth_type_nibble_str);
+}
+
 void print_ipmi_auth_cap(u_char auth_cap){
 #define __NONE   (1 << 0)
 #define __MD2    (1 << 1) 
@@ -135,108 +154,108 @@ void print_ipmi_auth_cap(u_char auth_cap){
 #define __OEM    (1 << 5)
 
     if ( auth_cap & __NONE ) {
-        printf("NONE ");
+        OUT_LIT("NONE ");
     }
     if ( auth_cap & __MD2 ) {
-        printf("MD2 ");
+        OUT_LIT("MD2 ");
     }
     if ( auth_cap & __MD5 ) {
-        printf("MD5 ");
+        OUT_LIT("MD5 ");
     }
     if ( auth_cap & __PWD ) {
-        printf("PWD ");
+        OUT_LIT("PWD ");
     }
     if ( auth_cap & __OEM ) {
-        printf("OEM ");
+        OUT_LIT("OEM ");
     }
 }
 
-/* TODO: check the payload length validation */
-void print_ipmi_session(enum ipmi_direction direction,u_char cmd, const u_char *payload, int payload_len, enum dump_level dl) {
-    if ( cmd ==  GET_CHAN_AUTH){
-        if ( direction == IPMI_REQUEST ){
-            struct ipmi_get_auth_cap_request *request = (struct ipmi_get_auth_cap_request *) payload;
-            printf("  [IPMI] Channel Number: 0x%02x\n", request->ch_num);
-            printf("  [IPMI] Privilege: %s(0x%02x)\n", get_ipmi_priviege(request->priviege & 0x0f), request->priviege);
-        }
-        else {
-            struct ipmi_get_auth_cap_response *response = (struct ipmi_get_auth_cap_response *) payload;
-            printf("  [IPMI] Completion Code: 0x%02x\n", response->cc);
-            printf("  [IPMI] Channel Number: 0x%02x\n", response->ch_num);
-            printf("  [IPMI] Authentication Support: (0x%02x)",response->auth_cap);
-            print_ipmi_auth_cap(response->auth_cap);
-            printf("\n");
-            /* TODO extract */
-            printf("  [IPMI] Authentication Method: 0x%02x\n", response->auth_method);
-            /* TODO print oem */
-        }
-    }
-    else if ( cmd == GET_SESS_CHAL ){
-        if ( direction == IPMI_REQUEST ){
-            struct ipmi_get_sess_chal_request *request = (struct ipmi_get_sess_chal_request *) payload;
-            printf("  [IPMI] Authentication Challege: %s(0x%02x)\n", get_ipmi_auth_type_str(request->auth_type & 0x0f), request->auth_type);
-            printf("  [IPMI] Username: %s\n", request->name);
-        }
-        else {
-            int i;
-            struct ipmi_get_sess_chal_response *response = (struct ipmi_get_sess_chal_response *) payload;
-            printf("  [IPMI] Completion Code: 0x%02x\n", response->cc);
-            printf("  [IPMI] Temporary Session ID: %d\n", response->sid);
-            printf("  [IPMI] Challege string data: ");
-            for (  i = 0 ; i < sizeof(response->chal_str); i++ ) {
-                printf(" 0x%02x", response->chal_str[i]);
-            }
-            printf("\n");
-        }
-    }
-    else if ( cmd ==  ACT_SESSION ) {
-        if ( direction == IPMI_REQUEST ){
-            int i;
-            struct ipmi_act_sess_request *request = (struct ipmi_act_sess_request *) payload;
-            printf("  [IPMI] Authentication Type: %s(0x%02x)\n", get_ipmi_auth_type_str(request->auth_type & 0x0f), request->auth_type);
-            printf("  [IPMI] Privilage: %s(0x%02x)\n", get_ipmi_priviege(request->priviege & 0x0f), request->priviege);
-            printf("  [IPMI] Challege string data: ");
-            for (  i = 0 ; i < sizeof(request->chal_str); i++ ) {
-                printf(" 0x%02x", request->chal_str[i]);
-            }
-            printf("\n");
-            printf("  [IPMI] Outbound Sequence Number: %d\n", request->ob_seq);
-        }
-        else {
-            struct ipmi_act_sess_response *response = (struct ipmi_act_sess_response *) payload;
-            printf("  [IPMI] Completion Code: 0x%02x\n", response->cc);
-            printf("  [IPMI] Authentication Type: %s(0x%02x)\n", get_ipmi_auth_type_str(response->auth_type & 0x0f), response->auth_type);
-            printf("  [IPMI] Reminder Session ID: %d\n", response->sid);
-            printf("  [IPMI] Inbound Sequence Number: %d\n", response->ib_seq);
-            printf("  [IPMI] Privilage: %s(0x%02x)\n", get_ipmi_priviege(response->priviege & 0x0f), response->priviege);
-        }
-    }
-    else if ( cmd == SET_SESS_PRIV ){
-        if ( direction == IPMI_REQUEST ){
-            struct ipmi_set_sess_priv_request *request = (struct ipmi_set_sess_priv_request *) payload;
-            printf("  [IPMI] Privilage: %s(0x%02x)\n", get_ipmi_priviege(request->priviege & 0x0f), request->priviege);
-        }
-        else {
-            struct ipmi_set_sess_priv_response *response = (struct ipmi_set_sess_priv_response *) payload;
-            printf("  [IPMI] Completion Code: 0x%02x\n", response->cc);
-            printf("  [IPMI] Privilage: %s(0x%02x)\n", get_ipmi_priviege(response->priviege & 0x0f), response->priviege);
-        }
-    }
-    else if ( cmd == CLOSE_SESSION ){
-        if ( direction == IPMI_REQUEST ){
-            struct ipmi_close_sess_request *request = (struct ipmi_close_sess_request*) payload;
-            printf("  [IPMI] Session ID: %d\n", request->sid);
-        }
-        else {
-            struct ipmi_close_sess_response *request = (struct ipmi_close_sess_response*) payload;
-            printf("  [IPMI] Completion Code: %d\n", request->cc);
+/* section 22.13 */
+void ipmi_get_auth_cap_request(const u_char *data, int data_len) {
+    struct ipmi_get_auth_cap_request *request = (struct ipmi_get_auth_cap_request *) data;
+    OUT_HEX8_LINE("  [IPMI] Channel Number: ", request->ch_num);
+    OUT_LABEL_LINE("  [IPMI] Privilege: ", &priviege_labels[request->priviege]);
+}
+
+void ipmi_get_auth_cap_response(const u_char *data, int data_len) {
+    struct ipmi_get_auth_cap_response *response = (struct ipmi_get_auth_cap_response *) data;
+    OUT_HEX8_LINE("  [IPMI] Completion Code: ", response->cc);
+    OUT_HEX8_LINE("  [IPMI] Channel Number: ", response->ch_num);
+    OUT_LIT("  [IPMI] Authentication Support: (");
+    out_hex8(response->auth_cap);
+    out_char(')');
+    print_ipmi_auth_cap(response->auth_cap);
+    OUT_LIT("\n");
+    /* TODO extract */
+    OUT_HEX8_LINE("  [IPMI] Authentication Method: ", response->auth_method);
+    /* TODO print oem */
+}
 
-        }
+/* section 22.16 */
+void ipmi_get_sess_chal_request(const u_char *data, int data_len) {
+    struct ipmi_get_sess_chal_request *request = (struct ipmi_get_sess_chal_request *) data;
+    OUT_LABEL_LINE("  [IPMI] Authentication Challege: ", &auth_type_labels[request->auth_type]);
+    OUT_LIT("  [IPMI] Username: ");
+    out_strn(request->name, strnlen(request->name, sizeof(request->name)));
+    out_char('\n');
+}
 
+void ipmi_get_sess_chal_response(const u_char *data, int data_len) {
+    int i;
+    struct ipmi_get_sess_chal_response *response = (struct ipmi_get_sess_chal_response *) data;
+    OUT_HEX8_LINE("  [IPMI] Completion Code: ", response->cc);
+    OUT_DEC_LINE("  [IPMI] Temporary Session ID: ", response->sid);
+    OUT_LIT("  [IPMI] Challege string data: ");
+    for (  i = 0 ; i < sizeof(response->chal_str); i++ ) {
+        out_char(' ');
+        out_hex8(response->chal_str[i]);
     }
-    else {
-        fprintf(stderr, "unrecognized cmd %d\n", cmd);
+    OUT_LIT("\n");
+}
+
+/* section 22.17 */
+void ipmi_act_sess_request(const u_char *data, int data_len) {
+    int i;
+    struct ipmi_act_sess_request *request = (struct ipmi_act_sess_request *) data;
+    OUT_LABEL_LINE("  [IPMI] Authentication Type: ", &auth_type_labels[request->auth_type]);
+    OUT_LABEL_LINE("  [IPMI] Privilage: ", &priviege_labels[request->priviege]);
+    OUT_LIT("  [IPMI] Challege string data: ");
+    for (  i = 0 ; i < sizeof(request->chal_str); i++ ) {
+        out_char(' ');
+        out_hex8(request->chal_str[i]);
     }
+    OUT_LIT("\n");
+    OUT_DEC_LINE("  [IPMI] Outbound Sequence Number: ", request->ob_seq);
+}
 
+void ipmi_act_sess_response(const u_char *data, int data_len) {
+    struct ipmi_act_sess_response *response = (struct ipmi_act_sess_response *) data;
+    OUT_HEX8_LINE("  [IPMI] Completion Code: ", response->cc);
+    OUT_LABEL_LINE("  [IPMI] Authentication Type: ", &auth_type_labels[response->auth_type]);
+    OUT_DEC_LINE("  [IPMI] Reminder Session ID: ", response->sid);
+    OUT_DEC_LINE("  [IPMI] Inbound Sequence Number: ", response->ib_seq);
+    OUT_LABEL_LINE("  [IPMI] Privilage: ", &priviege_labels[response->priviege]);
 }
 
+/* section 22.18 */
+void ipmi_set_sess_priv_request(const u_char *data, int data_len) {
+    struct ipmi_set_sess_priv_request *request = (struct ipmi_set_sess_priv_request *) data;
+    OUT_LABEL_LINE("  [IPMI] Privilage: ", &priviege_labels[request->priviege]);
+}
+
+void ipmi_set_sess_priv_response(const u_char *data, int data_len) {
+    struct ipmi_set_sess_priv_response *response = (struct ipmi_set_sess_priv_response *) data;
+    OUT_HEX8_LINE("  [IPMI] Completion Code: ", response->cc);
+    OUT_LABEL_LINE("  [IPMI] Privilage: ", &priviege_labels[response->priviege]);
+}
+
+/* section 22.19 */
+void ipmi_close_sess_request(const u_char *data, int data_len) {
+    struct ipmi_close_sess_request *request = (struct ipmi_close_sess_request*) data;
+    OUT_DEC_LINE("  [IPMI] Session ID: ", request->sid);
+}
+
+void ipmi_close_sess_response(const u_char *data, int data_len) {
+    struct ipmi_close_sess_response *response = (struct ipmi_close_sess_response*) data;
+    OUT_DEC_LINE("  [IPMI] Completion Code: ", response->cc);
+}
@@ -0,0 +1,165 @@
+/*
+ * response latency histograms, see latency.h
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/time.h>
+#include <arpa/inet.h>
+
+#include "dump.h"
+#include "ipmi_cmd.h"
+#include "latency.h"
+
+#define LAT_MASK        (LAT_SLOTS - 1)
+
+static int latency_on;
+
+/* both directions of a udp flow are decoded by the same thread, see bmc_shard of main.c and tpacket_open */
+static DUMP_TLS struct lat_hist *pool;
+static DUMP_TLS struct lat_hist **hists;       /* LAT_SLOTS, into pool */
+static DUMP_TLS u_int32_t hist_count;
+static DUMP_TLS u_int64_t hist_dropped;        /* samples without a histogram, the pool was used up */
+
+void latency_enable(void) {
+    latency_on = 1;
+}
+
+static inline u_int32_t lat_bucket(u_int32_t us) {
+    int shift;
+
+    if ( us < (1u << LAT_SUB_BITS) ){
+        return us;
+    }
+    shift = 31 - __builtin_clz(us) - (LAT_SUB_BITS - 1);
+    return shift * LAT_HALF + (us >> shift);
+}
+
+/* the highest value counted in bucket i */
+static u_int32_t lat_bucket_high(u_int32_t i) {
+    int shift;
+
+    if ( i < (1u << LAT_SUB_BITS) ){
+        return i;
+    }
+    shift = i / LAT_HALF - 1;
+    return (u_int32_t)((((u_int64_t)(i - shift * LAT_HALF) + 1) << shift) - 1);
+}
+
+static inline u_int32_t hist_slot(u_int64_t key) {
+    return (u_int32_t)(key * 0x9e3779b97f4a7c15ull >> 40) & LAT_MASK;
+}
+
+/* the histogram of key, NULL when it is new and the pool is used up */
+static struct lat_hist* hist_get(u_int64_t key) {
+    u_int32_t i;
+
+    if ( pool == NULL ){
+        pool = (struct lat_hist *)calloc(LAT_HISTS, sizeof(struct lat_hist));
+        hists = (struct lat_hist **)calloc(LAT_SLOTS, sizeof(struct lat_hist *));
+        if ( pool == NULL || hists == NULL ){
+            fprintf(stderr, "out of memory for latency histograms\n");
+            exit(1);
+        }
+    }
+
+    for ( i = hist_slot(key); hists[i] != NULL; i = (i + 1) & LAT_MASK ){
+        if ( hists[i]->key == key ){
+            return hists[i];
+        }
+    }
+    if ( hist_count >= LAT_HISTS ){
+        return NULL;
+    }
+
+    hists[i] = &pool[hist_count++];
+    hists[i]->key = key;
+    return hists[i];
+}
+
+/*
+ * count the time a BMC took to answer a request
+ *
+ * @bmc: DUMP_BMC_KEY of the BMC
+ * @netfn: netfn of the request
+ * @req: capture time of the request
+ * @rsp: capture time of the response
+ *
+ */
+void latency_record(u_int64_t bmc, u_char netfn, u_char cmd, const struct timeval *req, const struct timeval *rsp) {
+    struct lat_hist *h;
+    int64_t us;
+
+    if ( !latency_on ){
+        return;
+    }
+
+    us = (int64_t)(rsp->tv_sec - req->tv_sec) * 1000000 + (rsp->tv_usec - req->tv_usec);
+    /* a capture out of order, or a wait longer than the histogram */
+    if ( us < 0 ){
+        us = 0;
+    }
+    else if ( us > 0xffffffffLL ){
+        us = 0xffffffffLL;
+    }
+
+    h = hist_get(bmc << 16 | netfn << 8 | cmd);
+    if ( h == NULL ){
+        hist_dropped++;
+        return;
+    }
+    h->buckets[lat_bucket((u_int32_t)us)]++;
+    h->count++;
+    if ( (u_int32_t)us > h->max ){
+        h->max = (u_int32_t)us;
+    }
+}
+
+/* the value under which q of the samples are, as the highest value of its bucket */
+static u_int32_t hist_quantile(const struct lat_hist *h, double q) {
+    u_int64_t want = (u_int64_t)(q * h->count + 0.999999), seen = 0;
+    u_int32_t i, v;
+
+    if ( want == 0 ){
+        want = 1;
+    }
+    for ( i = 0; i < LAT_BUCKETS; i++ ){
+        seen += h->buckets[i];
+        if ( seen >= want ){
+            v = lat_bucket_high(i);
+            return v < h->max ? v : h->max;
+        }
+    }
+    return h->max;
+}
+
+/*
+ * print p50/p99/p999/max of every histogram of the calling thread, in one piece
+ */
+void latency_dump(FILE *f) {
+    const struct lat_hist *h;
+    struct in_addr addr;
+    u_int32_t i;
+
+    if ( !latency_on || pool == NULL ){
+        return;
+    }
+
+    flockfile(f);
+    fprintf(f, "Response latency(us): bmc, netfn, cmd, count, p50, p99, p999, max\n");
+    for ( i = 0; i < hist_count; i++ ){
+        h = &pool[i];
+        addr.s_addr = (u_int32_t)(h->key >> 32);
+        fprintf(f, "  %s:%u 0x%02x %s(0x%02x) %llu %u %u %u %u\n",
+                inet_ntoa(addr), (unsigned int)((h->key >> 16) & 0xffff),
+                (unsigned int)((h->key >> 8) & 0xff), ipmi_get_cmd_str((h->key >> 8) & 0xff, h->key & 0xff),
+                (unsigned int)(h->key & 0xff), (unsigned long long)h->count,
+                hist_quantile(h, 0.5), hist_quantile(h, 0.99), hist_quantile(h, 0.999), h->max);
+    }
+    if ( hist_dropped > 0 ){
+        fprintf(f, "  %llu samples were not counted, more than %d histograms\n",
+                (unsigned long long)hist_dropped, LAT_HISTS);
+    }
+    funlockfile(f);
+}
@@ -0,0 +1,42 @@
+#ifndef _IPMI_DUMP_LATENCY_H
+#define _IPMI_DUMP_LATENCY_H
+
+#include <stdio.h>
+#include <sys/types.h>
+#include <sys/time.h>
+
+#include "dump.h"
+
+/*
+ * response latency of the BMCs(-L), from the capture time of a request to the
+ * one of its response, per (BMC, netfn, cmd)
+ *
+ * every histogram is log bucketed the HDR way: values under 2^LAT_SUB_BITS
+ * microseconds have a bucket each, above every power of two is cut in
+ * 2^(LAT_SUB_BITS-1) buckets, so a bucket is at most 1/16 of its value wide.
+ * a record is a bucket index computed with one clz and an increment. the
+ * histograms of a decoding thread are a pool of LAT_HISTS allocated with the
+ * first record, found by key in an open addressing table at most half used,
+ * like the pending requests of ipmi_corr.c: nothing is allocated or rehashed
+ * on the packet path, the samples of a (BMC, netfn, cmd) seen once the pool is
+ * used up are only counted as dropped
+ */
+
+#define LAT_SUB_BITS        5
+#define LAT_HALF            (1 << (LAT_SUB_BITS - 1))
+#define LAT_BUCKETS         ((32 - LAT_SUB_BITS + 2) * LAT_HALF)   /* up to 2^32 us */
+#define LAT_HISTS           4096    /* histograms per decoding thread */
+#define LAT_SLOTS           (LAT_HISTS * 2)
+
+struct lat_hist {
+    u_int64_t       key;        /* DUMP_BMC_KEY << 16 | netfn << 8 | cmd */
+    u_int64_t       count;
+    u_int32_t       max;        /* us */
+    u_int32_t       buckets[LAT_BUCKETS];
+};
+
+void latency_enable(void);
+void latency_record(u_int64_t bmc, u_char netfn, u_char cmd, const struct timeval *req, const struct timeval *rsp);
+void latency_dump(FILE *f);
+
+#endif
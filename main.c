@@ -1,8 +1,15 @@
+#define _GNU_SOURCE
 #include <stdio.h>
-#include <ctype.h>
+#include <stdlib.h>
 #include <string.h>
+#include <limits.h>
+#include <errno.h>
+#include <time.h>
 
 #include <unistd.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sched.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
@@ -11,6 +18,18 @@
 
 #include "align.h"
 #include "dump.h"
+#include "output.h"
+#include "tpacket.h"
+#include "pcapfile.h"
+#include "hexdump.h"
+#include "sdr_store.h"
+#include "sdr_cache.h"
+#include "sdr_export.h"
+#include "ipmi_corr.h"
+#include "latency.h"
+#include "stats.h"
+#include "pktq.h"
+#include "probe.h"
 
 
 #define ETHER_ADDR_LEN      6
@@ -60,63 +79,105 @@ struct sniff_udp {
 #define     IP_HL(ip)       (((ip)->ip_vhl) & 0x0f)
 #define     IP_V(ip)       (((ip)->ip_vhl) >> 4)
 
+/* section 13.1.2 */
+#define     RMCP_PORT           623
+#define     RMCP_SECURE_PORT    664
+#define     RMCP_VERSION        0x06
+#define     RMCP_HEADER_LEN     4
+
+/*
+ * the kernel filter used when -e is empty, and-ed with -e otherwise(unless -F).
+ * udp[8] is the first payload byte, the rmcp version
+ */
+#define     DEFAULT_FILTER      "udp and (port 623 or port 664) and udp[8] = 0x06"
+
 
 extern void print_rmcp(const u_char *payload, int payload_len, enum dump_level dl);
 
 
 static int DL;
+DUMP_TLS struct dump_packet dump_pkt;
+DUMP_TLS struct dump_counters dump_cnt;
+static int hexdump_width = HEXDUMP_DEF_WIDTH;
+static int hexdump_on = 1;
+static int mem_report = 0;   /* -m */
+static enum dump_level dump_level = DL_IPMI;
+
+/* -l names, the layers below udp are never printed */
+static const char *dump_level_names[] = {
+    [DL_UDP] = "udp",
+    [DL_RMCP] = "rmcp",
+    [DL_ASF] = "asf",
+    [DL_IPMI_HEADER] = "header",
+    [DL_IPMI] = "ipmi",
+};
+
+
+/* kernel counters of the capture of a thread, read every second and at exit */
+struct capture_counters {
+    unsigned long long      recv;
+    unsigned long long      drop;       /* no room in the socket buffer or ring */
+    unsigned long long      ifdrop;     /* dropped by the interface, libpcap only */
+    struct pcap_stat        last;       /* libpcap counters are 32 bits and wrap, only their growth is added */
+    time_t                  read_at;
+};
 
 /*
- * print data in rows of 16 bytes: offset   hex   ascii
- *
- * 00000   47 45 54 20 2f 20 48 54  54 50 2f 31 2e 31 0d 0a   GET / HTTP/1.1..
+ * -j: every worker owns a ring of the same fanout group and its own decoder
+ * state. the kernel spreads packets by udp flow, so the SDR records and sensors
+ * of a BMC are known only to the workers of the flows that read them
  */
-void
-print_hex_ascii_line(const u_char *payload, int len, int offset)
-{
+#define MAX_WORKERS     64
+struct worker {
+    pthread_t               tid;
+    int                     cpu;    /* -1 means not pinned */
+    struct tpacket_ring     *ring;
+    int                     *pkts;  /* -r: batch index of packets decoded by this worker */
+    size_t                  *ends;  /* -r: end of the text of each of them */
+    int                     npkts;
+    const char              *text;
+    struct capture_counters cap;    /* of ring, or of live_handle for the first worker */
+};
+static struct worker workers[MAX_WORKERS];
+static DUMP_TLS struct worker *self;   /* the capturing worker of the thread, NULL for -r */
+static int nworkers = 1;
+static pcap_t *live_handle;
+static struct pcapfile *file_handle;
 
-    int i;
-    int gap;
-    const u_char *ch;
-
-    /* offset */
-    printf("%05d   ", offset);
-    
-    /* hex */
-    ch = payload;
-    for(i = 0; i < len; i++) {
-        printf("%02x ", *ch);
-        ch++;
-        /* print extra space after 8th byte for visual aid */
-        if (i == 7)
-            printf(" ");
-    }
-    /* print space to handle line less than 8 bytes */
-    if (len < 8)
-        printf(" ");
-    
-    /* fill hex gap with spaces if not full line */
-    if (len < 16) {
-        gap = 16 - len;
-        for (i = 0; i < gap; i++) {
-            printf("   ");
-        }
-    }
-    printf("   ");
-    
-    /* ascii (if printable) */
-    ch = payload;
-    for(i = 0; i < len; i++) {
-        if (isprint(*ch))
-            printf("%c", *ch);
-        else
-            printf(".");
-        ch++;
-    }
-
-    printf("\n");
-
-    return;
+/* -Q: live capture runs on a thread of its own and only fills the queue */
+static struct pktq *queue;
+static pthread_t capture_tid;
+
+/* SIGUSR1 only bumps report_gen, every decoding thread prints its reports when it sees it */
+static volatile sig_atomic_t report_gen;
+static DUMP_TLS sig_atomic_t report_seen;
+
+/*
+ * -r with -j: the file is cut into batches, every packet of a batch goes to
+ * the worker owning its BMC, then the text is written back in capture order
+ */
+#define FILE_BATCH      16384
+struct file_packet {
+    struct pcap_pkthdr      header;
+    const u_char            *data;
+    int                     worker;
+};
+static struct file_packet *batch;
+static int batch_len;       /* 0 tells workers to quit */
+static struct bpf_program *batch_filter;
+static pthread_barrier_t batch_start, batch_done;
+
+/* same as inet_ntoa, without its static buffer */
+static void out_ipv4(struct in_addr addr) {
+    const u_char *b = (const u_char *)&addr.s_addr;
+
+    out_udec(b[0]);
+    out_char('.');
+    out_udec(b[1]);
+    out_char('.');
+    out_udec(b[2]);
+    out_char('.');
+    out_udec(b[3]);
 }
 
 /*
@@ -124,42 +185,77 @@ print_hex_ascii_line(const u_char *payload, int len, int offset)
  */
 void print_payload(const u_char *payload, int len) {
 
-    int len_rem = len;
-    int line_width = 16;            /* number of bytes per line */
-    int line_len;
-    int offset = 0;                 /* zero-based offset counter */
-    const u_char *ch = payload;
-
     if (len <= 0)
         return;
 
-    /* data fits on one line */
-    if (len <= line_width) {
-        print_hex_ascii_line(ch, len, offset);
+    out_cur.len += hexdump_render(out_reserve(hexdump_size(len, hexdump_width)), payload, len, 0, hexdump_width);
+}
+
+/* add what libpcap counted since the last read, on the thread dispatching on live_handle */
+static void pcap_counters(struct capture_counters *c) {
+    struct pcap_stat ps;
+
+    if ( live_handle != NULL && pcap_stats(live_handle, &ps) == 0 ){
+        c->recv += (u_int)(ps.ps_recv - c->last.ps_recv);
+        c->drop += (u_int)(ps.ps_drop - c->last.ps_drop);
+        c->ifdrop += (u_int)(ps.ps_ifdrop - c->last.ps_ifdrop);
+        c->last = ps;
+    }
+}
+
+/* add what the kernel counted since the last read */
+static void capture_read(time_t now) {
+    struct capture_counters *c;
+    struct pktq_stats qs;
+
+    if ( self == NULL ){
         return;
     }
+    c = &self->cap;
+    if ( self->ring != NULL ){
+        tpacket_stats(self->ring, &c->recv, &c->drop);
+    }
+    else if ( queue != NULL ){
+        /* -Q: the capture thread owns live_handle and publishes its counters */
+        pktq_get_stats(queue, &qs);
+        c->recv = qs.cap_recv;
+        c->drop = qs.cap_drop;
+        c->ifdrop = qs.cap_ifdrop;
+    }
+    else {
+        pcap_counters(c);
+    }
+    c->read_at = now;
+    stats_capture(c->recv, c->drop, c->ifdrop);
+}
 
-    /* data spans multiple lines */
-    for ( ;; ) {
-        /* compute current line length */
-        line_len = line_width % len_rem;
-        /* print line */
-        print_hex_ascii_line(ch, line_len, offset);
-        /* compute total remaining */
-        len_rem = len_rem - line_len;
-        /* shift pointer to remaining bytes to print */
-        ch = ch + line_len;
-        /* add offset */
-        offset = offset + line_width;
-        /* check if we have line width chars or less */
-        if (len_rem <= line_width) {
-            /* print last line and get out */
-            print_hex_ascii_line(ch, len_rem, offset);
-            break;
-        }
+/*
+ * the packets the thread lost or could not decode, in one piece: the capture
+ * counters, the queue of -Q, then the decoder counters
+ */
+static void counters_report(FILE *f) {
+    capture_read(time(NULL));
+    flockfile(f);
+    if ( self != NULL ){
+        fprintf(f, "Capture: %llu packets received, %llu dropped by the kernel, %llu dropped by the interface\n",
+                self->cap.recv, self->cap.drop, self->cap.ifdrop);
     }
+    if ( queue != NULL ){
+        pktq_report(queue, f);
+    }
+    fprintf(f, "Decoder: %llu packets, %llu truncated, %llu not rmcp, %llu malformed, %llu unmatched responses, %llu SDR records with a gap, %llu stale\n",
+            dump_cnt.packets, dump_cnt.truncated, dump_cnt.rejects, dump_cnt.malformed, dump_cnt.unmatched, dump_cnt.sdr_gaps,
+            dump_cnt.sdr_stale);
+    funlockfile(f);
+}
 
-    return;
+static void report_poll(void) {
+    if ( report_seen != report_gen ){
+        report_seen = report_gen;
+        latency_dump(stderr);
+        probe_dump(stderr);
+        counters_report(stderr);
+    }
 }
 
 void got_packet(u_char *args, const struct pcap_pkthdr *header, const u_char *packet){
@@ -168,9 +264,17 @@ void got_packet(u_char *args, const struct pcap_pkthdr *header, const u_char *pa
     const struct sniff_ip       *ip;
     const struct sniff_udp      *udp;
     const u_char                *payload;
+    const u_char                *end = packet + header->caplen;
+    unsigned int link_len = DL == DLT_NULL ? SIZE_LOOPBACK : SIZE_ETHERNET;
 
     int size_ip, payload_len;
 
+    report_poll();
+    probe_packet_start();
+    PROBE_ENTER();
+    if ( header->caplen < link_len + 20 ){
+        return;
+    }
     if ( DL == DLT_NULL ) {
         /* loopback */
         loopback = (struct sniff_loopback *) packet;
@@ -180,6 +284,7 @@ void got_packet(u_char *args, const struct pcap_pkthdr *header, const u_char *pa
         ethernet = (struct sniff_ethernet *)(packet);
         ip = (struct sniff_ip *)(packet + SIZE_ETHERNET);
     }
+    PROBE_NEXT(PROBE_LINK);
 
     size_ip = IP_HL(ip)*4;
     if ( size_ip < 20 ){
@@ -194,43 +299,477 @@ void got_packet(u_char *args, const struct pcap_pkthdr *header, const u_char *pa
             //printf("    Protocol: %d\n", ip->ip_p);
             return;
     }
+    PROBE_NEXT(PROBE_IP);
 
 
     udp = (struct sniff_udp *)((u_char *)ip + size_ip);
     payload = (u_char *)udp + sizeof(struct sniff_udp);
+    if ( payload > end ){
+        dump_cnt.truncated++;
+        return;
+    }
     payload_len = ntohs(udp->uh_len) - sizeof(struct sniff_udp);
+    if ( payload_len > end - payload ){
+        /* cut by the snaplen, only what was captured is decoded */
+        dump_cnt.truncated++;
+        payload_len = end - payload;
+    }
+
+    /* whatever a broad -F filter lets through, only rmcp is decoded, and silently */
+    if ( payload_len < RMCP_HEADER_LEN || payload[0] != RMCP_VERSION ){
+        dump_cnt.rejects++;
+        return;
+    }
+    dump_cnt.packets++;
 
-    printf("[UDP] %s:%d -> %s:%d, PL:%d\n", inet_ntoa(ip->ip_src), ntohs(udp->uh_sport), inet_ntoa(ip->ip_dst), ntohs(udp->uh_dport), payload_len );
-    print_payload(payload, payload_len);
+    dump_pkt.ts = header->ts;
+    ipmi_corr_tick(header->ts.tv_sec);
+    dump_pkt.src_addr = ip->ip_src.s_addr;
+    dump_pkt.dst_addr = ip->ip_dst.s_addr;
+    dump_pkt.src_port = ntohs(udp->uh_sport);
+    dump_pkt.dst_port = ntohs(udp->uh_dport);
+
+    if ( dump_stats ){
+        /* the BMC side is the rmcp port one, or the destination when both or none are */
+        if ( dump_pkt.src_port == RMCP_PORT || dump_pkt.src_port == RMCP_SECURE_PORT ){
+            stats_packet(DUMP_BMC_KEY(dump_pkt.src_addr, dump_pkt.src_port),
+                    DUMP_BMC_KEY(dump_pkt.dst_addr, dump_pkt.dst_port), payload_len);
+        }
+        else {
+            stats_packet(DUMP_BMC_KEY(dump_pkt.dst_addr, dump_pkt.dst_port),
+                    DUMP_BMC_KEY(dump_pkt.src_addr, dump_pkt.src_port), payload_len);
+        }
+        PROBE_LEAVE(PROBE_UDP);
+        if ( dump_level >= DL_RMCP ){
+            PROBE_ENTER();
+            print_rmcp(payload, payload_len, dump_level);
+            PROBE_LEAVE(PROBE_RMCP);
+        }
+        PROBE_ENTER();
+        stats_tick(header->ts.tv_sec);
+        PROBE_LEAVE(PROBE_OUTPUT);
+        probe_packet_end();
+        return;
+    }
+
+    OUT_LIT("[UDP] ");
+    out_ipv4(ip->ip_src);
+    out_char(':');
+    out_udec(ntohs(udp->uh_sport));
+    OUT_LIT(" -> ");
+    out_ipv4(ip->ip_dst);
+    out_char(':');
+    out_udec(ntohs(udp->uh_dport));
+    OUT_LIT(", PL:");
+    out_dec(payload_len);
+    out_char('\n');
+    PROBE_LEAVE(PROBE_UDP);
+    if ( hexdump_on ){
+        PROBE_ENTER();
+        print_payload(payload, payload_len);
+        PROBE_LEAVE(PROBE_PAYLOAD);
+    }
 
-    print_rmcp(payload, payload_len, 0);
-    
+    if ( dump_level >= DL_RMCP ){
+        PROBE_ENTER();
+        print_rmcp(payload, payload_len, dump_level);
+        PROBE_LEAVE(PROBE_RMCP);
+    }
+
+    PROBE_ENTER();
+    out_packet_end();
+    PROBE_LEAVE(PROBE_OUTPUT);
+    probe_packet_end();
+}
+
+/* the reports of a decoding thread, once all its packets are decoded */
+static void decode_done(void) {
+    ipmi_corr_flush(stderr);
+    sdr_export_flush();
+    latency_dump(stderr);
+    probe_dump(stderr);
+    counters_report(stderr);
+    stats_report();
+    if ( mem_report ){
+        sdr_store_report(stderr);
+    }
+}
+
+/* a worker without packets still answers SIGUSR1, reports its counters and reads the kernel ones */
+static void worker_idle(void) {
+    time_t now = time(NULL);
+
+    out_tick();
+    report_poll();
+    if ( self != NULL && now != self->cap.read_at ){
+        capture_read(now);
+    }
+    ipmi_corr_tick(now);
+    stats_tick(now);
+    sdr_export_tick(now);
+}
+
+static void* capture_loop(void *arg) {
+    struct tpacket_ring *ring = (struct tpacket_ring *)arg;
+
+    if ( ring != NULL ){
+        tpacket_loop(ring, pktq_push, (u_char *)queue, NULL);
+    }
+    else {
+        struct capture_counters cap;
+        time_t read_at = 0, now;
+
+        memset(&cap, 0, sizeof(cap));
+        /* the handle times out every second, the counters are read between two dispatches */
+        while ( pcap_dispatch(live_handle, -1, pktq_push, (u_char *)queue) >= 0 ){
+            now = time(NULL);
+            if ( now != read_at ){
+                pcap_counters(&cap);
+                pktq_set_capture(queue, cap.recv, cap.drop, cap.ifdrop);
+                read_at = now;
+            }
+        }
+        pcap_counters(&cap);
+        pktq_set_capture(queue, cap.recv, cap.drop, cap.ifdrop);
+    }
+    pktq_close_input(queue);
+
+    return NULL;
+}
+
+/*
+ * -Q: capture from ring(or live_handle when NULL) on a new thread, decode the
+ * queue on the calling one until the capture stops
+ */
+static int decode_queue(struct tpacket_ring *ring) {
+    if ( pthread_create(&capture_tid, NULL, capture_loop, ring) != 0 ){
+        fprintf(stderr, "Couldn't start the capture thread\n");
+        return -1;
+    }
+    pktq_loop(queue, got_packet, NULL, worker_idle);
+    pthread_join(capture_tid, NULL);
+    return 0;
+}
+
+static void* worker_loop(void *arg) {
+    struct worker *w = (struct worker *)arg;
+    cpu_set_t cpus;
+
+    self = w;
+    if ( w->cpu >= 0 ){
+        CPU_ZERO(&cpus);
+        CPU_SET(w->cpu, &cpus);
+        if ( pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) != 0 ){
+            fprintf(stderr, "Couldn't pin worker to cpu %d\n", w->cpu);
+        }
+    }
+
+    if ( queue != NULL ){
+        decode_queue(w->ring);
+    }
+    else {
+        tpacket_loop(w->ring, got_packet, NULL, worker_idle);
+    }
+    out_flush();
+    decode_done();
+
+    return NULL;
+}
+
+/*
+ * pick the n-th cpu this process may run on, so -P also works under taskset
+ */
+static int nth_cpu(int n) {
+    cpu_set_t cpus;
+    int cpu, count;
+
+    if ( sched_getaffinity(0, sizeof(cpus), &cpus) == -1 ){
+        return -1;
+    }
+
+    count = CPU_COUNT(&cpus);
+    if ( count == 0 ){
+        return -1;
+    }
+    n %= count;
+    for ( cpu = 0; cpu < CPU_SETSIZE; cpu++ ){
+        if ( CPU_ISSET(cpu, &cpus) && n-- == 0 ){
+            return cpu;
+        }
+    }
+    return -1;
+}
+
+/*
+ * shard a packet by its BMC endpoint(the rmcp port side), so that every
+ * conversation with a BMC, from any client, is decoded by the same worker
+ */
+static unsigned int bmc_shard(const u_char *packet, bpf_u_int32 caplen) {
+    const struct sniff_ip       *ip;
+    const struct sniff_udp      *udp;
+    unsigned int link_len = DL == DLT_NULL ? SIZE_LOOPBACK : SIZE_ETHERNET;
+    unsigned int addr, port, size_ip;
+    u_short sport, dport;
+
+    if ( caplen < link_len + 20 ){
+        return 0;
+    }
+    ip = (struct sniff_ip *)(packet + link_len);
+    size_ip = IP_HL(ip)*4;
+    if ( ip->ip_p != IPPROTO_UDP || size_ip < 20 || caplen < link_len + size_ip + sizeof(struct sniff_udp) ){
+        return 0;
+    }
+    udp = (struct sniff_udp *)((u_char *)ip + size_ip);
+    sport = ntohs(udp->uh_sport);
+    dport = ntohs(udp->uh_dport);
+
+    if ( sport == RMCP_PORT || sport == RMCP_SECURE_PORT ){
+        addr = ip->ip_src.s_addr;
+        port = sport;
+    }
+    else if ( dport == RMCP_PORT || dport == RMCP_SECURE_PORT ){
+        addr = ip->ip_dst.s_addr;
+        port = dport;
+    }
+    else {
+        /* not on a well known port, mix both endpoints so both directions agree */
+        addr = ip->ip_src.s_addr ^ ip->ip_dst.s_addr;
+        port = sport ^ dport;
+    }
+
+    return ((addr * 0x9e3779b1u) ^ port) * 0x85ebca6bu >> 16;
+}
+
+static void* file_worker_loop(void *arg) {
+    struct worker *w = (struct worker *)arg;
+    struct file_packet *p;
+    cpu_set_t cpus;
+    int k;
+
+    if ( w->cpu >= 0 ){
+        CPU_ZERO(&cpus);
+        CPU_SET(w->cpu, &cpus);
+        if ( pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) != 0 ){
+            fprintf(stderr, "Couldn't pin worker to cpu %d\n", w->cpu);
+        }
+    }
+
+    out_hold(1);
+    for ( ;; ){
+        pthread_barrier_wait(&batch_start);
+        if ( batch_len == 0 ){
+            break;
+        }
+
+        out_discard();
+        for ( k = 0; k < w->npkts; k++ ){
+            p = &batch[w->pkts[k]];
+            if ( batch_filter == NULL || pcap_offline_filter(batch_filter, &p->header, p->data) != 0 ){
+                got_packet(NULL, &p->header, p->data);
+            }
+            w->ends[k] = out_length();
+        }
+        w->text = out_data();
+
+        pthread_barrier_wait(&batch_done);
+    }
+    decode_done();
+
+    return NULL;
+}
+
+/*
+ * write the text of a decoded batch in capture order, slices of consecutive
+ * packets of the same worker are contiguous and written as one iovec
+ */
+static void merge_batch(void) {
+    struct iovec iov[IOV_MAX];
+    size_t start[MAX_WORKERS];
+    int cur[MAX_WORKERS];
+    int i, w, n = 0, last = -1;
+    size_t end;
+
+    memset(start, 0, sizeof(start));
+    memset(cur, 0, sizeof(cur));
+
+    for ( i = 0; i < batch_len; i++ ){
+        w = batch[i].worker;
+        end = workers[w].ends[cur[w]++];
+        if ( end == start[w] ){
+            continue;
+        }
+
+        if ( w != last || n == 0 ){
+            if ( n == IOV_MAX ){
+                out_writev(iov, n);
+                n = 0;
+            }
+            iov[n].iov_base = (char *)workers[w].text + start[w];
+            iov[n].iov_len = 0;
+            n++;
+            last = w;
+        }
+        iov[n - 1].iov_len += end - start[w];
+        start[w] = end;
+    }
+
+    if ( n > 0 ){
+        out_writev(iov, n);
+    }
+}
+
+static int decode_file_parallel(struct pcapfile *pf, struct bpf_program *fp, int pin) {
+    struct file_packet *p;
+    int i, ret = 1;
+
+    batch = (struct file_packet *)calloc(FILE_BATCH, sizeof(struct file_packet));
+    if ( batch == NULL ){
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+    for ( i = 0; i < nworkers; i++ ){
+        workers[i].cpu = pin ? nth_cpu(i) : -1;
+        workers[i].pkts = (int *)calloc(FILE_BATCH, sizeof(int));
+        workers[i].ends = (size_t *)calloc(FILE_BATCH, sizeof(size_t));
+        if ( workers[i].pkts == NULL || workers[i].ends == NULL ){
+            fprintf(stderr, "out of memory\n");
+            exit(1);
+        }
+    }
+    batch_filter = fp;
+
+    pthread_barrier_init(&batch_start, NULL, nworkers + 1);
+    pthread_barrier_init(&batch_done, NULL, nworkers + 1);
+    for ( i = 0; i < nworkers; i++ ){
+        if ( pthread_create(&workers[i].tid, NULL, file_worker_loop, &workers[i]) != 0 ){
+            fprintf(stderr, "Couldn't start worker %d\n", i);
+            exit(2);
+        }
+    }
+
+    while ( ret == 1 ){
+        for ( i = 0; i < nworkers; i++ ){
+            workers[i].npkts = 0;
+        }
+
+        batch_len = 0;
+        while ( batch_len < FILE_BATCH && !pcapfile_stopped(pf) ){
+            p = &batch[batch_len];
+            ret = pcapfile_next(pf, &p->header, &p->data);
+            if ( ret != 1 ){
+                break;
+            }
+            p->worker = bmc_shard(p->data, p->header.caplen) % nworkers;
+            workers[p->worker].pkts[workers[p->worker].npkts++] = batch_len;
+            batch_len++;
+        }
+        if ( batch_len == 0 ){
+            break;
+        }
+
+        pthread_barrier_wait(&batch_start);
+        pthread_barrier_wait(&batch_done);
+        merge_batch();
+    }
+
+    /* batch_len is 0 here, release workers */
+    batch_len = 0;
+    pthread_barrier_wait(&batch_start);
+    for ( i = 0; i < nworkers; i++ ){
+        pthread_join(workers[i].tid, NULL);
+        free(workers[i].pkts);
+        free(workers[i].ends);
+    }
+    pthread_barrier_destroy(&batch_start);
+    pthread_barrier_destroy(&batch_done);
+    free(batch);
+
+    return ret == -1 ? -1 : 0;
+}
+
+static void stop_capture(int sig) {
+    int i;
+
+    for ( i = 0; i < nworkers; i++ ){
+        if ( workers[i].ring != NULL ){
+            tpacket_breakloop(workers[i].ring);
+        }
+    }
+    if ( live_handle != NULL ){
+        pcap_breakloop(live_handle);
+    }
+    if ( file_handle != NULL ){
+        pcapfile_breakloop(file_handle);
+    }
+}
+
+static void request_reports(int sig) {
+    report_gen++;
 }
 
 void usage(){
     fprintf(stderr, "IPMI dump, Usage:\n");
-    fprintf(stderr, "  ipmidump [-i interface] -e filter\n");
+    fprintf(stderr, "  ipmidump [-i interface] [-s snaplen] [-T [-B ring_mb] [-t block_ms]] [-j workers [-P] | -Q slots] [-l level] [-X | -W width] [-m] [-L] [-A secs [-o file]] [-C cache] [-D dir] [-F] [-e filter]\n");
+    fprintf(stderr, "  ipmidump -r file [-j workers [-P]] [-l level] [-X | -W width] [-m] [-L] [-A secs [-o file]] [-C cache] [-D dir] [-F] [-e filter]\n");
     fprintf(stderr, "  -i interface: specify a interface to dump, if empty default interface will be used\n");
-    fprintf(stderr, "  -e filter: filter express like tcpdump\n");
+    fprintf(stderr, "  -r file: decode a pcap or pcapng file instead of sniffing\n");
+    fprintf(stderr, "  -e filter: filter express like tcpdump, and-ed with the built-in rmcp filter(%s)\n", DEFAULT_FILTER);
+    fprintf(stderr, "  -F: use the -e filter alone, without the built-in one\n");
+    fprintf(stderr, "  -s snaplen: bytes to capture of each packet, default %d\n", BUFSIZ);
+    fprintf(stderr, "  -T: capture with a TPACKET_V3 mmap ring instead of libpcap\n");
+    fprintf(stderr, "  -B ring_mb: size of the TPACKET_V3 ring in MB, default %d\n", TPACKET_DEF_RING_SIZE >> 20);
+    fprintf(stderr, "  -t block_ms: timeout before a partly filled ring block is delivered, default %d\n", TPACKET_DEF_BLOCK_TIMEOUT);
+    fprintf(stderr, "  -j workers: decode on N threads, packets are sharded by UDP flow with PACKET_FANOUT_HASH(implies -T),\n");
+    fprintf(stderr, "              with -r the file is decoded in batches by BMC and the output keeps capture order\n");
+    fprintf(stderr, "  -P: pin every worker to its own cpu\n");
+    fprintf(stderr, "  -Q slots: capture on a thread of its own, queuing up to slots packets for the decoding thread\n");
+    fprintf(stderr, "  -l level: deepest layer to decode, udp, rmcp, asf, header(ipmi session and message header) or ipmi, default ipmi\n");
+    fprintf(stderr, "  -X: do not dump the payload in hex\n");
+    fprintf(stderr, "  -W width: bytes per row of the hex dump, a multiple of 8 up to %d, default %d\n", HEXDUMP_MAX_WIDTH, HEXDUMP_DEF_WIDTH);
+    fprintf(stderr, "  -m: report the memory of the SDR records of every BMC to stderr on exit\n");
+    fprintf(stderr, "  -L: measure the response latency per BMC and command, reported to stderr on exit and on SIGUSR1\n");
+    fprintf(stderr, "  -A secs: print no packet, only counters per BMC, client, rmcp class, auth type, command and completion code,\n");
+    fprintf(stderr, "           reported every secs seconds and on exit\n");
+    fprintf(stderr, "  -o file: append the -A reports to file instead of stdout\n");
+    fprintf(stderr, "  -C cache: keep the complete SDR records in the cache file, and convert the readings of a BMC\n");
+    fprintf(stderr, "            from its records of a former run until it walks its SDR again\n");
+    fprintf(stderr, "  -D dir: write the SDR records of every BMC to dir/address.sdr, in the format of ipmitool sdr dump\n");
 }
 
 int main(int argc, char *argv[]) {
 
     char filter[1024];
+    char bpf[sizeof(filter) + sizeof(DEFAULT_FILTER) + 16];
+    int raw_filter = 0;
     char dev[128], errbuf[PCAP_ERRBUF_SIZE];
     char *lookupdev;
+    char *rfile = NULL;
+    char *stats_file = NULL;
+    char *cache_file = NULL;
+    char *export_dir = NULL;
+    int stats_interval = 0;
+    struct pcapfile *pf = NULL;
     pcap_t *handle;
     struct bpf_program fp;
     bpf_u_int32 mask;
     bpf_u_int32 net;
-    struct pcap_pkthdr header;
-    const u_char *packet;
+    struct tpacket_opts topts;
+    int use_tpacket = 0;
+    int snaplen = BUFSIZ;
+    int queue_slots = 0;
+    int pin = 0;
+    int i;
 
     int ch, invalid=0;
     memset(dev,0, sizeof(dev));
     memset(filter,0, sizeof(filter));
 
-    while( (ch = getopt(argc, argv, "e:i:") ) != -1) {
+    topts.ring_size = TPACKET_DEF_RING_SIZE;
+    topts.block_size = TPACKET_DEF_BLOCK_SIZE;
+    topts.block_timeout = TPACKET_DEF_BLOCK_TIMEOUT;
+    topts.fanout = TPACKET_NO_FANOUT;
+
+    while( (ch = getopt(argc, argv, "e:Fi:r:s:TB:t:j:PQ:l:XW:mLA:o:C:D:") ) != -1) {
         switch( ch ){
             case 'i':
                 if ( optarg != NULL ){
@@ -242,6 +781,94 @@ int main(int argc, char *argv[]) {
                     strcpy(filter, optarg);
                 }
                 break;
+            case 'F':
+                raw_filter = 1;
+                break;
+            case 'r':
+                rfile = optarg;
+                break;
+            case 's':
+                snaplen = atoi(optarg);
+                if ( snaplen <= 0 ){
+                    invalid = 1;
+                }
+                break;
+            case 'T':
+                use_tpacket = 1;
+                break;
+            case 'B':
+                i = atoi(optarg);
+                /* the ring holds a block at least, and its bytes fit the unsigned int of the kernel */
+                if ( i <= 0 || (unsigned int)i > (UINT_MAX >> 20) || ((unsigned int)i << 20) < topts.block_size ){
+                    invalid = 1;
+                }
+                else {
+                    topts.ring_size = (unsigned int)i << 20;
+                }
+                break;
+            case 't':
+                i = atoi(optarg);
+                if ( i <= 0 ){
+                    invalid = 1;
+                }
+                topts.block_timeout = (unsigned int)i;
+                break;
+            case 'j':
+                nworkers = atoi(optarg);
+                if ( nworkers <= 0 || nworkers > MAX_WORKERS ){
+                    invalid = 1;
+                }
+                break;
+            case 'P':
+                pin = 1;
+                break;
+            case 'Q':
+                queue_slots = atoi(optarg);
+                if ( queue_slots <= 0 ){
+                    invalid = 1;
+                }
+                break;
+            case 'l':
+                for ( i = DL_UDP; i <= DL_IPMI; i++ ){
+                    if ( strcmp(optarg, dump_level_names[i]) == 0 ){
+                        break;
+                    }
+                }
+                if ( i > DL_IPMI ){
+                    invalid = 1;
+                }
+                dump_level = i;
+                break;
+            case 'X':
+                hexdump_on = 0;
+                break;
+            case 'm':
+                mem_report = 1;
+                break;
+            case 'L':
+                latency_enable();
+                break;
+            case 'A':
+                stats_interval = atoi(optarg);
+                if ( stats_interval <= 0 ){
+                    invalid = 1;
+                }
+                break;
+            case 'o':
+                stats_file = optarg;
+                break;
+            case 'C':
+                cache_file = optarg;
+                break;
+            case 'D':
+                export_dir = optarg;
+                break;
+            case 'W':
+                hexdump_width = atoi(optarg);
+                if ( hexdump_width <= 0 || hexdump_width > HEXDUMP_MAX_WIDTH || hexdump_width % 8 != 0 ){
+                    invalid = 1;
+                }
+                break;
             case '?':
                 invalid=1;
         }
@@ -253,31 +880,107 @@ int main(int argc, char *argv[]) {
         return (2);
     }
 
-    if( strcmp(dev, "") == 0 ){
-        /* no dev specify using default */
-        lookupdev  = pcap_lookupdev(errbuf);
+#ifdef __TINYC__
+    if ( nworkers > 1 ){
+        fprintf(stderr, "-j is not supported when built with tcc(no thread local storage)\n");
+        return (2);
+    }
+#endif
+    if ( rfile != NULL && use_tpacket ){
+        fprintf(stderr, "-T only applies to live capture\n");
+        usage();
+        return (2);
+    }
+    if ( queue_slots > 0 && (rfile != NULL || nworkers > 1) ){
+        fprintf(stderr, "-Q only applies to live capture with a single worker\n");
+        usage();
+        return (2);
+    }
+    if ( stats_file != NULL && stats_interval == 0 ){
+        fprintf(stderr, "-o only applies to -A\n");
+        usage();
+        return (2);
+    }
+    if ( stats_interval > 0 && stats_open(stats_interval, stats_file) == -1 ){
+        fprintf(stderr, "Couldn't open %s: %s\n", stats_file, strerror(errno));
+        return (2);
+    }
+    if ( cache_file != NULL && sdr_cache_open(cache_file) == -1 ){
+        if ( errno == EWOULDBLOCK ){
+            fprintf(stderr, "Couldn't open SDR cache %s: in use by another ipmidump\n", cache_file);
+        }
+        else if ( errno == EINVAL ){
+            fprintf(stderr, "Couldn't open SDR cache %s: not an SDR cache of this version\n", cache_file);
+        }
+        else {
+            fprintf(stderr, "Couldn't open SDR cache %s: %s\n", cache_file, strerror(errno));
+        }
+        return (2);
+    }
+    if ( export_dir != NULL && sdr_export_open(export_dir) == -1 ){
+        fprintf(stderr, "Couldn't write SDR dumps to %s: %s\n", export_dir, strerror(errno));
+        return (2);
+    }
+    if ( nworkers > 1 && rfile == NULL ){
+        /* only AF_PACKET can fan out to several sockets */
+        use_tpacket = 1;
+    }
 
-        if ( lookupdev == NULL ){
-            fprintf(stderr, "Couldn't find default device: %s\n", errbuf);
+    out_init(1);
+
+    if ( queue_slots > 0 ){
+        queue = pktq_open(queue_slots, snaplen);
+        if ( queue == NULL ){
+            fprintf(stderr, "Couldn't allocate a queue of %d packets of %d bytes\n", queue_slots, snaplen);
             return (2);
         }
-
-        strcpy(dev, lookupdev);
     }
 
+    if ( rfile != NULL ){
+        pf = pcapfile_open(rfile, errbuf);
+        if ( pf == NULL ){
+            fprintf(stderr, "Couldn't open file %s\n", errbuf);
+            return (2);
+        }
 
-    printf("Sniffing device: %s\n", dev);
-
-    if (pcap_lookupnet(dev, &net, &mask, errbuf) == -1) {
-        fprintf(stderr, "Can't get netmask for device %s\n", dev);
+        /* the dead handle is only used to compile filter for pcap_offline_filter */
+        handle = pcap_open_dead(pcapfile_linktype(pf), 65535);
         net = 0;
-        mask = 0;
     }
+    else {
+        if( strcmp(dev, "") == 0 ){
+            /* no dev specify using default */
+            lookupdev  = pcap_lookupdev(errbuf);
 
-    handle = pcap_open_live(dev, BUFSIZ, 1, 1000, errbuf);
-    if ( handle == NULL ){
-        fprintf(stderr, "Couldn't open device %s:%s\n",dev, errbuf);
-        return (2);
+            if ( lookupdev == NULL ){
+                fprintf(stderr, "Couldn't find default device: %s\n", errbuf);
+                return (2);
+            }
+
+            strcpy(dev, lookupdev);
+        }
+
+
+        out_printf("Sniffing device: %s\n", dev);
+        out_flush();
+
+        if (pcap_lookupnet(dev, &net, &mask, errbuf) == -1) {
+            fprintf(stderr, "Can't get netmask for device %s\n", dev);
+            net = 0;
+            mask = 0;
+        }
+
+        if ( use_tpacket ){
+            /* the ring always delivers ethernet framing, the dead handle is only used to compile filter */
+            handle = pcap_open_dead(DLT_EN10MB, snaplen);
+        }
+        else {
+            handle = pcap_open_live(dev, snaplen, 1, 1000, errbuf);
+        }
+        if ( handle == NULL ){
+            fprintf(stderr, "Couldn't open device %s:%s\n",dev, errbuf);
+            return (2);
+        }
     }
 
     DL = pcap_datalink(handle);
@@ -287,17 +990,110 @@ int main(int argc, char *argv[]) {
         return(2);
     }
 
-    if ( pcap_compile(handle, &fp, filter, 0, net) == -1 ){
-        fprintf(stderr, "Couldn't parse filter %s: %s\n",filter, pcap_geterr(handle));
+    if ( raw_filter ){
+        strcpy(bpf, filter);
+    }
+    else if ( filter[0] ){
+        snprintf(bpf, sizeof(bpf), "(" DEFAULT_FILTER ") and (%s)", filter);
+    }
+    else {
+        strcpy(bpf, DEFAULT_FILTER);
+    }
+    if ( pcap_compile(handle, &fp, bpf, 0, net) == -1 ){
+        fprintf(stderr, "Couldn't parse filter %s: %s\n", bpf, pcap_geterr(handle));
         return (2);
     }
 
-    if ( pcap_setfilter(handle, &fp) == -1 ){
-        fprintf(stderr, "Couldn't install filter %s: %s\n",filter,  pcap_geterr(handle));
-        return (2);
+    signal(SIGINT, stop_capture);
+    signal(SIGTERM, stop_capture);
+    signal(SIGUSR1, request_reports);
+
+    if ( pf != NULL ){
+        file_handle = pf;
+        /* an empty filter accepts everything, skip running it per packet */
+        if ( nworkers > 1 ){
+            i = decode_file_parallel(pf, bpf[0] ? &fp : NULL, pin);
+        }
+        else {
+            i = pcapfile_loop(pf, bpf[0] ? &fp : NULL, got_packet, NULL);
+            out_flush();
+            decode_done();
+        }
+        if ( i == -1 ){
+            fprintf(stderr, "Couldn't read file %s: %s\n", rfile, pcapfile_geterr(pf));
+        }
+        out_flush();
+        file_handle = NULL;
+        pcapfile_close(pf);
+    }
+    else if ( use_tpacket ){
+        topts.snaplen = snaplen;
+        if ( nworkers > 1 ){
+            /* the whole ring memory is split between workers */
+            topts.ring_size = topts.ring_size / nworkers;
+            if ( topts.ring_size < topts.block_size ){
+                topts.ring_size = topts.block_size;
+            }
+            topts.fanout = TPACKET_FANOUT_NEW;
+        }
+
+        for ( i = 0; i < nworkers; i++ ){
+            workers[i].cpu = pin ? nth_cpu(i) : -1;
+            workers[i].ring = tpacket_open(dev, &topts, &fp, errbuf);
+            if ( workers[i].ring == NULL ){
+                fprintf(stderr, "Couldn't open ring on device %s:%s\n",dev, errbuf);
+                return (2);
+            }
+            /* the first ring made the group, the others join it */
+            if ( topts.fanout == TPACKET_FANOUT_NEW ){
+                topts.fanout = tpacket_fanout_id(workers[i].ring);
+                if ( topts.fanout == -1 ){
+                    fprintf(stderr, "Couldn't get the fanout group of device %s: %s\n", dev, strerror(errno));
+                    return (2);
+                }
+            }
+        }
+
+        for ( i = 1; i < nworkers; i++ ){
+            if ( pthread_create(&workers[i].tid, NULL, worker_loop, &workers[i]) != 0 ){
+                fprintf(stderr, "Couldn't start worker %d\n", i);
+                return (2);
+            }
+        }
+        worker_loop(&workers[0]);
+        for ( i = 1; i < nworkers; i++ ){
+            pthread_join(workers[i].tid, NULL);
+        }
+
+        for ( i = 0; i < nworkers; i++ ){
+            tpacket_close(workers[i].ring);
+        }
+    }
+    else {
+        if ( pcap_setfilter(handle, &fp) == -1 ){
+            fprintf(stderr, "Couldn't install filter %s: %s\n", bpf, pcap_geterr(handle));
+            return (2);
+        }
+
+        live_handle = handle;
+        self = &workers[0];
+        if ( queue != NULL ){
+            if ( decode_queue(NULL) == -1 ){
+                return (2);
+            }
+        }
+        else {
+            /* pcap_dispatch also returns on the read timeout, so a quiet link still gets its output */
+            while ( pcap_dispatch(handle, -1, got_packet, NULL) >= 0 ){
+                worker_idle();
+            }
+        }
+        out_flush();
+        decode_done();
     }
 
-    pcap_loop(handle, -1, got_packet, NULL);
+    pktq_free(queue);
+    sdr_cache_close();
 
     pcap_freecode(&fp);
     pcap_close(handle);
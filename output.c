@@ -0,0 +1,255 @@
+/*
+ * buffered output shared by all decoders
+ *
+ * text is appended into a large per thread buffer by hand rolled emitters
+ * (no printf on the hot path) and written with write(2)/writev(2)
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "dump.h"
+#include "output.h"
+
+#define OUT_BUF_SIZE        (1 << 20)
+#define OUT_FLUSH_SIZE      (OUT_BUF_SIZE - (OUT_BUF_SIZE >> 2))
+#define OUT_FLUSH_MS        200
+
+static int out_fd = 1;
+static int out_tty;
+static pthread_mutex_t out_lock = PTHREAD_MUTEX_INITIALIZER;
+DUMP_TLS struct out_buf out_cur;
+char out_hex_pairs[256][2];
+
+__attribute__((constructor)) static void out_hex_pairs_init(void) {
+    static const char digits[] = "0123456789abcdef";
+    int i;
+
+    for ( i = 0; i < 256; i++ ){
+        out_hex_pairs[i][0] = digits[i >> 4];
+        out_hex_pairs[i][1] = digits[i & 0x0f];
+    }
+}
+
+static long out_now_ms(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/*
+ * set the descriptor all workers write to, must be called before any worker starts
+ */
+void out_init(int fd) {
+    out_fd = fd;
+    out_tty = isatty(fd);
+}
+
+/*
+ * slow path of out_reserve
+ */
+void out_grow(size_t n) {
+    size_t cap;
+    char *buf;
+
+    /* a packet is never split between two writes, grow instead of flushing */
+    cap = out_cur.cap ? out_cur.cap : OUT_BUF_SIZE;
+    while ( cap < out_cur.len + n ){
+        cap <<= 1;
+    }
+    buf = (char *)realloc(out_cur.buf, cap);
+    if ( buf == NULL ){
+        fprintf(stderr, "out of memory for output buffer\n");
+        exit(1);
+    }
+    out_cur.buf = buf;
+    out_cur.cap = cap;
+}
+
+/*
+ * for the rare lines that need a real format, e.g. %.2f
+ */
+void out_printf(const char *fmt, ...) {
+    va_list ap;
+    int n;
+
+    out_reserve(256);
+
+    va_start(ap, fmt);
+    n = vsnprintf(out_cur.buf + out_cur.len, out_cur.cap - out_cur.len, fmt, ap);
+    va_end(ap);
+    if ( n < 0 ){
+        return;
+    }
+
+    if ( (size_t)n >= out_cur.cap - out_cur.len ){
+        out_reserve(n + 1);
+        va_start(ap, fmt);
+        vsnprintf(out_cur.buf + out_cur.len, out_cur.cap - out_cur.len, fmt, ap);
+        va_end(ap);
+    }
+    out_cur.len += n;
+}
+
+/* same as printf("%lu") */
+void out_udec(unsigned long val) {
+    char tmp[20];
+    int i = sizeof(tmp);
+
+    do {
+        tmp[--i] = '0' + val % 10;
+        val /= 10;
+    } while ( val );
+
+    out_strn(tmp + i, sizeof(tmp) - i);
+}
+
+/* same as printf("%ld") */
+void out_dec(long val) {
+    if ( val < 0 ){
+        out_char('-');
+        out_udec(-(unsigned long)val);
+        return;
+    }
+    out_udec(val);
+}
+
+/* same as printf("%0*lu") */
+void out_udec_pad(unsigned long val, int width) {
+    char tmp[20];
+    int i = sizeof(tmp);
+
+    do {
+        tmp[--i] = '0' + val % 10;
+        val /= 10;
+    } while ( val );
+    while ( i > 0 && (int)sizeof(tmp) - i < width ){
+        tmp[--i] = '0';
+    }
+
+    out_strn(tmp + i, sizeof(tmp) - i);
+}
+
+/*
+ * format "name(0xNN)" of every value once
+ *
+ * @labels: n labels, indexed by value
+ * @name: the name of a value
+ *
+ */
+void out_labels_init(struct out_label *labels, int n, const char* (*name)(u_char)) {
+    int i, len;
+
+    for ( i = 0; i < n; i++ ){
+        len = snprintf(labels[i].s, sizeof(labels[i].s), "%s(0x%02x)", name(i), i);
+        if ( len >= (int)sizeof(labels[i].s) ){
+            len = sizeof(labels[i].s) - 1;
+        }
+        labels[i].len = len;
+    }
+}
+
+/*
+ * called by got_packet after the last line of a packet
+ */
+void out_packet_end(void) {
+    if ( out_cur.hold ){
+        return;
+    }
+    if ( out_tty || out_cur.len >= OUT_FLUSH_SIZE ){
+        out_flush();
+        return;
+    }
+    out_tick();
+}
+
+/*
+ * flush a quiet buffer, called between packets and by the capture loops when idle
+ */
+void out_tick(void) {
+    long now;
+
+    if ( out_cur.len == 0 || out_cur.hold ){
+        return;
+    }
+    now = out_now_ms();
+    if ( now - out_cur.last_ms >= OUT_FLUSH_MS ){
+        out_flush();
+    }
+}
+
+void out_flush(void) {
+    size_t off = 0;
+    ssize_t n;
+
+    out_cur.last_ms = out_now_ms();
+    if ( out_cur.len == 0 ){
+        return;
+    }
+
+    pthread_mutex_lock(&out_lock);
+    while ( off < out_cur.len ){
+        n = write(out_fd, out_cur.buf + off, out_cur.len - off);
+        if ( n == -1 ){
+            if ( errno == EINTR ){
+                continue;
+            }
+            break;
+        }
+        off += n;
+    }
+    pthread_mutex_unlock(&out_lock);
+
+    out_cur.len = 0;
+}
+
+void out_hold(int hold) {
+    out_cur.hold = hold;
+}
+
+const char* out_data(void) {
+    return out_cur.buf;
+}
+
+size_t out_length(void) {
+    return out_cur.len;
+}
+
+void out_discard(void) {
+    out_cur.len = 0;
+}
+
+/*
+ * write text of other workers, which is held in their own buffers
+ */
+void out_writev(struct iovec *iov, int iovcnt) {
+    ssize_t n;
+
+    pthread_mutex_lock(&out_lock);
+    while ( iovcnt > 0 ){
+        n = writev(out_fd, iov, iovcnt);
+        if ( n == -1 ){
+            if ( errno == EINTR ){
+                continue;
+            }
+            break;
+        }
+        /* skip what was written, a short write may stop in the middle of a slice */
+        while ( iovcnt > 0 && (size_t)n >= iov->iov_len ){
+            n -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if ( iovcnt > 0 ){
+            iov->iov_base = (char *)iov->iov_base + n;
+            iov->iov_len -= n;
+        }
+    }
+    pthread_mutex_unlock(&out_lock);
+}
@@ -0,0 +1,106 @@
+#ifndef _IPMI_DUMP_OUTPUT_H
+#define _IPMI_DUMP_OUTPUT_H
+
+#include <stddef.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#include "dump.h"
+
+/*
+ * per worker output buffer
+ *
+ * decoders append text with the emitters below, the buffer is written with a
+ * single write(2) only between packets, so the lines of one packet are never
+ * interleaved with another worker's. it is flushed when it fills up or when
+ * the last flush is older than OUT_FLUSH_MS
+ */
+
+struct out_buf {
+    char        *buf;
+    size_t      len;
+    size_t      cap;
+    int         hold;       /* never flush, see out_hold */
+    long        last_ms;    /* monotonic time of the last flush */
+};
+
+/* a name with its value, e.g. "Application(0x06)", formatted once at startup */
+struct out_label {
+    u_char      len;
+    char        s[47];
+};
+
+extern DUMP_TLS struct out_buf out_cur;
+extern char out_hex_pairs[256][2];
+
+void out_init(int fd);
+void out_printf(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+void out_grow(size_t n);
+void out_udec(unsigned long val);
+void out_dec(long val);
+void out_udec_pad(unsigned long val, int width);
+void out_labels_init(struct out_label *labels, int n, const char* (*name)(u_char));
+void out_packet_end(void);
+void out_tick(void);
+void out_flush(void);
+
+/* -r with -j: workers keep their text, the reader merges it back in capture order */
+void out_hold(int hold);
+const char* out_data(void);
+size_t out_length(void);
+void out_discard(void);
+void out_writev(struct iovec *iov, int iovcnt);
+
+static inline char* out_reserve(size_t n) {
+    if ( out_cur.len + n > out_cur.cap ){
+        out_grow(n);
+    }
+    return out_cur.buf + out_cur.len;
+}
+
+static inline void out_strn(const char *s, size_t n) {
+    memcpy(out_reserve(n), s, n);
+    out_cur.len += n;
+}
+
+/* string literal only, the length is known at compile time */
+#define OUT_LIT(s)      out_strn((s), sizeof(s) - 1)
+
+static inline void out_str(const char *s) {
+    out_strn(s, strlen(s));
+}
+
+static inline void out_char(char c) {
+    *out_reserve(1) = c;
+    out_cur.len++;
+}
+
+/* same as printf("%02x") */
+static inline void out_hex2(u_char val) {
+    char *p = out_reserve(2);
+    p[0] = out_hex_pairs[val][0];
+    p[1] = out_hex_pairs[val][1];
+    out_cur.len += 2;
+}
+
+/* same as printf("0x%02x") */
+static inline void out_hex8(u_char val) {
+    char *p = out_reserve(4);
+    p[0] = '0';
+    p[1] = 'x';
+    p[2] = out_hex_pairs[val][0];
+    p[3] = out_hex_pairs[val][1];
+    out_cur.len += 4;
+}
+
+static inline void out_label(const struct out_label *label) {
+    out_strn(label->s, label->len);
+}
+
+/* whole "prefix value" lines, prefix must be a string literal */
+#define OUT_HEX8_LINE(prefix, val)      do { OUT_LIT(prefix); out_hex8(val); out_char('\n'); } while ( 0 )
+#define OUT_DEC_LINE(prefix, val)       do { OUT_LIT(prefix); out_dec((int)(val)); out_char('\n'); } while ( 0 )
+#define OUT_LABEL_LINE(prefix, label)   do { OUT_LIT(prefix); out_label(label); out_char('\n'); } while ( 0 )
+
+#endif
@@ -0,0 +1,396 @@
+/*
+ * read pcap and pcapng capture files through mmap
+ *
+ * the file is walked once from the beginning to the end, the kernel is told
+ * so with madvise(SEQUENTIAL) so that read ahead keeps up with the decoder
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "bswap.h"
+#include "pcapfile.h"
+
+/* classic pcap */
+#define PCAP_MAGIC_USEC         0xa1b2c3d4
+#define PCAP_MAGIC_NSEC         0xa1b23c4d
+#define PCAP_MAGIC_USEC_SWAPPED 0xd4c3b2a1
+#define PCAP_MAGIC_NSEC_SWAPPED 0x4d3cb2a1
+#define PCAP_FILE_HEADER_LEN    24
+#define PCAP_RECORD_HEADER_LEN  16
+
+/* pcapng */
+#define PCAPNG_BT_SHB           0x0a0d0d0a  /* section header block */
+#define PCAPNG_BT_IDB           0x00000001  /* interface description block */
+#define PCAPNG_BT_SPB           0x00000003  /* simple packet block */
+#define PCAPNG_BT_EPB           0x00000006  /* enhanced packet block */
+#define PCAPNG_BYTE_ORDER_MAGIC 0x1a2b3c4d
+#define PCAPNG_OPT_ENDOFOPT     0
+#define PCAPNG_OPT_IF_TSRESOL   9
+#define PCAPNG_MAX_INTERFACES   64
+
+struct pcapng_interface {
+    int             linktype;
+    unsigned int    snaplen;
+    uint64_t        ts_per_sec;     /* timestamp units per second, if_tsresol */
+};
+
+struct pcapfile {
+    u_char          *map;
+    size_t          len;
+    size_t          off;            /* next record */
+    int             ng;             /* is pcapng */
+    int             swapped;        /* file byte order differs from host */
+    int             nsec;           /* classic pcap with nanosecond timestamp */
+    int             linktype;
+    int             nif;            /* pcapng interfaces of current section */
+    volatile int    stop;
+    struct pcapng_interface ifs[PCAPNG_MAX_INTERFACES];
+    char            errbuf[PCAP_ERRBUF_SIZE];
+};
+
+static inline uint16_t pf_u16(struct pcapfile *pf, const u_char *p) {
+    uint16_t v;
+    memcpy(&v, p, sizeof(v));
+    return pf->swapped ? BSWAP_16(v) : v;
+}
+
+static inline uint32_t pf_u32(struct pcapfile *pf, const u_char *p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return pf->swapped ? BSWAP_32(v) : v;
+}
+
+/*
+ * parse the section header at pf->off, the byte order of the whole section is decided here
+ */
+static int pcapng_section(struct pcapfile *pf) {
+    uint32_t magic;
+
+    if ( pf->len - pf->off < 28 ){
+        snprintf(pf->errbuf, PCAP_ERRBUF_SIZE, "truncated pcapng section header");
+        return -1;
+    }
+
+    memcpy(&magic, pf->map + pf->off + 8, sizeof(magic));
+    if ( magic == PCAPNG_BYTE_ORDER_MAGIC ){
+        pf->swapped = 0;
+    }
+    else if ( magic == BSWAP_32(PCAPNG_BYTE_ORDER_MAGIC) ){
+        pf->swapped = 1;
+    }
+    else {
+        snprintf(pf->errbuf, PCAP_ERRBUF_SIZE, "invalid pcapng byte order magic 0x%08x", magic);
+        return -1;
+    }
+
+    /* interface ids are scoped to the section */
+    pf->nif = 0;
+    return 0;
+}
+
+static void pcapng_interface(struct pcapfile *pf, const u_char *body, uint32_t body_len) {
+    struct pcapng_interface *iface;
+    const u_char *opt, *end;
+    uint16_t code, len;
+    u_char tsresol;
+    int i;
+
+    if ( pf->nif == PCAPNG_MAX_INTERFACES || body_len < 8 ){
+        return;
+    }
+
+    iface = &pf->ifs[pf->nif++];
+    iface->linktype = pf_u16(pf, body);
+    iface->snaplen = pf_u32(pf, body + 4);
+    iface->ts_per_sec = 1000000;
+
+    opt = body + 8;
+    end = body + body_len;
+    while ( opt + 4 <= end ){
+        code = pf_u16(pf, opt);
+        len = pf_u16(pf, opt + 2);
+        if ( code == PCAPNG_OPT_ENDOFOPT || opt + 4 + len > end ){
+            break;
+        }
+        if ( code == PCAPNG_OPT_IF_TSRESOL && len >= 1 ){
+            tsresol = opt[4];
+            iface->ts_per_sec = 1;
+            for ( i = 0; i < (tsresol & 0x7f) && i < 63; i++ ){
+                iface->ts_per_sec *= (tsresol & 0x80) ? 2 : 10;
+            }
+        }
+        opt += 4 + ((len + 3) & ~3);
+    }
+
+    if ( pf->linktype == -1 ){
+        pf->linktype = iface->linktype;
+    }
+}
+
+/*
+ * open and map the file, the first section/interface decides the linktype
+ *
+ * @path: capture file
+ * @errbuf: PCAP_ERRBUF_SIZE bytes to hold the error message
+ *
+ */
+struct pcapfile* pcapfile_open(const char *path, char *errbuf) {
+    struct pcapfile *pf;
+    struct stat st;
+    uint32_t magic;
+    int fd;
+
+    fd = open(path, O_RDONLY);
+    if ( fd == -1 ){
+        snprintf(errbuf, PCAP_ERRBUF_SIZE, "%s: %s", path, strerror(errno));
+        return NULL;
+    }
+    if ( fstat(fd, &st) == -1 ){
+        snprintf(errbuf, PCAP_ERRBUF_SIZE, "%s: %s", path, strerror(errno));
+        close(fd);
+        return NULL;
+    }
+    if ( st.st_size < PCAP_FILE_HEADER_LEN ){
+        snprintf(errbuf, PCAP_ERRBUF_SIZE, "%s: too small to be a capture file", path);
+        close(fd);
+        return NULL;
+    }
+
+    pf = (struct pcapfile *)calloc(1, sizeof(struct pcapfile));
+    if ( pf == NULL ){
+        snprintf(errbuf, PCAP_ERRBUF_SIZE, "out of memory");
+        close(fd);
+        return NULL;
+    }
+
+    pf->len = st.st_size;
+    pf->map = mmap(NULL, pf->len, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if ( pf->map == MAP_FAILED ){
+        snprintf(errbuf, PCAP_ERRBUF_SIZE, "mmap %s: %s", path, strerror(errno));
+        free(pf);
+        return NULL;
+    }
+    madvise(pf->map, pf->len, MADV_SEQUENTIAL);
+
+    pf->linktype = -1;
+    memcpy(&magic, pf->map, sizeof(magic));
+    switch ( magic ){
+        case PCAP_MAGIC_USEC:
+        case PCAP_MAGIC_NSEC:
+            pf->nsec = magic == PCAP_MAGIC_NSEC;
+            break;
+        case PCAP_MAGIC_USEC_SWAPPED:
+        case PCAP_MAGIC_NSEC_SWAPPED:
+            pf->swapped = 1;
+            pf->nsec = magic == PCAP_MAGIC_NSEC_SWAPPED;
+            break;
+        case PCAPNG_BT_SHB:
+            pf->ng = 1;
+            break;
+        default:
+            snprintf(errbuf, PCAP_ERRBUF_SIZE, "%s: unknown file format(magic 0x%08x)", path, magic);
+            pcapfile_close(pf);
+            return NULL;
+    }
+
+    if ( !pf->ng ){
+        /* the upper bits of linktype may carry the FCS length */
+        pf->linktype = pf_u32(pf, pf->map + 20) & 0x0fffffff;
+        pf->off = PCAP_FILE_HEADER_LEN;
+        return pf;
+    }
+
+    /* read ahead until the first interface is known */
+    while ( pf->linktype == -1 ){
+        uint32_t type, blen;
+
+        if ( pf->len - pf->off < 12 ){
+            snprintf(errbuf, PCAP_ERRBUF_SIZE, "%s: no interface description block", path);
+            pcapfile_close(pf);
+            return NULL;
+        }
+        memcpy(&type, pf->map + pf->off, sizeof(type));
+        if ( type == PCAPNG_BT_SHB && pcapng_section(pf) == -1 ){
+            snprintf(errbuf, PCAP_ERRBUF_SIZE, "%s: %.*s", path, PCAP_ERRBUF_SIZE - 3, pf->errbuf);
+            pcapfile_close(pf);
+            return NULL;
+        }
+        type = pf_u32(pf, pf->map + pf->off);
+        blen = pf_u32(pf, pf->map + pf->off + 4);
+        if ( blen < 12 || blen > pf->len - pf->off ){
+            snprintf(errbuf, PCAP_ERRBUF_SIZE, "%s: truncated pcapng block", path);
+            pcapfile_close(pf);
+            return NULL;
+        }
+        if ( type == PCAPNG_BT_IDB ){
+            pcapng_interface(pf, pf->map + pf->off + 8, blen - 12);
+        }
+        pf->off += blen;
+    }
+
+    return pf;
+}
+
+int pcapfile_linktype(struct pcapfile *pf) {
+    return pf->linktype;
+}
+
+const char* pcapfile_geterr(struct pcapfile *pf) {
+    return pf->errbuf;
+}
+
+static int pcap_next_record(struct pcapfile *pf, struct pcap_pkthdr *header, const u_char **data) {
+    const u_char *rec;
+
+    if ( pf->off == pf->len ){
+        return 0;
+    }
+    if ( pf->len - pf->off < PCAP_RECORD_HEADER_LEN ){
+        snprintf(pf->errbuf, PCAP_ERRBUF_SIZE, "truncated record header at offset %lu", (unsigned long)pf->off);
+        return -1;
+    }
+
+    rec = pf->map + pf->off;
+    header->ts.tv_sec = pf_u32(pf, rec);
+    header->ts.tv_usec = pf->nsec ? pf_u32(pf, rec + 4) / 1000 : pf_u32(pf, rec + 4);
+    header->caplen = pf_u32(pf, rec + 8);
+    header->len = pf_u32(pf, rec + 12);
+    if ( header->caplen > pf->len - pf->off - PCAP_RECORD_HEADER_LEN ){
+        snprintf(pf->errbuf, PCAP_ERRBUF_SIZE, "truncated record at offset %lu", (unsigned long)pf->off);
+        return -1;
+    }
+
+    *data = rec + PCAP_RECORD_HEADER_LEN;
+    pf->off += PCAP_RECORD_HEADER_LEN + header->caplen;
+    return 1;
+}
+
+static int pcapng_next_record(struct pcapfile *pf, struct pcap_pkthdr *header, const u_char **data) {
+    const u_char *blk, *body;
+    struct pcapng_interface *iface;
+    uint32_t type, blen, ifid;
+    uint64_t ts;
+
+    for ( ;; ){
+        if ( pf->off == pf->len ){
+            return 0;
+        }
+        if ( pf->len - pf->off < 12 ){
+            snprintf(pf->errbuf, PCAP_ERRBUF_SIZE, "truncated block header at offset %lu", (unsigned long)pf->off);
+            return -1;
+        }
+
+        blk = pf->map + pf->off;
+        memcpy(&type, blk, sizeof(type));
+        if ( type == PCAPNG_BT_SHB && pcapng_section(pf) == -1 ){
+            return -1;
+        }
+        type = pf_u32(pf, blk);
+        blen = pf_u32(pf, blk + 4);
+        if ( blen < 12 || blen > pf->len - pf->off ){
+            snprintf(pf->errbuf, PCAP_ERRBUF_SIZE, "truncated block at offset %lu", (unsigned long)pf->off);
+            return -1;
+        }
+        pf->off += blen;
+        body = blk + 8;
+
+        switch ( type ){
+            case PCAPNG_BT_IDB:
+                pcapng_interface(pf, body, blen - 12);
+                break;
+            case PCAPNG_BT_EPB:
+                if ( blen < 32 ){
+                    break;
+                }
+                ifid = pf_u32(pf, body);
+                if ( ifid >= (uint32_t)pf->nif || pf->ifs[ifid].linktype != pf->linktype ){
+                    /* got_packet has one datalink for the whole run */
+                    break;
+                }
+                iface = &pf->ifs[ifid];
+                ts = ((uint64_t)pf_u32(pf, body + 4) << 32) | pf_u32(pf, body + 8);
+                header->ts.tv_sec = ts / iface->ts_per_sec;
+                header->ts.tv_usec = (ts % iface->ts_per_sec) * 1000000 / iface->ts_per_sec;
+                header->caplen = pf_u32(pf, body + 12);
+                header->len = pf_u32(pf, body + 16);
+                if ( header->caplen > blen - 32 ){
+                    snprintf(pf->errbuf, PCAP_ERRBUF_SIZE, "truncated packet block at offset %lu", (unsigned long)(pf->off - blen));
+                    return -1;
+                }
+                *data = body + 20;
+                return 1;
+            case PCAPNG_BT_SPB:
+                if ( blen < 16 || pf->nif == 0 || pf->ifs[0].linktype != pf->linktype ){
+                    break;
+                }
+                /* simple packet block has no timestamp */
+                header->ts.tv_sec = 0;
+                header->ts.tv_usec = 0;
+                header->len = pf_u32(pf, body);
+                header->caplen = header->len < blen - 16 ? header->len : blen - 16;
+                *data = body + 4;
+                return 1;
+            default:
+                /* statistics, name resolution, custom blocks */
+                break;
+        }
+    }
+}
+
+/*
+ * @return: 1 with a packet, 0 at the end of file, -1 on a malformed file
+ */
+int pcapfile_next(struct pcapfile *pf, struct pcap_pkthdr *header, const u_char **data) {
+    if ( pf->ng ){
+        return pcapng_next_record(pf, header, data);
+    }
+    return pcap_next_record(pf, header, data);
+}
+
+/*
+ * hand every packet accepted by fp to callback, as fast as the decoder allows
+ *
+ * @fp: compiled filter, NULL to accept everything
+ * @return: packets delivered, -1 on a malformed file
+ */
+int pcapfile_loop(struct pcapfile *pf, struct bpf_program *fp, pcap_handler callback, u_char *user) {
+    struct pcap_pkthdr header;
+    const u_char *data;
+    int ret = 0, count = 0;
+
+    while ( !pf->stop && (ret = pcapfile_next(pf, &header, &data)) == 1 ){
+        if ( fp != NULL && pcap_offline_filter(fp, &header, data) == 0 ){
+            continue;
+        }
+        callback(user, &header, data);
+        count++;
+    }
+
+    return ret == -1 ? -1 : count;
+}
+
+void pcapfile_breakloop(struct pcapfile *pf) {
+    pf->stop = 1;
+}
+
+int pcapfile_stopped(struct pcapfile *pf) {
+    return pf->stop;
+}
+
+void pcapfile_close(struct pcapfile *pf) {
+    if ( pf == NULL ){
+        return;
+    }
+    if ( pf->map != MAP_FAILED && pf->map != NULL ){
+        munmap(pf->map, pf->len);
+    }
+    free(pf);
+}
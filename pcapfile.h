@@ -0,0 +1,23 @@
+#ifndef _IPMI_DUMP_PCAPFILE_H
+#define _IPMI_DUMP_PCAPFILE_H
+
+#include <pcap.h>
+
+/*
+ * memory mapped reader of capture files, accept classic pcap(usec and nsec) and pcapng
+ *
+ * packet data is returned as a pointer into the mapping, nothing is copied
+ */
+
+struct pcapfile;
+
+struct pcapfile* pcapfile_open(const char *path, char *errbuf);
+int pcapfile_linktype(struct pcapfile *pf);
+const char* pcapfile_geterr(struct pcapfile *pf);
+int pcapfile_next(struct pcapfile *pf, struct pcap_pkthdr *header, const u_char **data);
+int pcapfile_loop(struct pcapfile *pf, struct bpf_program *fp, pcap_handler callback, u_char *user);
+void pcapfile_breakloop(struct pcapfile *pf);
+int pcapfile_stopped(struct pcapfile *pf);
+void pcapfile_close(struct pcapfile *pf);
+
+#endif
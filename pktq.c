@@ -0,0 +1,176 @@
+/*
+ * packet queue between the capture and the decoding thread, see pktq.h
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "pktq.h"
+
+#define PKTQ_CACHE_LINE     64
+#define PKTQ_IDLE_NS        1000000     /* consumer sleep on an empty queue */
+
+struct pktq_desc {
+    struct pcap_pkthdr  header;
+};
+
+struct pktq {
+    struct pktq_desc    *desc;
+    u_char              *slab;
+    unsigned int        mask;
+    unsigned int        slot_size;
+
+    /* written by the producer only */
+    unsigned int        head __attribute__((aligned(PKTQ_CACHE_LINE)));
+    unsigned int        high_water;
+    unsigned long long  queued;
+    unsigned long long  dropped;
+    unsigned long long  cap_recv;
+    unsigned long long  cap_drop;
+    unsigned long long  cap_ifdrop;
+    int                 closed;
+
+    /* written by the consumer only */
+    unsigned int        tail __attribute__((aligned(PKTQ_CACHE_LINE)));
+};
+
+/*
+ * allocate the queue and its slab
+ *
+ * @slots: packets the queue holds, rounded up to a power of two
+ * @snaplen: bytes kept of every packet, the size of a slot
+ *
+ */
+struct pktq* pktq_open(unsigned int slots, unsigned int snaplen) {
+    struct pktq *q;
+    unsigned int n = 1;
+
+    while ( n < slots ){
+        n <<= 1;
+    }
+
+    if ( posix_memalign((void **)&q, PKTQ_CACHE_LINE, sizeof(struct pktq)) != 0 ){
+        return NULL;
+    }
+    memset(q, 0, sizeof(struct pktq));
+    q->mask = n - 1;
+    q->slot_size = (snaplen + 7) & ~7u;
+    q->desc = (struct pktq_desc *)calloc(n, sizeof(struct pktq_desc));
+    q->slab = (u_char *)malloc((size_t)n * q->slot_size);
+    if ( q->desc == NULL || q->slab == NULL ){
+        pktq_free(q);
+        return NULL;
+    }
+    return q;
+}
+
+/*
+ * the capture callback of the producer thread, copy one packet in the queue
+ *
+ * @user: the struct pktq
+ *
+ */
+void pktq_push(u_char *user, const struct pcap_pkthdr *header, const u_char *packet) {
+    struct pktq *q = (struct pktq *)user;
+    unsigned int head = q->head;
+    unsigned int used = head - __atomic_load_n(&q->tail, __ATOMIC_ACQUIRE);
+    struct pktq_desc *d;
+
+    if ( used > q->mask ){
+        __atomic_store_n(&q->dropped, q->dropped + 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    d = &q->desc[head & q->mask];
+    d->header = *header;
+    if ( d->header.caplen > q->slot_size ){
+        d->header.caplen = q->slot_size;
+    }
+    memcpy(q->slab + (size_t)(head & q->mask) * q->slot_size, packet, d->header.caplen);
+
+    if ( used + 1 > q->high_water ){
+        __atomic_store_n(&q->high_water, used + 1, __ATOMIC_RELAXED);
+    }
+    __atomic_store_n(&q->queued, q->queued + 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&q->head, head + 1, __ATOMIC_RELEASE);
+}
+
+/* the producer is done, the consumer returns once the queue is empty */
+void pktq_close_input(struct pktq *q) {
+    __atomic_store_n(&q->closed, 1, __ATOMIC_RELEASE);
+}
+
+/*
+ * decode packets in queue order until the input is closed and drained
+ *
+ * @idle: called when the queue is empty, may be NULL
+ * @return: 0
+ */
+int pktq_loop(struct pktq *q, pcap_handler callback, u_char *user, void (*idle)(void)) {
+    struct timespec nap = { 0, PKTQ_IDLE_NS };
+    unsigned int tail = q->tail, head;
+    int closed;
+
+    for ( ;; ){
+        /* closed is read before head, so no packet pushed before the close is missed */
+        closed = __atomic_load_n(&q->closed, __ATOMIC_ACQUIRE);
+        head = __atomic_load_n(&q->head, __ATOMIC_ACQUIRE);
+        if ( tail == head ){
+            if ( closed ){
+                return 0;
+            }
+            if ( idle != NULL ){
+                idle();
+            }
+            nanosleep(&nap, NULL);
+            continue;
+        }
+
+        while ( tail != head ){
+            callback(user, &q->desc[tail & q->mask].header, q->slab + (size_t)(tail & q->mask) * q->slot_size);
+            tail++;
+            __atomic_store_n(&q->tail, tail, __ATOMIC_RELEASE);
+        }
+    }
+}
+
+/* a snapshot of the counters, from any thread */
+/*
+ * publish the kernel counters read by the producer, a pcap_t is not to be
+ * touched by the consumer while the producer dispatches on it
+ *
+ */
+void pktq_set_capture(struct pktq *q, unsigned long long recv, unsigned long long drop, unsigned long long ifdrop) {
+    __atomic_store_n(&q->cap_recv, recv, __ATOMIC_RELAXED);
+    __atomic_store_n(&q->cap_drop, drop, __ATOMIC_RELAXED);
+    __atomic_store_n(&q->cap_ifdrop, ifdrop, __ATOMIC_RELAXED);
+}
+
+void pktq_get_stats(struct pktq *q, struct pktq_stats *stats) {
+    stats->slots = q->mask + 1;
+    stats->used = __atomic_load_n(&q->head, __ATOMIC_ACQUIRE) - __atomic_load_n(&q->tail, __ATOMIC_ACQUIRE);
+    stats->high_water = __atomic_load_n(&q->high_water, __ATOMIC_RELAXED);
+    stats->queued = __atomic_load_n(&q->queued, __ATOMIC_RELAXED);
+    stats->dropped = __atomic_load_n(&q->dropped, __ATOMIC_RELAXED);
+    stats->cap_recv = __atomic_load_n(&q->cap_recv, __ATOMIC_RELAXED);
+    stats->cap_drop = __atomic_load_n(&q->cap_drop, __ATOMIC_RELAXED);
+    stats->cap_ifdrop = __atomic_load_n(&q->cap_ifdrop, __ATOMIC_RELAXED);
+}
+
+void pktq_report(struct pktq *q, FILE *f) {
+    struct pktq_stats stats;
+
+    pktq_get_stats(q, &stats);
+    fprintf(f, "Queue: %u of %u slots used, high water %u, %llu packets queued, %llu dropped in userspace(queue full)\n",
+            stats.used, stats.slots, stats.high_water, stats.queued, stats.dropped);
+}
+
+void pktq_free(struct pktq *q) {
+    if ( q == NULL ){
+        return;
+    }
+    free(q->desc);
+    free(q->slab);
+    free(q);
+}
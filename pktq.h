@@ -0,0 +1,42 @@
+#ifndef _IPMI_DUMP_PKTQ_H
+#define _IPMI_DUMP_PKTQ_H
+
+#include <stdio.h>
+#include <pcap.h>
+
+/*
+ * single producer single consumer packet queue between the capture thread and
+ * the decoding thread(-Q), so a slow stdout or disk no longer stalls the
+ * capture loop and makes the kernel drop packets
+ *
+ * the queue is a power of two ring of packet headers, every slot owns a
+ * snaplen sized part of one slab allocated up front: the producer copies the
+ * packet in its slot and publishes it by storing head, the consumer decodes it
+ * in place and hands the slot back by storing tail. neither side takes a lock,
+ * a packet arriving on a full queue is dropped and counted
+ */
+
+struct pktq;
+
+struct pktq_stats {
+    unsigned int        slots;
+    unsigned int        used;           /* packets waiting now */
+    unsigned int        high_water;     /* most packets ever waiting */
+    unsigned long long  queued;
+    unsigned long long  dropped;        /* queue full, dropped in userspace */
+    /* the kernel counters of a libpcap handle, only the capture thread may read them */
+    unsigned long long  cap_recv;
+    unsigned long long  cap_drop;
+    unsigned long long  cap_ifdrop;
+};
+
+struct pktq* pktq_open(unsigned int slots, unsigned int snaplen);
+void pktq_push(u_char *user, const struct pcap_pkthdr *header, const u_char *packet);
+void pktq_close_input(struct pktq *q);
+int pktq_loop(struct pktq *q, pcap_handler callback, u_char *user, void (*idle)(void));
+void pktq_set_capture(struct pktq *q, unsigned long long recv, unsigned long long drop, unsigned long long ifdrop);
+void pktq_get_stats(struct pktq *q, struct pktq_stats *stats);
+void pktq_report(struct pktq *q, FILE *f);
+void pktq_free(struct pktq *q);
+
+#endif
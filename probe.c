@@ -0,0 +1,143 @@
+/*
+ * per stage cost histograms of the decoding, see probe.h
+ */
+#ifdef DUMP_PROBES
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include "dump.h"
+#include "ipmi_cmd.h"
+#include "probe.h"
+
+#define PROBE_BUCKETS       64      /* bucket i counts costs of i bits */
+#define PROBE_TOTAL         PROBE_STAGES    /* the histogram of the whole packet */
+
+struct probe_hist {
+    u_int64_t       count;
+    u_int64_t       sum;
+    u_int64_t       max;
+    u_int32_t       buckets[PROBE_BUCKETS];
+};
+
+/* the histograms of a command, allocated the first time it is seen */
+struct probe_row {
+    struct probe_hist   stages[PROBE_STAGES + 1];
+};
+
+static const char *stage_names[PROBE_STAGES + 1] = {
+    [PROBE_LINK] = "link",
+    [PROBE_IP] = "ip",
+    [PROBE_UDP] = "udp",
+    [PROBE_PAYLOAD] = "payload",
+    [PROBE_RMCP] = "rmcp",
+    [PROBE_ASF] = "asf",
+    [PROBE_IPMI] = "ipmi",
+    [PROBE_SESSION] = "session",
+    [PROBE_SDR] = "sdr",
+    [PROBE_CMD] = "cmd",
+    [PROBE_OUTPUT] = "output",
+    [PROBE_TOTAL] = "packet",
+};
+
+DUMP_TLS struct probe_frame probe_stack[PROBE_DEPTH];
+DUMP_TLS int probe_depth;
+DUMP_TLS u_int64_t probe_cost[PROBE_STAGES];
+DUMP_TLS u_int32_t probe_seen;
+DUMP_TLS int probe_cmd;
+
+static DUMP_TLS struct probe_row *rows[PROBE_NO_CMD + 1];
+
+/* a packet dropped before probe_packet_end leaves nothing behind */
+void probe_packet_start(void) {
+    probe_depth = 0;
+    probe_seen = 0;
+    probe_cmd = PROBE_NO_CMD;
+    memset(probe_cost, 0, sizeof(probe_cost));
+}
+
+static inline void hist_add(struct probe_hist *h, u_int64_t cost) {
+    h->count++;
+    h->sum += cost;
+    if ( cost > h->max ){
+        h->max = cost;
+    }
+    h->buckets[cost == 0 ? 0 : 63 - __builtin_clzll(cost)]++;
+}
+
+void probe_packet_end(void) {
+    struct probe_row *row = rows[probe_cmd];
+    u_int64_t total = 0;
+    int i;
+
+    if ( row == NULL ){
+        row = (struct probe_row *)calloc(1, sizeof(struct probe_row));
+        if ( row == NULL ){
+            fprintf(stderr, "out of memory for probe histograms\n");
+            exit(1);
+        }
+        rows[probe_cmd] = row;
+    }
+    for ( i = 0; i < PROBE_STAGES; i++ ){
+        if ( probe_seen & (1u << i) ){
+            hist_add(&row->stages[i], probe_cost[i]);
+            total += probe_cost[i];
+        }
+    }
+    hist_add(&row->stages[PROBE_TOTAL], total);
+}
+
+/* the upper bound of the bucket holding the q-th fraction of the histogram */
+static u_int64_t hist_quantile(const struct probe_hist *h, double q) {
+    u_int64_t rank = (u_int64_t)(q * h->count), seen = 0;
+    int i;
+
+    for ( i = 0; i < PROBE_BUCKETS - 1; i++ ){
+        seen += h->buckets[i];
+        if ( seen > rank ){
+            break;
+        }
+    }
+    return i == PROBE_BUCKETS - 1 ? h->max : (2ull << i) - 1;
+}
+
+/*
+ * print the histograms of the thread, one block per command seen, one line per
+ * stage: packets, mean, p50 and p99(upper bound of their log2 bucket), max
+ *
+ * @f: where to print
+ *
+ */
+void probe_dump(FILE *f) {
+    const struct probe_hist *h;
+    int r, i;
+
+    flockfile(f);
+    fprintf(f, "Probes(" PROBE_UNIT " per packet, own cost of each stage):\n");
+    for ( r = 0; r <= PROBE_NO_CMD; r++ ){
+        if ( rows[r] == NULL ){
+            continue;
+        }
+        if ( r == PROBE_NO_CMD ){
+            fprintf(f, "  no ipmi command\n");
+        }
+        else {
+            fprintf(f, "  %s(netfn 0x%02x, cmd 0x%02x)\n", ipmi_get_cmd_str((r >> 8) << 1, r & 0xff), (r >> 8) << 1, r & 0xff);
+        }
+        for ( i = 0; i <= PROBE_STAGES; i++ ){
+            h = &rows[r]->stages[i];
+            if ( h->count == 0 ){
+                continue;
+            }
+            fprintf(f, "    %-8s %10llu pkts, mean %8.1f, p50 <= %llu, p99 <= %llu, max %llu\n", stage_names[i],
+                    (unsigned long long)h->count, (double)h->sum / h->count,
+                    (unsigned long long)hist_quantile(h, 0.5), (unsigned long long)hist_quantile(h, 0.99),
+                    (unsigned long long)h->max);
+        }
+    }
+    funlockfile(f);
+}
+
+#endif
@@ -0,0 +1,131 @@
+#ifndef _IPMI_DUMP_PROBE_H
+#define _IPMI_DUMP_PROBE_H
+
+#include <stdio.h>
+#include <sys/types.h>
+
+#include "dump.h"
+#include "ipmi_cmd.h"
+
+/*
+ * cost of every stage of the decoding of a packet, built with make PROBES=1
+ * only: without it every probe below is an empty macro
+ *
+ * PROBE_ENTER and PROBE_LEAVE bracket a stage, the cycles(the tsc on x86,
+ * nanoseconds elsewhere) between them minus the ones of the stages nested in
+ * it are the own cost of the stage. the costs of a packet are added up while
+ * it is decoded, then filed under the command of the packet(ASF and packets
+ * without an ipmi command share a row) into log2 histograms, one per stage and
+ * one for the whole packet. a thread dumps its histograms with its other
+ * reports, on exit and on SIGUSR1
+ */
+
+enum probe_stage {
+    PROBE_LINK,         /* link header of got_packet */
+    PROBE_IP,
+    PROBE_UDP,          /* udp header, the rmcp check and the [UDP] line */
+    PROBE_PAYLOAD,      /* the hex dump, print_payload */
+    PROBE_RMCP,         /* print_rmcp */
+    PROBE_ASF,          /* print_asf */
+    PROBE_IPMI,         /* print_ipmi, the session and message headers */
+    PROBE_SESSION,      /* the decoders of ipmi_session.c */
+    PROBE_SDR,          /* the decoders of ipmi_sdr.c */
+    PROBE_CMD,          /* the body of any other command */
+    PROBE_OUTPUT,       /* out_packet_end */
+    PROBE_STAGES
+};
+
+#ifdef DUMP_PROBES
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__) && !defined(__TINYC__)
+#include <x86intrin.h>
+#define PROBE_TSC
+#define PROBE_UNIT          "cycles"
+#else
+#include <time.h>
+#define PROBE_UNIT          "ns"
+#endif
+
+#define PROBE_DEPTH         8       /* stages nested deeper are not measured */
+#define PROBE_NO_CMD        (IPMI_NETFN_ROWS * 256)
+
+struct probe_frame {
+    u_int64_t       start;
+    u_int64_t       nested;     /* spent in the stages entered from this one */
+};
+
+extern DUMP_TLS struct probe_frame probe_stack[PROBE_DEPTH];
+extern DUMP_TLS int probe_depth;
+extern DUMP_TLS u_int64_t probe_cost[PROBE_STAGES];
+extern DUMP_TLS u_int32_t probe_seen;       /* bit per stage entered by the packet */
+extern DUMP_TLS int probe_cmd;              /* netfn row << 8 | cmd, PROBE_NO_CMD before print_ipmi */
+
+static inline u_int64_t probe_now(void) {
+#ifdef PROBE_TSC
+    return __rdtsc();
+#else
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (u_int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+static inline void probe_enter(void) {
+    if ( probe_depth < PROBE_DEPTH ){
+        probe_stack[probe_depth].nested = 0;
+        probe_stack[probe_depth].start = probe_now();
+    }
+    probe_depth++;
+}
+
+static inline void probe_leave(enum probe_stage stage) {
+    u_int64_t spent;
+
+    if ( --probe_depth >= PROBE_DEPTH ){
+        return;
+    }
+    spent = probe_now() - probe_stack[probe_depth].start;
+    probe_cost[stage] += spent - probe_stack[probe_depth].nested;
+    probe_seen |= 1u << stage;
+    if ( probe_depth > 0 ){
+        probe_stack[probe_depth - 1].nested += spent;
+    }
+}
+
+/* the stage of the body decoder of a command, by the file it lives in */
+static inline enum probe_stage probe_body_stage(u_char netfn, u_char cmd) {
+    if ( netfn == NETFN_APP && cmd >= GET_CHAN_AUTH && cmd <= CLOSE_SESSION ){
+        return PROBE_SESSION;
+    }
+    if ( (netfn == NETFN_STOR && cmd >= GET_SDR_REPINFO && cmd <= GET_SDR)
+            || (netfn == NETFN_SEVT && (cmd == GET_SENSOR_READING || cmd == GET_SENSOR_THRESHOLD)) ){
+        return PROBE_SDR;
+    }
+    return PROBE_CMD;
+}
+
+void probe_packet_start(void);
+void probe_packet_end(void);
+void probe_dump(FILE *f);
+
+#define PROBE_ENTER()               probe_enter()
+#define PROBE_LEAVE(stage)          probe_leave(stage)
+/* leave a stage and enter the next one at the same level */
+#define PROBE_NEXT(stage)           do { probe_leave(stage); probe_enter(); } while ( 0 )
+#define PROBE_SET_CMD(netfn, cmd)   (probe_cmd = ((netfn) >> 1) << 8 | (cmd))
+#define PROBE_BODY_STAGE(netfn, cmd)    probe_body_stage(netfn, cmd)
+
+#else
+
+#define PROBE_ENTER()
+#define PROBE_LEAVE(stage)
+#define PROBE_NEXT(stage)
+#define PROBE_SET_CMD(netfn, cmd)
+#define probe_packet_start()
+#define probe_packet_end()
+#define probe_dump(f)
+
+#endif
+
+#endif
@@ -4,9 +4,13 @@
  */
 #include <stdio.h>
 #include <sys/types.h>
+#include <arpa/inet.h>
 
 #include "align.h"
 #include "dump.h"
+#include "output.h"
+#include "stats.h"
+#include "probe.h"
 
 /* section 13.6 */
 struct rmcp_header {
@@ -34,13 +38,20 @@ struct asf_header {
 extern void print_ipmi(const u_char *payload, int payload_len, enum dump_level dl);
 
 static void print_asf(const u_char *payload, int payload_len, enum dump_level dl);
+const char* asf_get_message_type_str(u_char message_type);
+
+static struct out_label asf_message_type_labels[256];
+
+__attribute__((constructor)) static void rmcp_labels_init(void) {
+    out_labels_init(asf_message_type_labels, 256, asf_get_message_type_str);
+}
 
 /*
  * parse and print rmcp payload
  *
  * @payload: the raw udp payload(without udp header)
  * @payload_len: the payload valid length
- * @dump_level: to determine what level should be print, rmcp? asf? ipmi?
+ * @dump_level: the deepest layer to decode, nothing past it is parsed or printed
  *
  */ 
 
@@ -50,38 +61,54 @@ void print_rmcp(const u_char *payload, int payload_len, enum dump_level dl) {
 
     /* must check whether the payload is a valid rmcp packet */
     if ( payload_len < sizeof(struct rmcp_header) ) {
-        fprintf(stderr, "Invalid rmcp: length is too small\n");
+        DUMP_INVALID("Invalid rmcp: length is too small\n");
         return;
     }
 
     rmcp_h = (struct rmcp_header *)payload;
 
     if ( rmcp_h->rmcp_v != 0x06 ) {
-        fprintf(stderr, "Invalid rmcp ASF version: only support 2.0(0x06), but got 0x%02x\n", payload[0]);
+        DUMP_INVALID("Invalid rmcp ASF version: only support 2.0(0x06), but got 0x%02x\n", payload[0]);
         return;
     }
 
     if ( rmcp_h->rmcp_sn != 0xff ) {
-        fprintf(stderr, "Invalid rmcp sequence number: only support ipmi(0xff), but got 0x%02x\n", payload[2]);
+        DUMP_INVALID("Invalid rmcp sequence number: only support ipmi(0xff), but got 0x%02x\n", payload[2]);
         return;
     }
 
     if ( rmcp_h->rmcp_class != RMCP_CLASS_ASF && rmcp_h->rmcp_class != RMCP_CLASS_IPMI ) {
-        fprintf(stderr, "Invalid rmcp class: only support ASF(0x%02x) and IPMI(0x%02x), but got 0x%02x\n", RMCP_CLASS_ASF, RMCP_CLASS_IPMI, rmcp_h->rmcp_class);
+        DUMP_INVALID("Invalid rmcp class: only support ASF(0x%02x) and IPMI(0x%02x), but got 0x%02x\n", RMCP_CLASS_ASF, RMCP_CLASS_IPMI, rmcp_h->rmcp_class);
         return;
     }
 
-    if ( dl <= DL_RMCP ){
-        printf("  [RMCP] ASF Version: 2.0\n");
-        printf("  [RMCP] SN: IPMI\n");
-        printf("  [RMCP] Class(%lu): %s(0x%02x)\n", sizeof(rmcp_h->rmcp_class), rmcp_h->rmcp_class == RMCP_CLASS_ASF ? "ASF" : "IPMI", rmcp_h->rmcp_class);
+    if ( dump_stats ){
+        stats_rmcp_class(rmcp_h->rmcp_class);
+    }
+    else if ( dl >= DL_RMCP ){
+        if ( rmcp_h->rmcp_class == RMCP_CLASS_ASF ){
+            OUT_LIT("  [RMCP] ASF Version: 2.0\n"
+                    "  [RMCP] SN: IPMI\n"
+                    "  [RMCP] Class(1): ASF(0x06)\n");
+        }
+        else {
+            OUT_LIT("  [RMCP] ASF Version: 2.0\n"
+                    "  [RMCP] SN: IPMI\n"
+                    "  [RMCP] Class(1): IPMI(0x07)\n");
+        }
     }
 
     if ( rmcp_h->rmcp_class == RMCP_CLASS_ASF ) {
-        print_asf( payload + sizeof(struct rmcp_header) , payload_len - sizeof(struct rmcp_header), dl );
+        if ( dl >= DL_ASF ){
+            PROBE_ENTER();
+            print_asf( payload + sizeof(struct rmcp_header) , payload_len - sizeof(struct rmcp_header), dl );
+            PROBE_LEAVE(PROBE_ASF);
+        }
     }
-    else {
+    else if ( dl >= DL_IPMI_HEADER ) {
+        PROBE_ENTER();
         print_ipmi( payload + sizeof(struct rmcp_header) , payload_len - sizeof(struct rmcp_header), dl );
+        PROBE_LEAVE(PROBE_IPMI);
     }
 
 }
@@ -104,31 +131,34 @@ const char* asf_get_message_type_str(u_char message_type) {
  *
  * @payload: the raw payload(without rmcp header)
  * @payload_len: the payload valid length
- * @dump_level: to determine what level should be print, rmcp? asf? ipmi?
+ * @dump_level: the deepest layer to decode, nothing past it is parsed or printed
  *
  */ 
 static void print_asf(const u_char *payload, int payload_len, enum dump_level dl){
     struct asf_header *asf_h;
 
     if ( payload_len < sizeof(struct asf_header) ) {
-        fprintf(stderr, "Invalid asf: length is too small\n");
+        DUMP_INVALID("Invalid asf: length is too small\n");
         return;
     }
 
     asf_h = (struct asf_header *) payload;
     if ( ntohl(asf_h->asf_iana) != ASF_IANA ){
-        fprintf(stderr, "Invalid asf IANA which must be 0x000011be\n");
+        DUMP_INVALID("Invalid asf IANA which must be 0x000011be\n");
         return;
     }
 
     if ( asf_h->asf_mtype != ASF_MESSAGE_TYPE_PING 
             && asf_h->asf_mtype != ASF_MESSAGE_TYPE_PONG ) {
-       fprintf(stderr, "Invalid asf message type, only support 0x%02x,0x%02x", ASF_MESSAGE_TYPE_PING, ASF_MESSAGE_TYPE_PONG);
+       DUMP_INVALID("Invalid asf message type, only support 0x%02x,0x%02x", ASF_MESSAGE_TYPE_PING, ASF_MESSAGE_TYPE_PONG);
     }
 
-    if ( dl <= DL_ASF ) {
-        printf("  [ASF] Message Type: %s(0x%02x)\n", asf_get_message_type_str(asf_h->asf_mtype), asf_h->asf_mtype);
-        printf("  [ASF] Message Tag: 0x%02x\n", asf_h->asf_mtag);
+    if ( dl >= DL_ASF && !dump_stats ) {
+        OUT_LIT("  [ASF] Message Type: ");
+        out_label(&asf_message_type_labels[asf_h->asf_mtype]);
+        OUT_LIT("\n  [ASF] Message Tag: ");
+        out_hex8(asf_h->asf_mtag);
+        out_char('\n');
     }
 }
 
@@ -0,0 +1,378 @@
+/*
+ * on disk cache of the SDR records, see sdr_cache.h
+ *
+ * the decoding threads share the file, every access holds the lock: records
+ * are only loaded on the first sight of a BMC and saved when one completes,
+ * both far less often than packets. an entry is written before the table
+ * points to it and before the header counts it, an ipmidump killed halfway
+ * leaves the former state
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/file.h>
+
+#include "dump.h"
+#include "sdr_store.h"
+#include "sdr_cache.h"
+
+#define SDR_CACHE_MAGIC     0x314344534d504949ull      /* "IIPMSDC1" */
+#define SDR_CACHE_VERSION   2
+#define SDR_CACHE_BMC_BITS  18
+#define SDR_CACHE_MIN_LOG   (1 << 20)
+
+struct sdr_cache_header {
+    u_int64_t       magic;
+    u_int32_t       version;
+    u_int32_t       bmc_bits;
+    u_int64_t       used;       /* bytes of the file in use, the next entry goes there */
+    u_int32_t       bmcs;       /* slots of the table in use */
+    u_int32_t       pad;
+};
+
+/* a BMC and the last Get SDR Repository Info seen from it */
+struct sdr_cache_slot {
+    u_int64_t       key;        /* DUMP_BMC_KEY */
+    u_int64_t       head;       /* offset of the newest entry of the BMC, 0 for none */
+    u_int32_t       add_ts;
+    u_int32_t       del_ts;
+    u_short         rec_count;
+    u_char          has_ts;
+    u_char          used;       /* 0 for a free slot */
+    u_int32_t       pad;
+};
+
+/*
+ * a record stays valid while the deletion timestamp does not move, an
+ * addition keeps the records read before it
+ */
+struct sdr_cache_entry {
+    u_int64_t       prev;       /* offset of the former entry of the BMC, 0 for none */
+    u_int32_t       del_ts;     /* deletion timestamp of the repository when the record was read */
+    u_short         rec_id;
+    u_char          has_ts;
+    u_char          rec_len;
+    u_char          raw[];      /* 5 bytes of header then rec_len bytes of body */
+};
+
+#define ENTRY_SIZE(rec_len)     ((sizeof(struct sdr_cache_entry) + 5 + (rec_len) + 7) & ~(size_t)7)
+#define TABLE_OFFSET            sizeof(struct sdr_cache_header)
+#define LOG_OFFSET              (TABLE_OFFSET + ((size_t)1 << SDR_CACHE_BMC_BITS) * sizeof(struct sdr_cache_slot))
+
+static struct {
+    pthread_mutex_t         lock;
+    int                     fd;
+    u_char                  *base;      /* NULL when there is no cache */
+    size_t                  size;       /* bytes mapped, the size of the file */
+    int                     full;       /* the table is full, warned once */
+} cache = { PTHREAD_MUTEX_INITIALIZER, -1, NULL, 0, 0 };
+
+#define HEADER()                ((struct sdr_cache_header *)cache.base)
+#define ENTRY(off)              ((struct sdr_cache_entry *)(cache.base + (off)))
+
+static inline u_int32_t cache_slot(u_int64_t key) {
+    return (u_int32_t)((key * 0x9e3779b97f4a7c15ull) >> (64 - SDR_CACHE_BMC_BITS));
+}
+
+/* the slot of key, a free one for it when add, NULL when not found or the table is 3/4 full */
+static struct sdr_cache_slot* slot_find(u_int64_t key, int add) {
+    struct sdr_cache_slot *table = (struct sdr_cache_slot *)(cache.base + TABLE_OFFSET);
+    u_int32_t mask = (1u << SDR_CACHE_BMC_BITS) - 1, i, n;
+
+    /* bounded, a damaged file may have every slot used */
+    for ( i = cache_slot(key), n = 0; table[i].used; i = (i + 1) & mask ){
+        if ( table[i].key == key ){
+            return &table[i];
+        }
+        if ( ++n > mask ){
+            return NULL;
+        }
+    }
+    if ( !add || (HEADER()->bmcs + 1) * 4 > (1u << SDR_CACHE_BMC_BITS) * 3 ){
+        return NULL;
+    }
+    return &table[i];
+}
+
+static inline int entry_same_repo(const struct sdr_cache_entry *e, const struct sdr_repo *repo) {
+    return e->has_ts == repo->has_ts && e->del_ts == repo->del_ts;
+}
+
+/* the entry at off, NULL when off is not a whole entry of the log, the file may be damaged */
+static struct sdr_cache_entry* entry_at(u_int64_t off) {
+    u_int64_t used = HEADER()->used;
+
+    if ( off < LOG_OFFSET || (off & 7) || off + sizeof(struct sdr_cache_entry) > used
+            || off + ENTRY_SIZE(ENTRY(off)->rec_len) > used ){
+        return NULL;
+    }
+    return ENTRY(off);
+}
+
+/* the former entry of the chain, entries only point back so a damaged one ends it instead of looping */
+static inline u_int64_t entry_prev(const struct sdr_cache_entry *e, u_int64_t off) {
+    return e->prev < off ? e->prev : 0;
+}
+
+/* the newest entry of a record of the repository, 0 for none */
+static u_int64_t entry_find(const struct sdr_cache_slot *slot, const struct sdr_repo *repo, u_short rec_id) {
+    struct sdr_cache_entry *e;
+    u_int64_t off;
+
+    for ( off = slot->head; (e = entry_at(off)) != NULL; off = entry_prev(e, off) ){
+        if ( e->rec_id == rec_id && entry_same_repo(e, repo) ){
+            return off;
+        }
+    }
+    return 0;
+}
+
+/*
+ * make the file and the mapping size bytes, the blocks reserved: a store to
+ * a hole of a shared mapping on a full filesystem would be a SIGBUS
+ */
+static int cache_map(size_t size) {
+    u_char *base;
+    int err;
+
+    err = posix_fallocate(cache.fd, 0, size);
+    if ( err != 0 ){
+        errno = err;
+        return -1;
+    }
+    base = (u_char *)mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, cache.fd, 0);
+    if ( base == MAP_FAILED ){
+        return -1;
+    }
+    if ( cache.base != NULL ){
+        munmap(cache.base, cache.size);
+    }
+    cache.base = base;
+    cache.size = size;
+    return 0;
+}
+
+/*
+ * open or create the cache file, the records are read lazily by sdr_cache_load
+ *
+ * @path: the cache file
+ *
+ * return -1 with errno set, EINVAL for a file that is not a cache of this
+ * version, EWOULDBLOCK for a cache another ipmidump has open
+ */
+int sdr_cache_open(const char *path) {
+    struct sdr_cache_header *hdr;
+    struct stat st;
+
+    cache.fd = open(path, O_RDWR | O_CREAT, 0644);
+    if ( cache.fd == -1 ){
+        return -1;
+    }
+    if ( flock(cache.fd, LOCK_EX | LOCK_NB) == -1 || fstat(cache.fd, &st) == -1 ){
+        goto fail;
+    }
+
+    if ( st.st_size == 0 ){
+        if ( cache_map(LOG_OFFSET + SDR_CACHE_MIN_LOG) == -1 ){
+            goto fail;
+        }
+        hdr = HEADER();
+        hdr->version = SDR_CACHE_VERSION;
+        hdr->bmc_bits = SDR_CACHE_BMC_BITS;
+        hdr->used = LOG_OFFSET;
+        hdr->magic = SDR_CACHE_MAGIC;
+        return 0;
+    }
+
+    if ( (size_t)st.st_size < LOG_OFFSET ){
+        errno = EINVAL;
+        goto fail;
+    }
+    /* a file of an older run may still have holes */
+    if ( cache_map(st.st_size) == -1 ){
+        goto fail;
+    }
+    hdr = HEADER();
+    if ( hdr->magic != SDR_CACHE_MAGIC || hdr->version != SDR_CACHE_VERSION || hdr->bmc_bits != SDR_CACHE_BMC_BITS
+            || hdr->used < LOG_OFFSET || hdr->used > cache.size ){
+        munmap(cache.base, cache.size);
+        cache.base = NULL;
+        errno = EINVAL;
+        goto fail;
+    }
+    return 0;
+
+fail:
+    close(cache.fd);
+    cache.fd = -1;
+    return -1;
+}
+
+/* a free slot of the table for key */
+static void slot_take(struct sdr_cache_slot *slot, u_int64_t key) {
+    if ( !slot->used ){
+        slot->key = key;
+        slot->head = 0;
+        slot->has_ts = 0;
+        slot->used = 1;
+        HEADER()->bmcs++;
+    }
+}
+
+/*
+ * fill the repo of a BMC just seen from the cache, with the repository info
+ * last seen from it and the records still valid for it
+ *
+ * @bmc: a BMC without records
+ *
+ */
+void sdr_cache_load(struct sdr_bmc *bmc) {
+    struct sdr_repo *repo = &bmc->repo;
+    struct sdr_cache_slot *slot;
+    struct sdr_cache_entry *e;
+    struct sdr_record *record;
+    u_int64_t off;
+
+    if ( cache.base == NULL ){
+        return;
+    }
+    pthread_mutex_lock(&cache.lock);
+    slot = slot_find(bmc->key, 0);
+    if ( slot == NULL ){
+        pthread_mutex_unlock(&cache.lock);
+        return;
+    }
+
+    repo->add_ts = slot->add_ts;
+    repo->del_ts = slot->del_ts;
+    repo->rec_count = slot->rec_count;
+    repo->has_ts = slot->has_ts;
+    for ( off = slot->head; (e = entry_at(off)) != NULL; off = entry_prev(e, off) ){
+        if ( !entry_same_repo(e, repo) ){
+            continue;
+        }
+        /* a record saved again, the newest copy was taken */
+        if ( sdr_record_find(repo, e->rec_id) != NULL ){
+            continue;
+        }
+        record = sdr_record_add(repo, e->rec_id);
+        sdr_record_alloc_raw(repo, record, e->rec_len);
+        memcpy(record->raw, e->raw, 5 + e->rec_len);
+        record->sdr_rec_type = e->raw[3];
+        record->sdr_cache_off = off;
+        sdr_record_done(repo, record);
+        ipmi_sdr_record_ready(repo, record);
+    }
+    pthread_mutex_unlock(&cache.lock);
+    sdr_bmc_share(bmc);
+}
+
+/*
+ * append a complete record, unless the cache already has the same bytes for
+ * the same repository
+ *
+ * @bmc: the BMC of the record
+ * @record: a record read without a gap
+ *
+ */
+void sdr_cache_save(const struct sdr_bmc *bmc, struct sdr_record *record) {
+    const struct sdr_repo *repo = &bmc->repo;
+    struct sdr_cache_slot *slot;
+    struct sdr_cache_entry *e;
+    size_t size = ENTRY_SIZE(record->sdr_rec_len);
+    u_int64_t off;
+
+    if ( cache.base == NULL ){
+        return;
+    }
+    pthread_mutex_lock(&cache.lock);
+    off = record->sdr_cache_off;
+    if ( off == 0 && (slot = slot_find(bmc->key, 0)) != NULL ){
+        /* read again after the repo was dropped, the cache may have it */
+        off = entry_find(slot, repo, record->sdr_rec_id);
+    }
+    if ( off != 0 ){
+        e = ENTRY(off);
+        if ( e->rec_len == record->sdr_rec_len && entry_same_repo(e, repo) && memcmp(e->raw, record->raw, 5 + e->rec_len) == 0 ){
+            record->sdr_cache_off = off;
+            pthread_mutex_unlock(&cache.lock);
+            return;
+        }
+    }
+
+    slot = slot_find(bmc->key, 1);
+    if ( slot == NULL ){
+        if ( !cache.full ){
+            fprintf(stderr, "SDR cache: no room for more BMCs, the records of new ones are not saved\n");
+            cache.full = 1;
+        }
+        pthread_mutex_unlock(&cache.lock);
+        return;
+    }
+    off = HEADER()->used;
+    if ( off + size > cache.size && cache_map(cache.size * 2) == -1 ){
+        if ( !cache.full ){
+            fprintf(stderr, "SDR cache: couldn't grow the file: %s\n", strerror(errno));
+            cache.full = 1;
+        }
+        pthread_mutex_unlock(&cache.lock);
+        return;
+    }
+    /* the mapping may have moved */
+    slot = slot_find(bmc->key, 1);
+
+    slot_take(slot, bmc->key);
+    e = ENTRY(off);
+    e->prev = slot->head;
+    e->del_ts = repo->del_ts;
+    e->rec_id = record->sdr_rec_id;
+    e->has_ts = repo->has_ts;
+    e->rec_len = record->sdr_rec_len;
+    memcpy(e->raw, record->raw, 5 + record->sdr_rec_len);
+    slot->head = off;
+    HEADER()->used = off + size;
+    record->sdr_cache_off = off;
+    pthread_mutex_unlock(&cache.lock);
+}
+
+/*
+ * keep the repository info of a BMC, after it changed: the next run checks
+ * the info it sees against it
+ *
+ * @bmc: the BMC, its records already dropped when the deletion timestamp moved
+ *
+ */
+void sdr_cache_tag(const struct sdr_bmc *bmc) {
+    struct sdr_cache_slot *slot;
+
+    if ( cache.base == NULL ){
+        return;
+    }
+    pthread_mutex_lock(&cache.lock);
+    slot = slot_find(bmc->key, 1);
+    if ( slot != NULL ){
+        slot_take(slot, bmc->key);
+        slot->add_ts = bmc->repo.add_ts;
+        slot->del_ts = bmc->repo.del_ts;
+        slot->rec_count = bmc->repo.rec_count;
+        slot->has_ts = bmc->repo.has_ts;
+    }
+    pthread_mutex_unlock(&cache.lock);
+}
+
+void sdr_cache_close(void) {
+    if ( cache.base == NULL ){
+        return;
+    }
+    munmap(cache.base, cache.size);
+    close(cache.fd);
+    cache.base = NULL;
+    cache.fd = -1;
+}
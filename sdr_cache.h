@@ -0,0 +1,31 @@
+#ifndef _IPMI_DUMP_SDR_CACHE_H
+#define _IPMI_DUMP_SDR_CACHE_H
+
+#include <sys/types.h>
+
+#include "sdr_store.h"
+
+/*
+ * SDR records kept on disk across runs(-C), so the readings of a BMC are
+ * converted from its first packet instead of after its next SDR walk
+ *
+ * the file is mapped in memory: a header, an open addressing table of BMCs
+ * (DUMP_BMC_KEY, fibonacci hashing) and a log of the complete records. the
+ * table keeps the last Get SDR Repository Info of every BMC and points to its
+ * newest record, every record is appended with the deletion timestamp of its
+ * repository and linked to the former record of the same BMC.
+ * nothing is read at startup, the records of a BMC are loaded the first time
+ * the BMC is seen, from the newest back, the ones read before the last
+ * deletion are skipped
+ */
+
+int sdr_cache_open(const char *path);
+void sdr_cache_load(struct sdr_bmc *bmc);
+void sdr_cache_save(const struct sdr_bmc *bmc, struct sdr_record *record);
+void sdr_cache_tag(const struct sdr_bmc *bmc);
+void sdr_cache_close(void);
+
+/* ipmi_sdr.c: index a complete record by sensor and build its conversion table */
+void ipmi_sdr_record_ready(struct sdr_repo *repo, struct sdr_record *record);
+
+#endif
@@ -0,0 +1,171 @@
+/*
+ * ipmitool compatible SDR dumps of the BMCs(-D), see sdr_export.h
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <arpa/inet.h>
+
+#include "dump.h"
+#include "sdr_store.h"
+#include "sdr_export.h"
+
+#define EXPORT_RMCP_PORT    623
+
+static const char *export_dir;
+
+/* every decoding thread writes the dumps of its own BMCs */
+static DUMP_TLS struct sdr_bmc *dirty;
+static DUMP_TLS time_t next_flush;
+static DUMP_TLS struct sdr_record **list;
+static DUMP_TLS u_int32_t list_size;
+static DUMP_TLS int warned;
+
+/*
+ * write the dumps under dir
+ *
+ * @dir: an existing directory
+ *
+ * return -1 with errno set when dir is not a writable directory
+ */
+int sdr_export_open(const char *dir) {
+    struct stat st;
+
+    if ( stat(dir, &st) == -1 ){
+        return -1;
+    }
+    if ( !S_ISDIR(st.st_mode) ){
+        errno = ENOTDIR;
+        return -1;
+    }
+    if ( access(dir, W_OK) == -1 ){
+        return -1;
+    }
+    export_dir = dir;
+    return 0;
+}
+
+/*
+ * a record of the BMC completed or its records were dropped, its dump is
+ * written on the next flush
+ */
+void sdr_export_mark(struct sdr_bmc *bmc) {
+    if ( export_dir == NULL || bmc->export_dirty ){
+        return;
+    }
+    bmc->export_dirty = 1;
+    bmc->export_next = dirty;
+    dirty = bmc;
+}
+
+static int record_cmp(const void *a, const void *b) {
+    return (int)(*(struct sdr_record * const *)a)->sdr_rec_id - (int)(*(struct sdr_record * const *)b)->sdr_rec_id;
+}
+
+static void export_warn(const char *path) {
+    if ( !warned ){
+        fprintf(stderr, "Couldn't write SDR dump %s: %s\n", path, strerror(errno));
+        warned = 1;
+    }
+}
+
+/* the records read without a gap, by record id */
+static u_int32_t export_records(const struct sdr_repo *repo) {
+    struct sdr_record *r;
+    u_int32_t n, complete = 0, i;
+
+    if ( repo->nrecords > list_size ){
+        free(list);
+        list_size = repo->nrecords * 2;
+        list = (struct sdr_record **)malloc(list_size * sizeof(struct sdr_record *));
+        if ( list == NULL ){
+            fprintf(stderr, "out of memory for SDR dumps\n");
+            exit(1);
+        }
+    }
+    n = sdr_record_list(repo, list);
+    for ( i = 0; i < n; i++ ){
+        r = list[i];
+        if ( r->raw != NULL && !r->sdr_gap ){
+            list[complete++] = r;
+        }
+    }
+    qsort(list, complete, sizeof(struct sdr_record *), record_cmp);
+    return complete;
+}
+
+static void export_write(struct sdr_bmc *bmc) {
+    char path[PATH_MAX], tmp[PATH_MAX + 32], addr[INET_ADDRSTRLEN];
+    struct in_addr in;
+    u_int32_t n, i;
+    FILE *f;
+
+    in.s_addr = (u_int32_t)(bmc->key >> 16);
+    inet_ntop(AF_INET, &in, addr, sizeof(addr));
+    if ( (bmc->key & 0xffff) == EXPORT_RMCP_PORT ){
+        snprintf(path, sizeof(path), "%s/%s.sdr", export_dir, addr);
+    }
+    else {
+        snprintf(path, sizeof(path), "%s/%s_%u.sdr", export_dir, addr, (unsigned int)(bmc->key & 0xffff));
+    }
+
+    n = export_records(sdr_bmc_records(bmc));
+    if ( n == 0 ){
+        /* the repository changed, a former dump is wrong */
+        if ( unlink(path) == -1 && errno != ENOENT ){
+            export_warn(path);
+        }
+        return;
+    }
+    /* a poller reading a partial dump would miss sensors, the last full one stays */
+    if ( !bmc->repo.has_ts || n < bmc->repo.rec_count ){
+        return;
+    }
+
+    snprintf(tmp, sizeof(tmp), "%s.%lx.tmp", path, (unsigned long)pthread_self());
+    f = fopen(tmp, "w");
+    if ( f == NULL ){
+        export_warn(tmp);
+        return;
+    }
+    for ( i = 0; i < n; i++ ){
+        fwrite(list[i]->raw, 1, list[i]->sdr_rec_len + 5, f);
+    }
+    if ( ferror(f) | (fclose(f) != 0) ){
+        export_warn(tmp);
+        unlink(tmp);
+        return;
+    }
+    if ( rename(tmp, path) == -1 ){
+        export_warn(path);
+        unlink(tmp);
+    }
+}
+
+/* write the dumps of the marked BMCs of the thread */
+void sdr_export_flush(void) {
+    struct sdr_bmc *bmc;
+
+    while ( dirty != NULL ){
+        bmc = dirty;
+        dirty = bmc->export_next;
+        bmc->export_next = NULL;
+        bmc->export_dirty = 0;
+        export_write(bmc);
+    }
+}
+
+/* flush at most once a second, from the idle callback of the thread */
+void sdr_export_tick(time_t now) {
+    if ( dirty == NULL || now < next_flush ){
+        return;
+    }
+    next_flush = now + 1;
+    sdr_export_flush();
+}
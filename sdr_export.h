@@ -0,0 +1,27 @@
+#ifndef _IPMI_DUMP_SDR_EXPORT_H
+#define _IPMI_DUMP_SDR_EXPORT_H
+
+#include <time.h>
+
+#include "sdr_store.h"
+
+/*
+ * the SDR records of every BMC written to a directory(-D) as the binary dump
+ * of ipmitool sdr dump, which ipmitool -S reads back instead of walking the
+ * SDR of the BMC
+ *
+ * a dump is the complete records one after the other, each its 5 bytes of
+ * header then its body, named after the BMC address(address_port.sdr when the
+ * port is not 623). a record completing marks its BMC, the marked BMCs of the
+ * thread are written at most once a second and when decoding ends, each to a
+ * temporary file renamed over the former dump, so a reader never sees half a
+ * dump. a dump is only written once every record the BMC announced in Get SDR
+ * Repository Info is read, and removed when the repository drops its records
+ */
+
+int sdr_export_open(const char *dir);
+void sdr_export_mark(struct sdr_bmc *bmc);
+void sdr_export_tick(time_t now);
+void sdr_export_flush(void);
+
+#endif
@@ -0,0 +1,192 @@
+/*
+ * SDR records being reassembled, see sdr_partial.h
+ *
+ * linear probing with the entries after a removed one shifted back, like the
+ * pending requests of ipmi_corr.c
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include "dump.h"
+#include "sdr_partial.h"
+
+#define PARTIAL_MASK        (SDR_PARTIAL_SLOTS - 1)
+#define PARTIAL_MAX_USED    (SDR_PARTIAL_SLOTS / 4 * 3)
+
+/* the reads of a record come on one udp flow, decoded by one thread */
+static DUMP_TLS struct sdr_partial *partials;
+static DUMP_TLS u_int32_t partial_count;
+static DUMP_TLS time_t next_sweep;
+
+static inline u_int32_t partial_slot(u_int64_t bmc, unsigned short rec_id) {
+    return (u_int32_t)(((bmc ^ (u_int64_t)rec_id << 48) * 0x9e3779b97f4a7c15ull) >> 40) & PARTIAL_MASK;
+}
+
+/* slot of the record, or the free slot ending its cluster */
+static u_int32_t partial_find(u_int64_t bmc, unsigned short rec_id) {
+    u_int32_t i;
+
+    for ( i = partial_slot(bmc, rec_id); partials[i].used; i = (i + 1) & PARTIAL_MASK ){
+        if ( partials[i].bmc == bmc && partials[i].rec_id == rec_id ){
+            break;
+        }
+    }
+    return i;
+}
+
+/* free slot i, the entries after it move back when their home slot allows */
+static void partial_remove(u_int32_t i) {
+    u_int32_t j, home;
+
+    for ( j = (i + 1) & PARTIAL_MASK; partials[j].used; j = (j + 1) & PARTIAL_MASK ){
+        home = partial_slot(partials[j].bmc, partials[j].rec_id);
+        /* the entry can fill i unless its home lies cyclically in (i, j] */
+        if ( ((j - home) & PARTIAL_MASK) >= ((j - i) & PARTIAL_MASK) ){
+            partials[i] = partials[j];
+            i = j;
+        }
+    }
+    partials[i].used = 0;
+    partial_count--;
+}
+
+/* drop the records no read came for in SDR_PARTIAL_TIMEOUT */
+static void partial_expire(time_t now) {
+    u_int32_t i = 0;
+
+    while ( i < SDR_PARTIAL_SLOTS ){
+        if ( partials[i].used && partials[i].ts + SDR_PARTIAL_TIMEOUT < now ){
+            dump_cnt.sdr_stale++;
+            /* an entry from further may move into i, look at i again */
+            partial_remove(i);
+            continue;
+        }
+        i++;
+    }
+    next_sweep = now + 1;
+}
+
+/*
+ * the buffer of a record being read, a new one for the first read of it
+ *
+ * @bmc: DUMP_BMC_KEY of the BMC
+ * @rec_id: the record
+ * @now: capture time of the read
+ *
+ * return NULL when the table is full of records read in the last
+ * SDR_PARTIAL_TIMEOUT, the pointer is valid until the next call
+ */
+struct sdr_partial* sdr_partial_get(u_int64_t bmc, unsigned short rec_id, time_t now) {
+    struct sdr_partial *p;
+    u_int32_t i;
+
+    if ( partials == NULL ){
+        partials = (struct sdr_partial *)calloc(SDR_PARTIAL_SLOTS, sizeof(struct sdr_partial));
+        if ( partials == NULL ){
+            fprintf(stderr, "out of memory for SDR reassembly\n");
+            exit(1);
+        }
+        next_sweep = now + 1;
+    }
+    /* at most once a second, like the sweep of the pending requests */
+    if ( now >= next_sweep ){
+        partial_expire(now);
+    }
+
+    i = partial_find(bmc, rec_id);
+    p = &partials[i];
+    if ( !p->used ){
+        if ( partial_count >= PARTIAL_MAX_USED ){
+            return NULL;
+        }
+        memset(p, 0, sizeof(struct sdr_partial));
+        p->used = 1;
+        p->bmc = bmc;
+        p->rec_id = rec_id;
+        partial_count++;
+    }
+    p->ts = now;
+    return p;
+}
+
+/* mark [from, to) received, return how many of those bytes were not yet */
+static u_int32_t bits_set(u_int64_t *got, u_int32_t from, u_int32_t to) {
+    u_int32_t fresh = 0, n;
+    u_int64_t mask;
+
+    while ( from < to ){
+        n = 64 - (from & 63);
+        if ( n > to - from ){
+            n = to - from;
+        }
+        mask = (n == 64 ? ~0ull : (1ull << n) - 1) << (from & 63);
+        fresh += __builtin_popcountll(mask & ~got[from >> 6]);
+        got[from >> 6] |= mask;
+        from += n;
+    }
+    return fresh;
+}
+
+/* the header is all there and tells the length, the bytes received past it are not of the record */
+static void partial_header(struct sdr_partial *p) {
+    u_int32_t end, i;
+
+    p->header = 1;
+    p->len = p->raw[4];
+    end = p->len + 5;
+    if ( end & 63 ){
+        p->got[end >> 6] &= (1ull << (end & 63)) - 1;
+    }
+    for ( i = (end + 63) >> 6; i < SDR_PARTIAL_WORDS; i++ ){
+        p->got[i] = 0;
+    }
+    p->have = 0;
+    for ( i = 0; i < SDR_PARTIAL_WORDS; i++ ){
+        p->have += __builtin_popcountll(p->got[i]);
+    }
+}
+
+/*
+ * copy a read at its offset in the record, bytes past the record are dropped
+ *
+ * @p: the record
+ * @offset: offset of the read in the record, header included
+ * @data: the bytes read
+ * @len: how many
+ *
+ * return the bytes copied
+ */
+int sdr_partial_add(struct sdr_partial *p, int offset, const u_char *data, int len) {
+    int end = p->header ? p->len + 5 : SDR_RAW_MAX;
+
+    if ( p->header && offset <= 4 && offset + len > 4 && data[4 - offset] != p->len ){
+        /* the record changed between two reads, what was read is of the former one */
+        memset(p->got, 0, sizeof(p->got));
+        p->have = 0;
+        p->header = 0;
+        end = SDR_RAW_MAX;
+    }
+    if ( len > end - offset ){
+        len = end - offset;
+    }
+    if ( len <= 0 ){
+        return 0;
+    }
+    memcpy(&p->raw[offset], data, len);
+    p->have += bits_set(p->got, offset, offset + len);
+    /* in one read or several, in any order */
+    if ( !p->header && (p->got[0] & 0x1f) == 0x1f ){
+        partial_header(p);
+        if ( offset + len > p->len + 5 ){
+            len = p->len + 5 - offset;
+        }
+    }
+    return len > 0 ? len : 0;
+}
+
+/* the record is complete or given up, its slot is free */
+void sdr_partial_release(struct sdr_partial *p) {
+    partial_remove((u_int32_t)(p - partials));
+}
@@ -0,0 +1,42 @@
+#ifndef _IPMI_DUMP_SDR_PARTIAL_H
+#define _IPMI_DUMP_SDR_PARTIAL_H
+
+#include <sys/types.h>
+#include <time.h>
+
+/*
+ * SDR records being reassembled from the partial reads of Get SDR
+ *
+ * a record being read is a buffer of the decoding thread found by BMC and
+ * record id in a bounded open addressing table, so the reads of many BMCs and
+ * records interleave freely. every read is copied at its offset and marked in
+ * a bitmap of the bytes received: duplicated, retransmitted and reordered
+ * reads only fill what is missing, and the record is complete when the count
+ * of bytes received reaches the length of its header, in O(1). a record left
+ * untouched for SDR_PARTIAL_TIMEOUT seconds(of capture time) is dropped
+ */
+
+#define SDR_PARTIAL_SLOTS   1024    /* records being read per decoding thread, at most 3/4 used */
+#define SDR_PARTIAL_TIMEOUT 30
+#define SDR_RAW_MAX         (5 + 255)   /* header and the longest body */
+#define SDR_PARTIAL_WORDS   ((SDR_RAW_MAX + 63) / 64)
+
+struct sdr_partial {
+    u_int64_t       bmc;            /* DUMP_BMC_KEY */
+    unsigned short  rec_id;
+    unsigned short  have;           /* bytes received, within the record once the header is */
+    u_char          used;
+    u_char          header;         /* the header was received, len is known */
+    u_char          len;            /* body length from the header */
+    time_t          ts;             /* capture time of the last read */
+    u_int64_t       got[SDR_PARTIAL_WORDS];     /* bit i: raw[i] was received */
+    u_char          raw[SDR_RAW_MAX];
+};
+
+#define SDR_PARTIAL_COMPLETE(p)     ((p)->header && (p)->have == (p)->len + 5)
+
+struct sdr_partial* sdr_partial_get(u_int64_t bmc, unsigned short rec_id, time_t now);
+int sdr_partial_add(struct sdr_partial *p, int offset, const u_char *data, int len);
+void sdr_partial_release(struct sdr_partial *p);
+
+#endif
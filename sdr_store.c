@@ -0,0 +1,584 @@
+/*
+ * per BMC store of SDR records, indexed with open addressing(linear probing)
+ *
+ * nothing is ever removed from an index one entry at a time, a repo is only
+ * dropped as a whole. so there are no tombstones and a probe stops at the
+ * first slot that is not of the current generation
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <arpa/inet.h>
+
+#include "dump.h"
+#include "sdr_store.h"
+#include "sdr_cache.h"
+#include "sensor_conv.h"
+
+#define INDEX_MIN_BITS      4
+#define BMC_MIN_BITS        6
+#define SET_MIN_BITS        4
+#define CHUNK_MIN_SIZE      4096
+#define CHUNK_MAX_SIZE      65536
+
+/*
+ * every decoding thread keeps the BMCs it decodes, see bmc_shard of main.c. a
+ * live -j shards by udp flow, so a BMC polled by several clients may be kept by
+ * several threads
+ */
+static DUMP_TLS struct sdr_bmc **bmcs;
+static DUMP_TLS u_int32_t bmc_count;
+static DUMP_TLS u_char bmc_bits;
+
+/* the shared repositories of the thread, by hash of their records */
+static DUMP_TLS struct sdr_set **sets;
+static DUMP_TLS u_int32_t set_count;
+static DUMP_TLS u_char set_bits;
+
+/* records sorted by id, of the repo being shared and of a set it is compared to */
+struct record_list {
+    struct sdr_record   **records;
+    u_int32_t           size;
+};
+static DUMP_TLS struct record_list own_list, set_list;
+
+static void* sdr_calloc(size_t n, size_t size) {
+    void *p = calloc(n, size);
+
+    if ( p == NULL ){
+        fprintf(stderr, "out of memory for SDR records\n");
+        exit(1);
+    }
+    return p;
+}
+
+/*
+ * bump allocation from the chunks of the arena
+ */
+static void* arena_alloc(struct sdr_arena *arena, size_t n) {
+    struct sdr_chunk *chunk;
+    size_t size;
+    void *p;
+
+    n = (n + 7) & ~(size_t)7;
+    if ( arena->cur == NULL || arena->pos + n > arena->cur->size ){
+        if ( arena->cur != NULL && arena->cur->next != NULL && n <= arena->cur->next->size ){
+            /* rewound by a reset, reuse the next chunk */
+            arena->cur = arena->cur->next;
+        }
+        else {
+            size = arena->cur == NULL ? CHUNK_MIN_SIZE : arena->cur->size * 2;
+            if ( size > CHUNK_MAX_SIZE ){
+                size = CHUNK_MAX_SIZE;
+            }
+            if ( size < n ){
+                size = n;
+            }
+            chunk = (struct sdr_chunk *)sdr_calloc(1, sizeof(struct sdr_chunk) + size);
+            chunk->size = size;
+            if ( arena->cur == NULL ){
+                arena->first = chunk;
+            }
+            else {
+                chunk->next = arena->cur->next;
+                arena->cur->next = chunk;
+            }
+            arena->cur = chunk;
+            arena->reserved += size;
+        }
+        arena->pos = 0;
+    }
+
+    p = arena->cur->data + arena->pos;
+    arena->pos += n;
+    arena->used += n;
+    return p;
+}
+
+/* O(1), the chunks are kept for the records to come */
+static void arena_reset(struct sdr_arena *arena) {
+    arena->cur = arena->first;
+    arena->pos = 0;
+    arena->used = 0;
+}
+
+/* give the chunks back, the records of the repo are shared from now on */
+static void arena_free(struct sdr_arena *arena) {
+    struct sdr_chunk *chunk, *next;
+
+    for ( chunk = arena->first; chunk != NULL; chunk = next ){
+        next = chunk->next;
+        free(chunk);
+    }
+    memset(arena, 0, sizeof(struct sdr_arena));
+}
+
+/* fibonacci hashing, the high bits of the product are the well mixed ones */
+static inline u_int32_t index_slot(u_int32_t key, u_char bits) {
+    return (key * 0x9e3779b1u) >> (32 - bits);
+}
+
+static inline u_int32_t bmc_slot(u_int64_t key, u_char bits) {
+    return (u_int32_t)((key * 0x9e3779b97f4a7c15ull) >> (64 - bits));
+}
+
+static struct sdr_record* index_find(const struct sdr_index *idx, u_int32_t key) {
+    u_int32_t mask, i;
+
+    if ( idx->slots == NULL ){
+        return NULL;
+    }
+    mask = (1u << idx->bits) - 1;
+    for ( i = index_slot(key, idx->bits); idx->slots[i].gen == idx->gen; i = (i + 1) & mask ){
+        if ( idx->slots[i].key == key ){
+            return idx->slots[i].val;
+        }
+    }
+    return NULL;
+}
+
+/* keep the load under 1/2, probes stay short */
+static void index_grow(struct sdr_index *idx) {
+    struct sdr_index old = *idx;
+    u_int32_t mask, i, j;
+
+    idx->bits = old.slots == NULL ? INDEX_MIN_BITS : old.bits + 1;
+    idx->slots = (struct sdr_slot *)sdr_calloc((size_t)1 << idx->bits, sizeof(struct sdr_slot));
+    idx->gen = 1;
+    mask = (1u << idx->bits) - 1;
+
+    for ( i = 0; old.slots != NULL && i < (1u << old.bits); i++ ){
+        if ( old.slots[i].gen != old.gen ){
+            continue;
+        }
+        for ( j = index_slot(old.slots[i].key, idx->bits); idx->slots[j].gen == idx->gen; j = (j + 1) & mask );
+        idx->slots[j] = old.slots[i];
+        idx->slots[j].gen = idx->gen;
+    }
+    free(old.slots);
+}
+
+static void index_put(struct sdr_index *idx, u_int32_t key, struct sdr_record *val) {
+    u_int32_t mask, i;
+
+    if ( idx->slots == NULL || (idx->count + 1) * 2 > (1u << idx->bits) ){
+        index_grow(idx);
+    }
+    mask = (1u << idx->bits) - 1;
+    for ( i = index_slot(key, idx->bits); idx->slots[i].gen == idx->gen; i = (i + 1) & mask ){
+        if ( idx->slots[i].key == key ){
+            idx->slots[i].val = val;
+            return;
+        }
+    }
+    idx->slots[i].key = key;
+    idx->slots[i].gen = idx->gen;
+    idx->slots[i].val = val;
+    idx->count++;
+}
+
+/* O(1), every slot of an older generation reads as free */
+static void index_reset(struct sdr_index *idx) {
+    idx->count = 0;
+    if ( ++idx->gen == 0 && idx->slots != NULL ){
+        /* wrapped, a slot written 2^32 resets ago would look live again */
+        memset(idx->slots, 0, ((size_t)1 << idx->bits) * sizeof(struct sdr_slot));
+        idx->gen = 1;
+    }
+}
+
+static void index_free(struct sdr_index *idx) {
+    free(idx->slots);
+    memset(idx, 0, sizeof(struct sdr_index));
+}
+
+/* the records and their memory, the repository info stays */
+static void repo_free(struct sdr_repo *repo) {
+    arena_free(&repo->arena);
+    index_free(&repo->records);
+    index_free(&repo->sensors);
+    repo->nrecords = 0;
+    repo->ndone = 0;
+}
+
+static void bmc_grow(void) {
+    struct sdr_bmc **old = bmcs;
+    u_char old_bits = bmc_bits;
+    u_int32_t mask, i, j;
+
+    bmc_bits = old == NULL ? BMC_MIN_BITS : old_bits + 1;
+    bmcs = (struct sdr_bmc **)sdr_calloc((size_t)1 << bmc_bits, sizeof(struct sdr_bmc *));
+    mask = (1u << bmc_bits) - 1;
+
+    for ( i = 0; old != NULL && i < (1u << old_bits); i++ ){
+        if ( old[i] == NULL ){
+            continue;
+        }
+        for ( j = bmc_slot(old[i]->key, bmc_bits); bmcs[j] != NULL; j = (j + 1) & mask );
+        bmcs[j] = old[i];
+    }
+    free(old);
+}
+
+/*
+ * the BMC of key, created on first sight
+ *
+ * @key: DUMP_BMC_KEY of the BMC side of the packet
+ *
+ */
+struct sdr_bmc* sdr_bmc_get(u_int64_t key) {
+    u_int32_t mask, i;
+
+    if ( bmcs == NULL || (bmc_count + 1) * 2 > (1u << bmc_bits) ){
+        bmc_grow();
+    }
+    mask = (1u << bmc_bits) - 1;
+    for ( i = bmc_slot(key, bmc_bits); bmcs[i] != NULL; i = (i + 1) & mask ){
+        if ( bmcs[i]->key == key ){
+            return bmcs[i];
+        }
+    }
+
+    bmcs[i] = (struct sdr_bmc *)sdr_calloc(1, sizeof(struct sdr_bmc));
+    bmcs[i]->key = key;
+    bmc_count++;
+    /* the records of a former run(-C) */
+    sdr_cache_load(bmcs[i]);
+    return bmcs[i];
+}
+
+static int record_cmp(const void *a, const void *b) {
+    return (int)(*(struct sdr_record * const *)a)->sdr_rec_id - (int)(*(struct sdr_record * const *)b)->sdr_rec_id;
+}
+
+/* the records of repo by id, into list */
+static u_int32_t repo_sorted(const struct sdr_repo *repo, struct record_list *list) {
+    u_int32_t n;
+
+    if ( repo->nrecords > list->size ){
+        free(list->records);
+        list->size = repo->nrecords * 2;
+        list->records = (struct sdr_record **)sdr_calloc(list->size, sizeof(struct sdr_record *));
+    }
+    n = sdr_record_list(repo, list->records);
+    qsort(list->records, n, sizeof(struct sdr_record *), record_cmp);
+    return n;
+}
+
+/* FNV-1a of the bytes of the records in order, the length byte of every header separates them */
+static u_int64_t records_hash(struct sdr_record **records, u_int32_t n) {
+    u_int64_t h = 0xcbf29ce484222325ull;
+    u_int32_t i, j;
+
+    for ( i = 0; i < n; i++ ){
+        for ( j = 0; j < records[i]->sdr_rec_len + 5u; j++ ){
+            h = (h ^ records[i]->raw[j]) * 0x100000001b3ull;
+        }
+    }
+    return h;
+}
+
+static int set_equal(const struct sdr_set *set, struct sdr_record **records, u_int32_t n) {
+    u_int32_t i;
+
+    if ( set->repo.nrecords != n || repo_sorted(&set->repo, &set_list) != n ){
+        return 0;
+    }
+    for ( i = 0; i < n; i++ ){
+        if ( set_list.records[i]->sdr_rec_len != records[i]->sdr_rec_len
+                || memcmp(set_list.records[i]->raw, records[i]->raw, records[i]->sdr_rec_len + 5) != 0 ){
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static void set_grow(void) {
+    struct sdr_set **old = sets;
+    u_char old_bits = set_bits;
+    u_int32_t mask, i, j;
+
+    set_bits = old == NULL ? SET_MIN_BITS : old_bits + 1;
+    sets = (struct sdr_set **)sdr_calloc((size_t)1 << set_bits, sizeof(struct sdr_set *));
+    mask = (1u << set_bits) - 1;
+
+    for ( i = 0; old != NULL && i < (1u << old_bits); i++ ){
+        if ( old[i] == NULL ){
+            continue;
+        }
+        for ( j = bmc_slot(old[i]->hash, set_bits); sets[j] != NULL; j = (j + 1) & mask );
+        sets[j] = old[i];
+    }
+    free(old);
+}
+
+/* the set with the same records, NULL for none */
+static struct sdr_set* set_find(u_int64_t hash, struct sdr_record **records, u_int32_t n) {
+    u_int32_t mask, i;
+
+    if ( sets == NULL ){
+        return NULL;
+    }
+    mask = (1u << set_bits) - 1;
+    for ( i = bmc_slot(hash, set_bits); sets[i] != NULL; i = (i + 1) & mask ){
+        if ( sets[i]->hash == hash && set_equal(sets[i], records, n) ){
+            return sets[i];
+        }
+    }
+    return NULL;
+}
+
+static void set_insert(struct sdr_set *set) {
+    u_int32_t mask, i;
+
+    if ( sets == NULL || (set_count + 1) * 2 > (1u << set_bits) ){
+        set_grow();
+    }
+    mask = (1u << set_bits) - 1;
+    for ( i = bmc_slot(set->hash, set_bits); sets[i] != NULL; i = (i + 1) & mask );
+    sets[i] = set;
+    set_count++;
+}
+
+/* the last BMC of the set left it, the entries after it shift back so probes need no tombstone */
+static void set_unref(struct sdr_set *set) {
+    u_int32_t mask, i, j, k;
+
+    if ( --set->refs > 0 ){
+        return;
+    }
+    mask = (1u << set_bits) - 1;
+    for ( i = bmc_slot(set->hash, set_bits); sets[i] != set; i = (i + 1) & mask );
+    for ( j = (i + 1) & mask; sets[j] != NULL; j = (j + 1) & mask ){
+        k = bmc_slot(sets[j]->hash, set_bits);
+        /* an entry whose home is cyclically in (i, j] stays */
+        if ( i <= j ? (i < k && k <= j) : (i < k || k <= j) ){
+            continue;
+        }
+        sets[i] = sets[j];
+        i = j;
+    }
+    sets[i] = NULL;
+    set_count--;
+
+    repo_free(&set->repo);
+    free(set);
+}
+
+/*
+ * drop every record of the BMC, its repository changed
+ */
+void sdr_bmc_reset(struct sdr_bmc *bmc) {
+    arena_reset(&bmc->repo.arena);
+    index_reset(&bmc->repo.records);
+    index_reset(&bmc->repo.sensors);
+    bmc->repo.nrecords = 0;
+    bmc->repo.ndone = 0;
+    if ( bmc->set != NULL ){
+        set_unref(bmc->set);
+        bmc->set = NULL;
+    }
+}
+
+/*
+ * share the repo of the BMC once every record it announced is read: with the
+ * set of the same records, or as a new set. either way the BMC keeps no
+ * record of its own
+ */
+void sdr_bmc_share(struct sdr_bmc *bmc) {
+    struct sdr_repo *repo = &bmc->repo;
+    struct sdr_set *set;
+    u_int64_t hash;
+    u_int32_t n;
+
+    if ( !repo->has_ts || repo->nrecords == 0 || repo->nrecords != repo->ndone || repo->ndone != repo->rec_count ){
+        return;
+    }
+    n = repo_sorted(repo, &own_list);
+    hash = records_hash(own_list.records, n);
+    set = set_find(hash, own_list.records, n);
+    if ( set == NULL ){
+        /* the repo moves into the set as it is, the BMC starts a new one */
+        set = (struct sdr_set *)sdr_calloc(1, sizeof(struct sdr_set));
+        set->hash = hash;
+        set->repo = *repo;
+        memset(&repo->arena, 0, sizeof(struct sdr_arena));
+        memset(&repo->records, 0, sizeof(struct sdr_index));
+        memset(&repo->sensors, 0, sizeof(struct sdr_index));
+        repo->nrecords = 0;
+        repo->ndone = 0;
+        set_insert(set);
+    }
+    else {
+        repo_free(repo);
+    }
+    /* taken before the former set is left, it may be the same */
+    set->refs++;
+    if ( bmc->set != NULL ){
+        set_unref(bmc->set);
+    }
+    bmc->set = set;
+}
+
+/* the records of the last complete read of the BMC, else the ones read so far */
+struct sdr_repo* sdr_bmc_records(struct sdr_bmc *bmc) {
+    return bmc->set != NULL ? &bmc->set->repo : &bmc->repo;
+}
+
+/* the record of a sensor, from the shared set first then from a read in progress */
+struct sdr_record* sdr_bmc_sensor_find(struct sdr_bmc *bmc, u_int32_t key) {
+    struct sdr_record *record = NULL;
+
+    if ( bmc->set != NULL ){
+        record = index_find(&bmc->set->repo.sensors, key);
+    }
+    return record != NULL ? record : index_find(&bmc->repo.sensors, key);
+}
+
+struct sdr_record* sdr_record_find(struct sdr_repo *repo, unsigned short rec_id) {
+    return index_find(&repo->records, rec_id);
+}
+
+/*
+ * a new empty record, the record id must not be in the repo yet
+ */
+struct sdr_record* sdr_record_add(struct sdr_repo *repo, unsigned short rec_id) {
+    struct sdr_record *record;
+
+    record = (struct sdr_record *)arena_alloc(&repo->arena, sizeof(struct sdr_record));
+    memset(record, 0, sizeof(struct sdr_record));
+    record->sdr_rec_id = rec_id;
+    index_put(&repo->records, rec_id, record);
+    repo->nrecords++;
+    return record;
+}
+
+/*
+ * every record of the repo, in no order
+ *
+ * @records: room for repo->nrecords pointers
+ *
+ * return the records written
+ */
+u_int32_t sdr_record_list(const struct sdr_repo *repo, struct sdr_record **records) {
+    const struct sdr_index *idx = &repo->records;
+    u_int32_t n = 0, i;
+
+    for ( i = 0; idx->slots != NULL && i < (1u << idx->bits); i++ ){
+        if ( idx->slots[i].gen == idx->gen ){
+            records[n++] = idx->slots[i].val;
+        }
+    }
+    return n;
+}
+
+/*
+ * room for the header and the body of a record, once its length is known
+ *
+ * @len: body length of the record header
+ *
+ */
+u_char* sdr_record_alloc_raw(struct sdr_repo *repo, struct sdr_record *record, u_char len) {
+    record->raw = (u_char *)arena_alloc(&repo->arena, 5 + len);
+    record->sdr_rec_len = len;
+    sdr_record_restart(repo, record);
+    return record->raw;
+}
+
+/* the bytes of the record are replaced by a new read */
+void sdr_record_restart(struct sdr_repo *repo, struct sdr_record *record) {
+    if ( record->sdr_done ){
+        record->sdr_done = 0;
+        repo->ndone--;
+    }
+}
+
+/* the record is complete, it counts for sdr_bmc_share unless a partial read was missed */
+void sdr_record_done(struct sdr_repo *repo, struct sdr_record *record) {
+    if ( !record->sdr_gap && !record->sdr_done ){
+        record->sdr_done = 1;
+        repo->ndone++;
+    }
+}
+
+/*
+ * room for the conversion table of a full sensor, see sensor_conv.h
+ */
+float* sdr_record_alloc_conv(struct sdr_repo *repo, struct sdr_record *record) {
+    record->conv = (float *)arena_alloc(&repo->arena, SENSOR_CONV_VALUES * sizeof(float));
+    return record->conv;
+}
+
+struct sdr_record* sdr_sensor_find(struct sdr_repo *repo, u_int32_t key) {
+    return index_find(&repo->sensors, key);
+}
+
+/*
+ * index a complete sensor record, replacing an older record of the same sensor
+ */
+void sdr_sensor_set(struct sdr_repo *repo, u_int32_t key, struct sdr_record *record) {
+    index_put(&repo->sensors, key, record);
+}
+
+static size_t index_bytes(const struct sdr_index *idx) {
+    return idx->slots == NULL ? 0 : ((size_t)1 << idx->bits) * sizeof(struct sdr_slot);
+}
+
+/*
+ * memory of every BMC of the calling thread(-m), in one piece
+ */
+void sdr_store_report(FILE *f) {
+    struct sdr_bmc *bmc;
+    struct sdr_set *set;
+    struct in_addr addr;
+    size_t used = 0, reserved = 0, index = 0;
+    u_int32_t records = 0, shared = 0, i;
+
+    if ( bmcs == NULL ){
+        return;
+    }
+
+    flockfile(f);
+    fprintf(f, "SDR memory: bmc, records, arena used/reserved bytes, index bytes[, shared set]\n");
+    for ( i = 0; i < (1u << bmc_bits); i++ ){
+        bmc = bmcs[i];
+        if ( bmc == NULL ){
+            continue;
+        }
+        addr.s_addr = (u_int32_t)(bmc->key >> 16);
+        fprintf(f, "  %s:%u %u %zu/%zu %zu", inet_ntoa(addr), (unsigned int)(bmc->key & 0xffff),
+                bmc->repo.nrecords, bmc->repo.arena.used, bmc->repo.arena.reserved,
+                index_bytes(&bmc->repo.records) + index_bytes(&bmc->repo.sensors));
+        if ( bmc->set != NULL ){
+            fprintf(f, ", set %016llx", (unsigned long long)bmc->set->hash);
+            shared++;
+        }
+        fputc('\n', f);
+        records += bmc->repo.nrecords;
+        used += bmc->repo.arena.used;
+        reserved += bmc->repo.arena.reserved;
+        index += index_bytes(&bmc->repo.records) + index_bytes(&bmc->repo.sensors);
+    }
+    for ( i = 0; sets != NULL && i < (1u << set_bits); i++ ){
+        set = sets[i];
+        if ( set == NULL ){
+            continue;
+        }
+        fprintf(f, "  set %016llx: %u bmcs, %u records, %zu/%zu %zu\n", (unsigned long long)set->hash,
+                set->refs, set->repo.nrecords, set->repo.arena.used, set->repo.arena.reserved,
+                index_bytes(&set->repo.records) + index_bytes(&set->repo.sensors));
+        records += set->repo.nrecords;
+        used += set->repo.arena.used;
+        reserved += set->repo.arena.reserved;
+        index += index_bytes(&set->repo.records) + index_bytes(&set->repo.sensors);
+    }
+    fprintf(f, "  total: %u bmcs, %u records, %zu/%zu arena bytes, %zu index bytes, %zu bytes of bmc table\n",
+            bmc_count, records, used, reserved, index,
+            ((size_t)1 << bmc_bits) * sizeof(struct sdr_bmc *) + bmc_count * sizeof(struct sdr_bmc));
+    if ( set_count > 0 ){
+        fprintf(f, "  shared: %u bmcs in %u sets, %zu bytes of set table\n", shared, set_count,
+                ((size_t)1 << set_bits) * sizeof(struct sdr_set *) + set_count * sizeof(struct sdr_set));
+    }
+    funlockfile(f);
+}
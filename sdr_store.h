@@ -0,0 +1,116 @@
+#ifndef _IPMI_DUMP_SDR_STORE_H
+#define _IPMI_DUMP_SDR_STORE_H
+
+#include <stdio.h>
+#include <sys/types.h>
+
+#include "align.h"
+
+/*
+ * SDR records seen on the wire, per BMC
+ *
+ * a BMC is found by its address in an open addressing table of the decoding
+ * thread, then its records by record id and by sensor in two more open
+ * addressing indexes of its repo, so every lookup is O(1) however many BMCs
+ * and records are watched.
+ *
+ * records and their bytes live in an arena of the repo, when the BMC tells
+ * that its repository changed the whole repo is dropped in O(1): the arena
+ * is rewound and the generation of the indexes bumped
+ *
+ * BMCs of the same model have the same repository byte for byte. once every
+ * record a BMC announced is read, its repo is hashed and looked up among the
+ * sets of the thread: a set with the same records is shared(refcounted) and
+ * the repo of the BMC freed, else the repo becomes a new set. a set is never
+ * written again, so the sensor index and conversion tables of a model exist
+ * once per thread. a BMC walking its SDR again fills its own repo meanwhile
+ */
+
+/* a record, once the partial reads of Get SDR brought all its bytes, see sdr_partial.h */
+struct sdr_record {
+    unsigned short      sdr_rec_id;
+    u_char              sdr_sensor_num;
+    u_char              sdr_rec_type;
+    u_char              sdr_rec_len;
+    u_char              sdr_gap;    /* completed while a partial read was missing */
+    u_char              sdr_done;   /* completed without a gap, counted in ndone of the repo */
+    u_char              *raw;       /* 5 bytes of header then sdr_rec_len bytes of body */
+    float               *conv;      /* converted value of every raw reading of an analog full sensor, or NULL */
+    u_int64_t           sdr_cache_off;  /* the entry of sdr_cache.c with the same bytes, 0 for none */
+};
+
+/* chunks are kept across resets and reused */
+struct sdr_chunk {
+    struct sdr_chunk    *next;
+    size_t              size;
+    u_char              data[];
+};
+
+struct sdr_arena {
+    struct sdr_chunk    *first;
+    struct sdr_chunk    *cur;
+    size_t              pos;        /* in cur */
+    size_t              used;       /* bytes handed out since the last reset */
+    size_t              reserved;   /* bytes of all chunks */
+};
+
+struct sdr_slot {
+    u_int32_t           key;
+    u_int32_t           gen;        /* the slot is free unless it is the generation of the index */
+    struct sdr_record   *val;
+};
+
+struct sdr_index {
+    struct sdr_slot     *slots;
+    u_int32_t           count;
+    u_int32_t           gen;
+    u_char              bits;       /* log2 of the slots */
+};
+
+struct sdr_repo {
+    struct sdr_arena    arena;
+    struct sdr_index    records;    /* by record id */
+    struct sdr_index    sensors;    /* by SDR_SENSOR_KEY */
+    u_int32_t           nrecords;
+    u_int32_t           ndone;      /* records with sdr_done */
+    u_int32_t           add_ts;     /* timestamps of Get SDR Repository Info */
+    u_int32_t           del_ts;     /* the records are dropped when it moves */
+    unsigned short      rec_count;  /* records the BMC announced */
+    int                 has_ts;
+};
+
+/* a complete repository shared by the BMCs with the same records */
+struct sdr_set {
+    u_int64_t           hash;
+    u_int32_t           refs;
+    struct sdr_repo     repo;       /* read only */
+};
+
+struct sdr_bmc {
+    u_int64_t           key;        /* DUMP_BMC_KEY */
+    struct sdr_repo     repo;       /* the records being read, and the repository info */
+    struct sdr_set      *set;       /* the records of the last complete read, or NULL */
+    struct sdr_bmc      *export_next;   /* list of the BMCs whose -D dump is to write, see sdr_export.h */
+    int                 export_dirty;
+};
+
+/* a sensor is owned by a controller(slave address) and a lun of it */
+#define SDR_SENSOR_KEY(owner, lun, num)     (((u_int32_t)(owner) << 16) | (((lun) & 0x03) << 8) | (num))
+
+struct sdr_bmc* sdr_bmc_get(u_int64_t key);
+void sdr_bmc_reset(struct sdr_bmc *bmc);
+void sdr_bmc_share(struct sdr_bmc *bmc);
+struct sdr_repo* sdr_bmc_records(struct sdr_bmc *bmc);
+struct sdr_record* sdr_bmc_sensor_find(struct sdr_bmc *bmc, u_int32_t key);
+struct sdr_record* sdr_record_find(struct sdr_repo *repo, unsigned short rec_id);
+struct sdr_record* sdr_record_add(struct sdr_repo *repo, unsigned short rec_id);
+u_char* sdr_record_alloc_raw(struct sdr_repo *repo, struct sdr_record *record, u_char len);
+void sdr_record_restart(struct sdr_repo *repo, struct sdr_record *record);
+void sdr_record_done(struct sdr_repo *repo, struct sdr_record *record);
+float* sdr_record_alloc_conv(struct sdr_repo *repo, struct sdr_record *record);
+u_int32_t sdr_record_list(const struct sdr_repo *repo, struct sdr_record **records);
+struct sdr_record* sdr_sensor_find(struct sdr_repo *repo, u_int32_t key);
+void sdr_sensor_set(struct sdr_repo *repo, u_int32_t key, struct sdr_record *record);
+void sdr_store_report(FILE *f);
+
+#endif
@@ -0,0 +1,94 @@
+/*
+ * conversion of full sensor readings to their unit, see sensor_conv.h
+ */
+#include <math.h>
+#include <sys/types.h>
+
+#include "sensor_conv.h"
+
+/* the raw reading as the signed or unsigned number of the analog data format */
+static int sensor_raw_value(u_char fmt, u_char raw) {
+    switch ( fmt ){
+        case SENSOR_FMT_1S_COMPL:
+            /* 0xff is -0 */
+            return (raw & 0x80) ? -(int)(u_char)~raw : raw;
+        case SENSOR_FMT_2S_COMPL:
+            return (signed char)raw;
+        default:
+            return raw;
+    }
+}
+
+/* L[] of section 36.3, the non linear(0x70-0x7f) and the OEM ones are left as is */
+static double sensor_linearize(u_char linearization, double y) {
+    switch ( linearization & 0x7f ){
+        case SDR_SENSOR_L_LN:
+            return log(y);
+        case SDR_SENSOR_L_LOG10:
+            return log10(y);
+        case SDR_SENSOR_L_LOG2:
+            return log2(y);
+        case SDR_SENSOR_L_E:
+            return exp(y);
+        case SDR_SENSOR_L_EXP10:
+            return pow(10, y);
+        case SDR_SENSOR_L_EXP2:
+            return pow(2, y);
+        case SDR_SENSOR_L_1_X:
+            return 1 / y;
+        case SDR_SENSOR_L_SQR:
+            return y * y;
+        case SDR_SENSOR_L_CUBE:
+            return y * y * y;
+        case SDR_SENSOR_L_SQRT:
+            return sqrt(y);
+        case SDR_SENSOR_L_CUBERT:
+            return cbrt(y);
+        default:
+            return y;
+    }
+}
+
+/*
+ * convert one raw reading, the factors are decoded on every call
+ *
+ * @fs: the body of a full sensor record
+ * @raw: the reading byte of Get Sensor Reading
+ *
+ */
+double sensor_conv_value(const struct ipmi_sdr_type_full_sensor *fs, u_char raw) {
+    u_char fmt = SENSOR_FMT(fs->common.unit);
+
+    if ( fmt == SENSOR_FMT_NO_ANALOG ){
+        return 0.0;
+    }
+    return sensor_linearize(fs->linearization,
+            (__TO_M(fs->mtol) * sensor_raw_value(fmt, raw) + __TO_B(fs->bacc) * pow(10, __TO_B_EXP(fs->bacc)))
+            * pow(10, __TO_R_EXP(fs->bacc)));
+}
+
+/*
+ * convert every raw reading of a full sensor at once
+ *
+ * @table: SENSOR_CONV_VALUES floats, indexed by the raw reading
+ * @fs: the body of a full sensor record
+ *
+ * return -1 when the sensor has no analog reading, the table is left untouched
+ */
+int sensor_conv_build(float *table, const struct ipmi_sdr_type_full_sensor *fs) {
+    u_char fmt = SENSOR_FMT(fs->common.unit);
+    double m, offset, scale;
+    int v;
+
+    if ( fmt == SENSOR_FMT_NO_ANALOG ){
+        return -1;
+    }
+
+    m = __TO_M(fs->mtol);
+    offset = __TO_B(fs->bacc) * pow(10, __TO_B_EXP(fs->bacc));
+    scale = pow(10, __TO_R_EXP(fs->bacc));
+    for ( v = 0; v < SENSOR_CONV_VALUES; v++ ){
+        table[v] = (float)sensor_linearize(fs->linearization, (m * sensor_raw_value(fmt, v) + offset) * scale);
+    }
+    return 0;
+}
@@ -0,0 +1,51 @@
+#ifndef _IPMI_DUMP_SENSOR_CONV_H
+#define _IPMI_DUMP_SENSOR_CONV_H
+
+#include <sys/types.h>
+
+#include "bswap.h"
+#include "ipmi_sdr_type.h"
+
+/*
+ * conversion of the raw readings of a full sensor, section 36.3
+ *
+ *   y = L[(M x V + B x pow(10,Bexp)) x pow(10,Rexp)]
+ *
+ * a raw reading is one byte, so once the record is read all 256 values are
+ * converted to a table and a reading is a load from it
+ */
+
+#define tos32(val, bits)    ((val & ((1<<((bits)-1)))) ? (-((val) & (1<<((bits)-1))) | (val)) : (val))
+
+#if WORDS_BIGENDIAN
+# define __TO_TOL(mtol)     (uint16_t)(mtol & 0x3f)
+# define __TO_M(mtol)       (int16_t)(tos32((((mtol & 0xff00) >> 8) | ((mtol & 0xc0) << 2)), 10))
+# define __TO_B(bacc)       (int32_t)(tos32((((bacc & 0xff000000) >> 24) | ((bacc & 0xc00000) >> 14)), 10))
+# define __TO_ACC(bacc)     (uint32_t)(((bacc & 0x3f0000) >> 16) | ((bacc & 0xf000) >> 6))
+# define __TO_ACC_EXP(bacc) (uint32_t)((bacc & 0xc00) >> 10)
+# define __TO_R_EXP(bacc)   (int32_t)(tos32(((bacc & 0xf0) >> 4), 4))
+# define __TO_B_EXP(bacc)   (int32_t)(tos32((bacc & 0xf), 4))
+#else
+# define __TO_TOL(mtol)     (uint16_t)(BSWAP_16(mtol) & 0x3f)
+# define __TO_M(mtol)       (int16_t)(tos32((((BSWAP_16(mtol) & 0xff00) >> 8) | ((BSWAP_16(mtol) & 0xc0) << 2)), 10))
+# define __TO_B(bacc)       (int32_t)(tos32((((BSWAP_32(bacc) & 0xff000000) >> 24) | \
+                                            ((BSWAP_32(bacc) & 0xc00000) >> 14)), 10))
+# define __TO_ACC(bacc)     (uint32_t)(((BSWAP_32(bacc) & 0x3f0000) >> 16) | ((BSWAP_32(bacc) & 0xf000) >> 6))
+# define __TO_ACC_EXP(bacc) (uint32_t)((BSWAP_32(bacc) & 0xc00) >> 10)
+# define __TO_R_EXP(bacc)   (int32_t)(tos32(((BSWAP_32(bacc) & 0xf0) >> 4), 4))
+# define __TO_B_EXP(bacc)   (int32_t)(tos32((BSWAP_32(bacc) & 0xf), 4))
+#endif
+
+/* analog data format, bits [7:6] of the sensor unit */
+#define SENSOR_FMT_UNSIGNED     0
+#define SENSOR_FMT_1S_COMPL     1
+#define SENSOR_FMT_2S_COMPL     2
+#define SENSOR_FMT_NO_ANALOG    3
+#define SENSOR_FMT(unit)        (((unit) & 0xc0) >> 6)
+
+#define SENSOR_CONV_VALUES      256
+
+int sensor_conv_build(float *table, const struct ipmi_sdr_type_full_sensor *fs);
+double sensor_conv_value(const struct ipmi_sdr_type_full_sensor *fs, u_char raw);
+
+#endif
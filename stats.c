@@ -0,0 +1,322 @@
+/*
+ * counters of the aggregate only mode(-A), see stats.h
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/types.h>
+#include <arpa/inet.h>
+
+#include "dump.h"
+#include "ipmi_cmd.h"
+#include "stats.h"
+
+#define PEER_MIN_BITS   6
+
+int dump_stats = 0;
+
+static int stats_interval;
+static FILE *stats_out;
+
+struct stats_peers {
+    struct stats_peer   **slots;
+    u_int32_t           count;
+    u_char              bits;
+};
+
+struct stats_thread {
+    struct stats_peers  bmcs;
+    struct stats_peers  clients;
+    struct stats_count  total;
+    u_int64_t           errors;
+    struct stats_count  rmcp_class[256];
+    u_int64_t           auth_type[256];
+    struct stats_cmd    cmds[IPMI_NETFN_ROWS][256];     /* [netfn >> 1][cmd] like ipmi_cmds */
+    u_int64_t           cc[256];
+    int                 has_capture;
+    u_int64_t           capture_recv;   /* kernel counters of the capture of the thread */
+    u_int64_t           capture_drop;
+    u_int64_t           capture_ifdrop;
+    time_t              now;            /* of the last stats_tick */
+    time_t              next_report;
+};
+
+static DUMP_TLS struct stats_thread *st;
+/* the peers of the packet being decoded */
+static DUMP_TLS struct stats_peer *cur_bmc;
+static DUMP_TLS struct stats_peer *cur_client;
+static DUMP_TLS int cur_bytes;
+
+static void* stats_calloc(size_t n, size_t size) {
+    void *p = calloc(n, size);
+
+    if ( p == NULL ){
+        fprintf(stderr, "out of memory for statistics\n");
+        exit(1);
+    }
+    return p;
+}
+
+/*
+ * turn the aggregate only mode on
+ *
+ * @interval: seconds between two reports
+ * @path: file the reports are appended to, NULL for stdout
+ *
+ */
+int stats_open(int interval, const char *path) {
+    stats_interval = interval;
+    stats_out = stdout;
+    if ( path != NULL ){
+        stats_out = fopen(path, "a");
+        if ( stats_out == NULL ){
+            return -1;
+        }
+    }
+    dump_stats = 1;
+    return 0;
+}
+
+static inline u_int32_t peer_slot(u_int64_t key, u_char bits) {
+    return (u_int32_t)((key * 0x9e3779b97f4a7c15ull) >> (64 - bits));
+}
+
+static void peers_grow(struct stats_peers *peers) {
+    struct stats_peer **old = peers->slots;
+    u_char old_bits = peers->bits;
+    u_int32_t mask, i, j;
+
+    peers->bits = old == NULL ? PEER_MIN_BITS : old_bits + 1;
+    peers->slots = (struct stats_peer **)stats_calloc((size_t)1 << peers->bits, sizeof(struct stats_peer *));
+    mask = (1u << peers->bits) - 1;
+
+    for ( i = 0; old != NULL && i < (1u << old_bits); i++ ){
+        if ( old[i] == NULL ){
+            continue;
+        }
+        for ( j = peer_slot(old[i]->key, peers->bits); peers->slots[j] != NULL; j = (j + 1) & mask );
+        peers->slots[j] = old[i];
+    }
+    free(old);
+}
+
+static struct stats_peer* peers_get(struct stats_peers *peers, u_int64_t key) {
+    u_int32_t mask, i;
+
+    if ( peers->slots == NULL || (peers->count + 1) * 2 > (1u << peers->bits) ){
+        peers_grow(peers);
+    }
+    mask = (1u << peers->bits) - 1;
+    for ( i = peer_slot(key, peers->bits); peers->slots[i] != NULL; i = (i + 1) & mask ){
+        if ( peers->slots[i]->key == key ){
+            return peers->slots[i];
+        }
+    }
+
+    peers->slots[i] = (struct stats_peer *)stats_calloc(1, sizeof(struct stats_peer));
+    peers->slots[i]->key = key;
+    peers->count++;
+    return peers->slots[i];
+}
+
+static void stats_thread_init(void) {
+    if ( st == NULL ){
+        st = (struct stats_thread *)stats_calloc(1, sizeof(struct stats_thread));
+    }
+}
+
+/*
+ * count a udp packet, the first call of every packet
+ *
+ * @bmc: DUMP_BMC_KEY of the BMC side(the rmcp port side)
+ * @client: DUMP_BMC_KEY of the other side
+ * @bytes: udp payload length
+ *
+ */
+void stats_packet(u_int64_t bmc, u_int64_t client, int bytes) {
+    stats_thread_init();
+
+    cur_bmc = peers_get(&st->bmcs, bmc);
+    cur_client = peers_get(&st->clients, client);
+    cur_bmc->packets++;
+    cur_bmc->bytes += bytes;
+    cur_client->packets++;
+    cur_client->bytes += bytes;
+    st->total.packets++;
+    st->total.bytes += bytes;
+    cur_bytes = bytes;
+}
+
+void stats_error(void) {
+    if ( st == NULL ){
+        return;
+    }
+    cur_bmc->errors++;
+    cur_client->errors++;
+    st->errors++;
+}
+
+void stats_rmcp_class(u_char rmcp_class) {
+    st->rmcp_class[rmcp_class].packets++;
+    st->rmcp_class[rmcp_class].bytes += cur_bytes;
+}
+
+void stats_auth_type(u_char auth_type) {
+    st->auth_type[auth_type]++;
+}
+
+/*
+ * count an ipmi message
+ *
+ * @netfn: netfn of the request, even for a response too
+ * @cc: completion code of a response, -1 when the message has none
+ *
+ */
+void stats_ipmi(u_char netfn, u_char cmd, int response, int cc) {
+    struct stats_cmd *c = &st->cmds[netfn >> 1][cmd];
+
+    if ( !response ){
+        c->requests++;
+        cur_bmc->requests++;
+        cur_client->requests++;
+        return;
+    }
+
+    c->responses++;
+    cur_bmc->responses++;
+    cur_client->responses++;
+    if ( cc > 0 ){
+        c->failed++;
+        cur_bmc->failed++;
+        cur_client->failed++;
+    }
+    if ( cc >= 0 ){
+        st->cc[cc]++;
+    }
+}
+
+/*
+ * count a request no response came for, it is not the packet being decoded
+ *
+ * @bmc: DUMP_BMC_KEY of the BMC the request was sent to
+ * @client: DUMP_BMC_KEY of the client
+ * @netfn: netfn of the request
+ *
+ */
+void stats_expired(u_int64_t bmc, u_int64_t client, u_char netfn, u_char cmd) {
+    stats_thread_init();
+    peers_get(&st->bmcs, bmc)->expired++;
+    peers_get(&st->clients, client)->expired++;
+    st->cmds[netfn >> 1][cmd].expired++;
+}
+
+/*
+ * the capture counters of the thread, totals since the start
+ */
+void stats_capture(unsigned long long recv, unsigned long long drop, unsigned long long ifdrop) {
+    if ( !dump_stats ){
+        return;
+    }
+    stats_thread_init();
+    st->has_capture = 1;
+    st->capture_recv = recv;
+    st->capture_drop = drop;
+    st->capture_ifdrop = ifdrop;
+}
+
+static void report_peers(FILE *f, const char *kind, const struct stats_peers *peers) {
+    const struct stats_peer *p;
+    struct in_addr addr;
+    u_int32_t i;
+
+    for ( i = 0; peers->slots != NULL && i < (1u << peers->bits); i++ ){
+        p = peers->slots[i];
+        if ( p == NULL ){
+            continue;
+        }
+        addr.s_addr = (u_int32_t)(p->key >> 16);
+        fprintf(f, "%s %s:%u packets %llu bytes %llu errors %llu requests %llu responses %llu failed %llu expired %llu\n",
+                kind, inet_ntoa(addr), (unsigned int)(p->key & 0xffff),
+                (unsigned long long)p->packets, (unsigned long long)p->bytes, (unsigned long long)p->errors,
+                (unsigned long long)p->requests, (unsigned long long)p->responses, (unsigned long long)p->failed,
+                (unsigned long long)p->expired);
+    }
+}
+
+/*
+ * write the counters of the calling thread since it started, in one piece
+ */
+void stats_report(void) {
+    FILE *f = stats_out;
+    const struct stats_cmd *c;
+    int i, j;
+
+    if ( !dump_stats || st == NULL ){
+        return;
+    }
+
+    flockfile(f);
+    fprintf(f, "# ipmidump stats at %ld\n", (long)(st->now != 0 ? st->now : time(NULL)));
+    fprintf(f, "total packets %llu bytes %llu errors %llu\n",
+            (unsigned long long)st->total.packets, (unsigned long long)st->total.bytes, (unsigned long long)st->errors);
+    if ( st->has_capture ){
+        fprintf(f, "capture received %llu dropped %llu ifdropped %llu\n",
+                (unsigned long long)st->capture_recv, (unsigned long long)st->capture_drop,
+                (unsigned long long)st->capture_ifdrop);
+    }
+    fprintf(f, "decoder truncated %llu rejected %llu malformed %llu unmatched %llu sdr_gaps %llu sdr_stale %llu\n",
+            dump_cnt.truncated, dump_cnt.rejects, dump_cnt.malformed, dump_cnt.unmatched, dump_cnt.sdr_gaps, dump_cnt.sdr_stale);
+    report_peers(f, "bmc", &st->bmcs);
+    report_peers(f, "client", &st->clients);
+    for ( i = 0; i < 256; i++ ){
+        if ( st->rmcp_class[i].packets != 0 ){
+            fprintf(f, "class 0x%02x packets %llu bytes %llu\n", i,
+                    (unsigned long long)st->rmcp_class[i].packets, (unsigned long long)st->rmcp_class[i].bytes);
+        }
+    }
+    for ( i = 0; i < 256; i++ ){
+        if ( st->auth_type[i] != 0 ){
+            fprintf(f, "auth 0x%02x packets %llu\n", i, (unsigned long long)st->auth_type[i]);
+        }
+    }
+    for ( i = 0; i < IPMI_NETFN_ROWS; i++ ){
+        for ( j = 0; j < 256; j++ ){
+            c = &st->cmds[i][j];
+            if ( c->requests == 0 && c->responses == 0 ){
+                continue;
+            }
+            fprintf(f, "cmd 0x%02x 0x%02x %s requests %llu responses %llu failed %llu expired %llu\n",
+                    i << 1, j, ipmi_get_cmd_str(i << 1, j),
+                    (unsigned long long)c->requests, (unsigned long long)c->responses, (unsigned long long)c->failed,
+                    (unsigned long long)c->expired);
+        }
+    }
+    for ( i = 0; i < 256; i++ ){
+        if ( st->cc[i] != 0 ){
+            fprintf(f, "cc 0x%02x responses %llu\n", i, (unsigned long long)st->cc[i]);
+        }
+    }
+    fflush(f);
+    funlockfile(f);
+}
+
+/*
+ * report when the interval is over
+ *
+ * @now: capture time of the packet being decoded, or the wall clock when idle
+ *
+ */
+void stats_tick(time_t now) {
+    if ( !dump_stats || st == NULL ){
+        return;
+    }
+    st->now = now;
+    if ( st->next_report == 0 ){
+        st->next_report = now + stats_interval;
+    }
+    else if ( now >= st->next_report ){
+        stats_report();
+        st->next_report = now + stats_interval;
+    }
+}
@@ -0,0 +1,68 @@
+#ifndef _IPMI_DUMP_STATS_H
+#define _IPMI_DUMP_STATS_H
+
+#include <stdio.h>
+#include <time.h>
+#include <sys/types.h>
+
+#include "dump.h"
+
+/*
+ * counters of the aggregate only mode(-A)
+ *
+ * the decoders only count, nothing is formatted per packet. a packet is
+ * counted for its BMC and its client when it enters(stats_packet), the layers
+ * above add to the counters of the current packet without looking them up
+ * again. counters are kept per decoding thread and reported every interval by
+ * the thread, so with -j every worker reports the BMCs it decodes
+ */
+
+/* a BMC or a client */
+struct stats_peer {
+    u_int64_t       key;            /* DUMP_BMC_KEY of the endpoint */
+    u_int64_t       packets;
+    u_int64_t       bytes;          /* of udp payload */
+    u_int64_t       errors;         /* packets the decoders could not parse */
+    u_int64_t       requests;
+    u_int64_t       responses;
+    u_int64_t       failed;         /* responses with a completion code other than 0 */
+    u_int64_t       expired;        /* requests never answered */
+};
+
+struct stats_count {
+    u_int64_t       packets;
+    u_int64_t       bytes;
+};
+
+struct stats_cmd {
+    u_int64_t       requests;
+    u_int64_t       responses;
+    u_int64_t       failed;
+    u_int64_t       expired;
+};
+
+extern int dump_stats;
+
+int stats_open(int interval, const char *path);
+void stats_packet(u_int64_t bmc, u_int64_t client, int bytes);
+void stats_error(void);
+void stats_rmcp_class(u_char rmcp_class);
+void stats_auth_type(u_char auth_type);
+void stats_ipmi(u_char netfn, u_char cmd, int response, int cc);
+void stats_expired(u_int64_t bmc, u_int64_t client, u_char netfn, u_char cmd);
+void stats_capture(unsigned long long recv, unsigned long long drop, unsigned long long ifdrop);
+void stats_tick(time_t now);
+void stats_report(void);
+
+/* a malformed packet: counted with -A, reported otherwise */
+#define DUMP_INVALID(...)   do {                                \
+        dump_cnt.malformed++;                                   \
+        if ( dump_stats ){                                      \
+            stats_error();                                      \
+        }                                                       \
+        else {                                                  \
+            fprintf(stderr, __VA_ARGS__);                       \
+        }                                                       \
+    } while ( 0 )
+
+#endif
@@ -0,0 +1,311 @@
+/*
+ * capture packets through a TPACKET_V3 mmap'ed ring
+ *
+ * compared to pcap_open_live(BUFSIZ), the ring is sized explicitly and
+ * the kernel batches packets into blocks, so a sweep over thousands of
+ * BMCs does not overflow the socket buffer while the decoder is busy
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <net/if.h>
+#include <net/if_arp.h>
+#include <arpa/inet.h>
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+#include <linux/filter.h>
+
+#include "tpacket.h"
+
+#ifndef PACKET_FANOUT_FLAG_UNIQUEID
+#define PACKET_FANOUT_FLAG_UNIQUEID     0x2000
+#endif
+
+struct tpacket_ring {
+    int                 fd;
+    u_char              *map;
+    size_t              map_len;
+    unsigned int        block_size;
+    unsigned int        block_nr;
+    unsigned int        block_timeout;
+    unsigned int        cur;        /* next block to walk */
+    int                 loopback;   /* loopback shows every packet twice, outgoing and incoming */
+    volatile int        stop;
+};
+
+
+static int tpacket_set_filter(int fd, struct bpf_program *fp, char *errbuf) {
+    struct sock_fprog prog;
+
+    if ( fp == NULL ){
+        return 0;
+    }
+
+    /* struct bpf_insn of libpcap has the same layout as struct sock_filter */
+    prog.len = fp->bf_len;
+    prog.filter = (struct sock_filter *)fp->bf_insns;
+    if ( setsockopt(fd, SOL_SOCKET, SO_ATTACH_FILTER, &prog, sizeof(prog)) == -1 ){
+        snprintf(errbuf, PCAP_ERRBUF_SIZE, "SO_ATTACH_FILTER: %s", strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * open the ring on device
+ *
+ * @dev: interface name, must be ethernet or loopback
+ * @opts: ring geometry and timeout
+ * @fp: compiled filter, attached before bind so that no unfiltered packet enters the ring
+ * @errbuf: PCAP_ERRBUF_SIZE bytes to hold the error message
+ *
+ */
+struct tpacket_ring* tpacket_open(const char *dev, const struct tpacket_opts *opts, struct bpf_program *fp, char *errbuf) {
+    struct tpacket_ring *ring;
+    struct tpacket_req3 req;
+    struct sockaddr_ll ll;
+    struct packet_mreq mr;
+    struct ifreq ifr;
+    int version = TPACKET_V3;
+    int ifindex;
+
+    ifindex = if_nametoindex(dev);
+    if ( ifindex == 0 ){
+        snprintf(errbuf, PCAP_ERRBUF_SIZE, "no such device %s", dev);
+        return NULL;
+    }
+
+    if ( opts->block_size == 0 || opts->block_size % getpagesize() != 0 || opts->ring_size < opts->block_size ){
+        snprintf(errbuf, PCAP_ERRBUF_SIZE, "invalid ring geometry: ring %u, block %u", opts->ring_size, opts->block_size);
+        return NULL;
+    }
+
+    ring = (struct tpacket_ring *)calloc(1, sizeof(struct tpacket_ring));
+    if ( ring == NULL ){
+        snprintf(errbuf, PCAP_ERRBUF_SIZE, "out of memory");
+        return NULL;
+    }
+    ring->map = MAP_FAILED;
+
+    ring->fd = socket(AF_PACKET, SOCK_RAW, 0);
+    if ( ring->fd == -1 ){
+        snprintf(errbuf, PCAP_ERRBUF_SIZE, "socket: %s", strerror(errno));
+        goto fail;
+    }
+
+    /* got_packet only understands ethernet framing, AF_PACKET gives a zeroed ethernet header on loopback */
+    memset(&ifr, 0, sizeof(ifr));
+    strncpy(ifr.ifr_name, dev, IFNAMSIZ - 1);
+    if ( ioctl(ring->fd, SIOCGIFHWADDR, &ifr) == -1 ){
+        snprintf(errbuf, PCAP_ERRBUF_SIZE, "SIOCGIFHWADDR: %s", strerror(errno));
+        goto fail;
+    }
+    if ( ifr.ifr_hwaddr.sa_family != ARPHRD_ETHER && ifr.ifr_hwaddr.sa_family != ARPHRD_LOOPBACK ){
+        snprintf(errbuf, PCAP_ERRBUF_SIZE, "only support Ethernet or Loopback device, but hardware type %d supplied", ifr.ifr_hwaddr.sa_family);
+        goto fail;
+    }
+    ring->loopback = ifr.ifr_hwaddr.sa_family == ARPHRD_LOOPBACK;
+
+    if ( setsockopt(ring->fd, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) == -1 ){
+        snprintf(errbuf, PCAP_ERRBUF_SIZE, "PACKET_VERSION: %s", strerror(errno));
+        goto fail;
+    }
+
+    ring->block_size = opts->block_size;
+    ring->block_nr = opts->ring_size / opts->block_size;
+    ring->block_timeout = opts->block_timeout;
+
+    memset(&req, 0, sizeof(req));
+    req.tp_block_size = ring->block_size;
+    req.tp_block_nr = ring->block_nr;
+    req.tp_frame_size = TPACKET_ALIGNMENT << 7; /* only a hint in V3, packets are packed by tp_next_offset */
+    req.tp_frame_nr = (ring->block_size / req.tp_frame_size) * ring->block_nr;
+    req.tp_retire_blk_tov = ring->block_timeout;
+    req.tp_feature_req_word = TP_FT_REQ_FILL_RXHASH;
+    if ( setsockopt(ring->fd, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req)) == -1 ){
+        snprintf(errbuf, PCAP_ERRBUF_SIZE, "PACKET_RX_RING: %s", strerror(errno));
+        goto fail;
+    }
+
+    ring->map_len = (size_t)ring->block_size * ring->block_nr;
+    ring->map = mmap(NULL, ring->map_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_LOCKED | MAP_POPULATE, ring->fd, 0);
+    if ( ring->map == MAP_FAILED ){
+        /* MAP_LOCKED fails without CAP_IPC_LOCK or a big enough RLIMIT_MEMLOCK, it is only an optimization */
+        ring->map = mmap(NULL, ring->map_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, 0);
+    }
+    if ( ring->map == MAP_FAILED ){
+        snprintf(errbuf, PCAP_ERRBUF_SIZE, "mmap: %s", strerror(errno));
+        goto fail;
+    }
+
+    if ( tpacket_set_filter(ring->fd, fp, errbuf) == -1 ){
+        goto fail;
+    }
+
+    memset(&ll, 0, sizeof(ll));
+    ll.sll_family = AF_PACKET;
+    ll.sll_protocol = htons(ETH_P_ALL);
+    ll.sll_ifindex = ifindex;
+    if ( bind(ring->fd, (struct sockaddr *)&ll, sizeof(ll)) == -1 ){
+        snprintf(errbuf, PCAP_ERRBUF_SIZE, "bind: %s", strerror(errno));
+        goto fail;
+    }
+
+    if ( opts->fanout != TPACKET_NO_FANOUT ){
+        /*
+         * the flow hash of fanout(addresses and ports) is symmetric, so a request and its response
+         * land on the same ring, but two flows of one BMC may not. defrag keeps the fragments of
+         * one datagram together
+         */
+        int fanout = (PACKET_FANOUT_HASH | PACKET_FANOUT_FLAG_DEFRAG) << 16;
+        if ( opts->fanout == TPACKET_FANOUT_NEW ){
+            /* the kernel picks the id, another ipmidump never lands in the group */
+            fanout |= PACKET_FANOUT_FLAG_UNIQUEID << 16;
+        }
+        else {
+            fanout |= opts->fanout & 0xffff;
+        }
+        if ( setsockopt(ring->fd, SOL_PACKET, PACKET_FANOUT, &fanout, sizeof(fanout)) == -1 ){
+            snprintf(errbuf, PCAP_ERRBUF_SIZE, "PACKET_FANOUT: %s", strerror(errno));
+            goto fail;
+        }
+    }
+
+    memset(&mr, 0, sizeof(mr));
+    mr.mr_ifindex = ifindex;
+    mr.mr_type = PACKET_MR_PROMISC;
+    if ( setsockopt(ring->fd, SOL_PACKET, PACKET_ADD_MEMBERSHIP, &mr, sizeof(mr)) == -1 ){
+        snprintf(errbuf, PCAP_ERRBUF_SIZE, "PACKET_ADD_MEMBERSHIP: %s", strerror(errno));
+        goto fail;
+    }
+
+    return ring;
+
+fail:
+    tpacket_close(ring);
+    return NULL;
+}
+
+/*
+ * the id of the fanout group of the ring, for the other rings to join it
+ *
+ * @ring: a ring opened with a fanout
+ *
+ * return -1 with errno set on failure
+ */
+int tpacket_fanout_id(struct tpacket_ring *ring) {
+    int fanout;
+    socklen_t len = sizeof(fanout);
+
+    if ( getsockopt(ring->fd, SOL_PACKET, PACKET_FANOUT, &fanout, &len) == -1 ){
+        return -1;
+    }
+    return fanout & 0xffff;
+}
+
+/*
+ * hand every packet of a retired block to callback, then return the block to kernel
+ */
+static void tpacket_walk_block(struct tpacket_ring *ring, struct tpacket_block_desc *bd, pcap_handler callback, u_char *user) {
+    struct tpacket3_hdr *ppd;
+    struct sockaddr_ll *ll;
+    struct pcap_pkthdr header;
+    unsigned int i, num_pkts;
+
+    num_pkts = bd->hdr.bh1.num_pkts;
+    ppd = (struct tpacket3_hdr *)((u_char *)bd + bd->hdr.bh1.offset_to_first_pkt);
+    for ( i = 0; i < num_pkts; i++ ){
+        ll = (struct sockaddr_ll *)((u_char *)ppd + TPACKET_ALIGN(sizeof(struct tpacket3_hdr)));
+        if ( ring->loopback && ll->sll_pkttype == PACKET_OUTGOING ){
+            /* same as libpcap, keep only the incoming copy */
+            ppd = (struct tpacket3_hdr *)((u_char *)ppd + ppd->tp_next_offset);
+            continue;
+        }
+        header.ts.tv_sec = ppd->tp_sec;
+        header.ts.tv_usec = ppd->tp_nsec / 1000;
+        header.caplen = ppd->tp_snaplen;
+        header.len = ppd->tp_len;
+        callback(user, &header, (u_char *)ppd + ppd->tp_mac);
+        ppd = (struct tpacket3_hdr *)((u_char *)ppd + ppd->tp_next_offset);
+    }
+
+    __atomic_store_n(&bd->hdr.bh1.block_status, TP_STATUS_KERNEL, __ATOMIC_RELEASE);
+}
+
+/*
+ * walk the ring block by block until tpacket_breakloop
+ *
+ * @idle: called after each block and when poll times out, may be NULL
+ * @return: 0 when stopped by tpacket_breakloop, -1 on poll error
+ */
+int tpacket_loop(struct tpacket_ring *ring, pcap_handler callback, u_char *user, void (*idle)(void)) {
+    struct tpacket_block_desc *bd;
+    struct pollfd pfd;
+
+    pfd.fd = ring->fd;
+    pfd.events = POLLIN | POLLERR;
+    pfd.revents = 0;
+
+    while ( !ring->stop ){
+        bd = (struct tpacket_block_desc *)(ring->map + (size_t)ring->cur * ring->block_size);
+        if ( (__atomic_load_n(&bd->hdr.bh1.block_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER) == 0 ){
+            if ( poll(&pfd, 1, ring->block_timeout) == -1 && errno != EINTR ){
+                return -1;
+            }
+            if ( idle != NULL ){
+                idle();
+            }
+            continue;
+        }
+
+        tpacket_walk_block(ring, bd, callback, user);
+        ring->cur = (ring->cur + 1) % ring->block_nr;
+        if ( idle != NULL ){
+            idle();
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * add the packets the kernel received and dropped on the ring since the last
+ * call, PACKET_STATISTICS resets its counters when read
+ *
+ * @return: 0, -1 when getsockopt fails
+ */
+int tpacket_stats(struct tpacket_ring *ring, unsigned long long *recv, unsigned long long *drop) {
+    struct tpacket_stats_v3 st;
+    socklen_t len = sizeof(st);
+
+    if ( getsockopt(ring->fd, SOL_PACKET, PACKET_STATISTICS, &st, &len) == -1 ){
+        return -1;
+    }
+    /* tp_packets already counts the dropped ones */
+    *recv += st.tp_packets;
+    *drop += st.tp_drops;
+    return 0;
+}
+
+void tpacket_breakloop(struct tpacket_ring *ring) {
+    ring->stop = 1;
+}
+
+void tpacket_close(struct tpacket_ring *ring) {
+    if ( ring == NULL ){
+        return;
+    }
+    if ( ring->map != MAP_FAILED ){
+        munmap(ring->map, ring->map_len);
+    }
+    if ( ring->fd != -1 ){
+        close(ring->fd);
+    }
+    free(ring);
+}
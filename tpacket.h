@@ -0,0 +1,36 @@
+#ifndef _IPMI_DUMP_TPACKET_H
+#define _IPMI_DUMP_TPACKET_H
+
+#include <pcap.h>
+
+/*
+ * block based AF_PACKET (TPACKET_V3) capture backend, linux only
+ *
+ * the kernel fills whole blocks of the mmap'ed ring and hands them over in one go,
+ * every packet in a retired block is passed to the handler in place(no copy)
+ */
+
+#define TPACKET_DEF_RING_SIZE       (64 << 20)  /* 64MB */
+#define TPACKET_DEF_BLOCK_SIZE      (1 << 20)   /* 1MB */
+#define TPACKET_DEF_BLOCK_TIMEOUT   100         /* ms */
+#define TPACKET_NO_FANOUT           (-1)        /* a standalone ring */
+#define TPACKET_FANOUT_NEW          (-2)        /* a group of an id no other group of the host has */
+
+struct tpacket_opts {
+    unsigned int    ring_size;      /* total bytes of the ring, rounded down to block size */
+    unsigned int    block_size;     /* bytes of one block, must be multiple of page size */
+    unsigned int    block_timeout;  /* ms before the kernel retires a partly filled block */
+    unsigned int    snaplen;        /* enforced by the return value of the compiled filter */
+    int             fanout;         /* PACKET_FANOUT_HASH group id to join, or TPACKET_NO_FANOUT, TPACKET_FANOUT_NEW */
+};
+
+struct tpacket_ring;
+
+struct tpacket_ring* tpacket_open(const char *dev, const struct tpacket_opts *opts, struct bpf_program *fp, char *errbuf);
+int tpacket_loop(struct tpacket_ring *ring, pcap_handler callback, u_char *user, void (*idle)(void));
+int tpacket_fanout_id(struct tpacket_ring *ring);
+int tpacket_stats(struct tpacket_ring *ring, unsigned long long *recv, unsigned long long *drop);
+void tpacket_breakloop(struct tpacket_ring *ring);
+void tpacket_close(struct tpacket_ring *ring);
+
+#endif